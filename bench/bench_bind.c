@@ -0,0 +1,196 @@
+/* Fills the MYSQL_BIND array of a parameter set, once as pst_input.c used */
+/* to, resolving the type name and converting and copying every value into */
+/* a malloc'ed buffer on each bind, once with pst_input_BindParameters on */
+/* sets resolved when they are parsed. Build with `make bench`, run */
+/* ./bench/bench_bind [BINDS] */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "log.h"
+#include "pst_input.h"
+#include "pst_stream.h"
+
+#define BENCH_DEFAULT_BINDS 1000000
+#define BENCH_SETS 1000
+#define BENCH_MARKERS 5
+
+/* PstParameter as it was, the type by name and numbers as double */
+typedef struct OldParameter {
+    char type[16];
+    bool is_unsigned;
+    char* valuestring;
+    double valuedouble;
+} OldParameter;
+
+static double GetSec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* BindParameters of the old pst_input.c for these types */
+static int OldBindParameters(MYSQL_BIND* bind, const OldParameter* param, unsigned long count) {
+    memset(bind, 0, count * sizeof(MYSQL_BIND));
+    for (unsigned long i = 0; i < count; i++) {
+        bind[i].is_unsigned = param[i].is_unsigned;
+        bind[i].buffer_type = pst_ToMySQLFieldType(param[i].type);
+        switch (bind[i].buffer_type) {
+        case MYSQL_TYPE_LONG:
+            bind[i].buffer = malloc(sizeof(int));
+            if (bind[i].buffer == NULL) {
+                return -1;
+            }
+            memset(bind[i].buffer, 0, sizeof(int));
+            *(int*)bind[i].buffer = (int)param[i].valuedouble;
+            break;
+        case MYSQL_TYPE_LONGLONG:
+            bind[i].buffer = malloc(sizeof(long long));
+            if (bind[i].buffer == NULL) {
+                return -1;
+            }
+            memset(bind[i].buffer, 0, sizeof(long long));
+            *(long long*)bind[i].buffer = (long long)param[i].valuedouble;
+            break;
+        case MYSQL_TYPE_DOUBLE:
+            bind[i].buffer = malloc(sizeof(double));
+            if (bind[i].buffer == NULL) {
+                return -1;
+            }
+            memset(bind[i].buffer, 0, sizeof(double));
+            *(double*)bind[i].buffer = param[i].valuedouble;
+            break;
+        case MYSQL_TYPE_DATETIME:
+            bind[i].buffer = malloc(sizeof(MYSQL_TIME));
+            if (bind[i].buffer == NULL) {
+                return -1;
+            }
+            memset(bind[i].buffer, 0, sizeof(MYSQL_TIME));
+            *(MYSQL_TIME*)bind[i].buffer = pst_ToMySQLTime(param[i].valuestring);
+            break;
+        case MYSQL_TYPE_STRING:
+            bind[i].buffer_length = strlen(param[i].valuestring) + 1;
+            bind[i].length = &bind[i].buffer_length;
+            bind[i].buffer = malloc(bind[i].buffer_length);
+            if (bind[i].buffer == NULL) {
+                return -1;
+            }
+            memset(bind[i].buffer, 0, bind[i].buffer_length);
+            memcpy(bind[i].buffer, param[i].valuestring, bind[i].buffer_length);
+            break;
+        default:
+            break;
+        }
+    }
+
+    return 0;
+}
+
+static void OldFreeParameters(MYSQL_BIND* bind, unsigned long count) {
+    for (unsigned long i = 0; i < count; i++) {
+        free(bind[i].buffer);
+        bind[i].buffer = NULL;
+    }
+}
+
+/* [{int}, {bigint unsigned}, {varchar}, {datetime}, {double}] per line */
+static int WriteSets(const char* filename) {
+    static const char* names[] = { "Georgi", "Bezalel", "Parto", "Chirstian", "Kyoichi", "Anneke" };
+
+    FILE* fp = fopen(filename, "w");
+    if (fp == NULL) {
+        return -1;
+    }
+
+    for (unsigned long i = 0; i < BENCH_SETS; i++) {
+        fprintf(fp, "[{\"type\": \"int\", \"value\": %lu}, "
+            "{\"type\": \"bigint\", \"unsigned\": true, \"value\": %lu}, "
+            "{\"type\": \"varchar\", \"value\": \"%s\"}, "
+            "{\"type\": \"datetime\", \"value\": \"1986-06-%02lu 10:20:30\"}, "
+            "{\"type\": \"double\", \"value\": %lu.5}]\n",
+            10001 + i, 4000000000UL + i, names[i % 6], 1 + i % 28, i);
+    }
+
+    return fclose(fp);
+}
+
+int main(int argc, char* argv[]) {
+    long binds = argc > 1 ? atol(argv[1]) : BENCH_DEFAULT_BINDS;
+    if (binds <= 0) {
+        fprintf(stderr, "Usage: %s [BINDS]\n", argv[0]);
+        return 1;
+    }
+
+    const char* tmpdir = getenv("TMPDIR") != NULL ? getenv("TMPDIR") : "/tmp";
+    char filename[256];
+    snprintf(filename, sizeof(filename), "%s/bench_bind_%d.ndjson", tmpdir, (int)getpid());
+    log_set_quiet(true);
+
+    PstParamStream stream;
+    if (WriteSets(filename) != 0 || pst_stream_OpenFile(&stream, filename) != RET_OK) {
+        fprintf(stderr, "Can not write '%s'\n", filename);
+        unlink(filename);
+        return 1;
+    }
+
+    static PstParameter* sets[BENCH_SETS];
+    static OldParameter old_sets[BENCH_SETS][BENCH_MARKERS];
+    static const char* types[BENCH_MARKERS] = { "int", "bigint", "varchar", "datetime", "double" };
+    char datetime[32];
+    for (unsigned long i = 0; i < BENCH_SETS; i++) {
+        unsigned long count = BENCH_MARKERS;
+        if (pst_stream_Next(&stream, &sets[i], &count) != RET_OK || sets[i] == NULL) {
+            fprintf(stderr, "Can not read '%s'\n", filename);
+            unlink(filename);
+            return 1;
+        }
+        for (unsigned long k = 0; k < BENCH_MARKERS; k++) {
+            strcpy(old_sets[i][k].type, types[k]);
+            old_sets[i][k].is_unsigned = sets[i][k].is_unsigned;
+        }
+        old_sets[i][0].valuedouble = sets[i][0].value.integer;
+        old_sets[i][1].valuedouble = (double)(unsigned long long)sets[i][1].value.big;
+        old_sets[i][2].valuestring = strndup(sets[i][2].valuestring, sets[i][2].length);
+        pst_FromMySQLTime(sets[i][3].value.time, MYSQL_TYPE_DATETIME, datetime, sizeof(datetime));
+        old_sets[i][3].valuestring = strdup(datetime);
+        old_sets[i][4].valuedouble = sets[i][4].value.dbl;
+    }
+
+    MYSQL_BIND old_bind[BENCH_MARKERS];
+    double start = GetSec();
+    for (long n = 0; n < binds; n++) {
+        if (OldBindParameters(old_bind, old_sets[n % BENCH_SETS], BENCH_MARKERS) != 0) {
+            fprintf(stderr, "Can not bind\n");
+            return 1;
+        }
+        OldFreeParameters(old_bind, BENCH_MARKERS);
+    }
+    double before = GetSec() - start;
+
+    PstSession session;
+    memset(&session, 0, sizeof(PstSession));
+    start = GetSec();
+    for (long n = 0; n < binds; n++) {
+        if (pst_input_BindParameters(&session, sets[n % BENCH_SETS], BENCH_MARKERS) != RET_OK) {
+            fprintf(stderr, "Can not bind\n");
+            return 1;
+        }
+        pst_input_FreeParameters(&session);
+    }
+    double after = GetSec() - start;
+
+    printf("%-10s %15s %15s\n", "binds", "by name ns", "resolved ns");
+    printf("%-10ld %15.1f %15.1f\n", binds, before * 1e9 / binds, after * 1e9 / binds);
+
+    for (unsigned long i = 0; i < BENCH_SETS; i++) {
+        pst_stream_FreeParameters(sets[i], BENCH_MARKERS);
+        free(old_sets[i][2].valuestring);
+        free(old_sets[i][3].valuestring);
+    }
+    pst_stream_Close(&stream);
+    unlink(filename);
+
+    return 0;
+}
@@ -0,0 +1,149 @@
+/* Cells per second of the fetch loop formatters against the sprintf calls */
+/* they replace. Build with `make bench`, run ./bench/bench_format [CELLS] */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "pst_format.h"
+
+#define BENCH_DEFAULT_CELLS 10000000
+#define BENCH_VALUES 4096
+
+typedef enum enum_bench_kind {
+    BenchKind_Int,
+    BenchKind_LongLong,
+    BenchKind_Double,
+    BenchKind_DateTime,
+
+    BenchKind_Count
+} BenchKind;
+
+static const char* kind_names[BenchKind_Count] = { "int", "bigint", "double", "datetime" };
+
+static int g_ints[BENCH_VALUES];
+static long long g_longlongs[BENCH_VALUES];
+static double g_doubles[BENCH_VALUES];
+static MYSQL_TIME g_times[BENCH_VALUES];
+
+/* keeps the formatted text alive so the calls are not optimized away */
+static volatile size_t g_sink = 0;
+
+static double GetSec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void InitValues() {
+    srand(42);
+    for (int i = 0; i < BENCH_VALUES; i++) {
+        g_ints[i] = rand() - RAND_MAX / 2;
+        g_longlongs[i] = ((long long)rand() << 31 | rand()) * (i % 2 ? 1 : -1);
+        g_doubles[i] = (rand() % 20000000 - 10000000) / 1000.0;
+        memset(&g_times[i], 0, sizeof(MYSQL_TIME));
+        g_times[i].year = 1970 + rand() % 100;
+        g_times[i].month = 1 + rand() % 12;
+        g_times[i].day = 1 + rand() % 28;
+        g_times[i].hour = rand() % 24;
+        g_times[i].minute = rand() % 60;
+        g_times[i].second = rand() % 60;
+    }
+}
+
+static size_t FormatWithSprintf(BenchKind kind, int i, char* text) {
+    const MYSQL_TIME* time = &g_times[i];
+    switch (kind) {
+    case BenchKind_Int:
+        sprintf(text, "%d", g_ints[i]);
+        break;
+    case BenchKind_LongLong:
+        sprintf(text, "%lld", g_longlongs[i]);
+        break;
+    case BenchKind_Double:
+        sprintf(text, "%.2lf", g_doubles[i]);
+        break;
+    default:
+        sprintf(text, "%04d-%02d-%02d %02d:%02d:%02d",
+            time->year, time->month, time->day, time->hour, time->minute, time->second);
+        break;
+    }
+
+    /* the trim loop that followed every sprintf */
+    size_t length = strlen(text);
+    for (int j = strlen(text) - 1; j >= 0; j--) {
+        if (text[j] == ' ') {
+            text[j] = '\0';
+        } else {
+            break;
+        }
+    }
+
+    return length;
+}
+
+static size_t FormatWithPst(BenchKind kind, int i, char* text) {
+    switch (kind) {
+    case BenchKind_Int:
+        return pst_format_Int64(text, g_ints[i]);
+    case BenchKind_LongLong:
+        return pst_format_Int64(text, g_longlongs[i]);
+    case BenchKind_Double:
+        return pst_format_Fixed2(text, g_doubles[i]);
+    default:
+        return pst_format_DateTime(text, &g_times[i]);
+    }
+}
+
+static double Run(size_t (*format)(BenchKind, int, char*), BenchKind kind, long cells) {
+    char text[64];
+    size_t total = 0;
+
+    double start = GetSec();
+    for (long c = 0; c < cells; c++) {
+        total += format(kind, c % BENCH_VALUES, text);
+    }
+    double elapsed = GetSec() - start;
+    g_sink += total;
+
+    return cells / elapsed;
+}
+
+static int Verify() {
+    char expected[64];
+    char text[64];
+    for (int kind = 0; kind < BenchKind_Count; kind++) {
+        for (int i = 0; i < BENCH_VALUES; i++) {
+            FormatWithSprintf(kind, i, expected);
+            FormatWithPst(kind, i, text);
+            if (strcmp(expected, text) != 0) {
+                fprintf(stderr, "%s: \"%s\" should be \"%s\"\n", kind_names[kind], text, expected);
+                return -1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    long cells = argc > 1 ? atol(argv[1]) : BENCH_DEFAULT_CELLS;
+    if (cells <= 0) {
+        fprintf(stderr, "Usage: %s [CELLS]\n", argv[0]);
+        return 1;
+    }
+
+    InitValues();
+    if (Verify() != 0) {
+        return 1;
+    }
+
+    printf("%-10s %15s %15s %8s\n", "type", "sprintf/sec", "pst/sec", "speedup");
+    for (int kind = 0; kind < BenchKind_Count; kind++) {
+        double before = Run(FormatWithSprintf, kind, cells);
+        double after = Run(FormatWithPst, kind, cells);
+        printf("%-10s %15.0f %15.0f %7.1fx\n", kind_names[kind], before, after, after / before);
+    }
+
+    return 0;
+}
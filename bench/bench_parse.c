@@ -0,0 +1,197 @@
+/* Startup time of a large scenario file: generates a statement with */
+/* parameter sets up to the given size and loads it with pst_parse_Parse, */
+/* which maps the file, cuts the "parameter" arrays out of the text for */
+/* pst_stream_Next to parse one set at a time, and builds only the rest of */
+/* the document with cJSON. The line by line loader pst_parse.c used to */
+/* have, which strcat's every line onto the text read so far, runs on */
+/* doubling sizes until it gets too slow. */
+/* Build with `make bench`, run ./bench/bench_parse [MB] */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "cJSON.h"
+#include "log.h"
+#include "pst_parse.h"
+
+#define BENCH_DEFAULT_MB 500
+/* the old loader stops at the first size that takes longer */
+#define BENCH_OLD_LIMIT_SEC 2.0
+
+static double GetSec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* A scenario laid out like statement.json, at least mb megabytes */
+static int WriteScenario(const char* filename, long mb) {
+    static const char* names[] = { "Georgi", "Bezalel", "Parto", "Chirstian", "Kyoichi", "Anneke" };
+
+    FILE* fp = fopen(filename, "w");
+    if (fp == NULL) {
+        return -1;
+    }
+
+    fprintf(fp, "{\n"
+        "    \"user\": \"user\",\n"
+        "    \"password\": \"password\",\n"
+        "    \"host\": \"127.0.0.1\",\n"
+        "    \"port\": 3306,\n"
+        "    \"database\": \"employees\",\n"
+        "    \"prepared_statement\": [\n"
+        "        {\n"
+        "            \"statement\": \"SELECT * FROM employees WHERE emp_no = ? AND first_name = ?\",\n"
+        "            \"parameter\": [\n");
+
+    long target = mb * 1024 * 1024;
+    for (unsigned long i = 0; ftell(fp) < target; i++) {
+        fprintf(fp, "%s"
+            "                [\n"
+            "                    {\n"
+            "                        \"type\": \"int\",\n"
+            "                        \"value\": %lu\n"
+            "                    },\n"
+            "                    {\n"
+            "                        \"type\": \"varchar\",\n"
+            "                        \"value\": \"%s\"\n"
+            "                    }\n"
+            "                ]", i == 0 ? "" : ",\n", 10001 + i, names[i % 6]);
+    }
+
+    fprintf(fp, "\n"
+        "            ]\n"
+        "        }\n"
+        "    ]\n"
+        "}\n");
+
+    return fclose(fp);
+}
+
+/* ReadLine of the old pst_parse.c, one fgetc per character */
+static char* ReadLine(FILE* file, char* buffer) {
+    free(buffer);
+    int buffer_size = 1024;
+    buffer = (char*)calloc(1, buffer_size);
+    if (!buffer) {
+        return NULL;
+    }
+
+    int position = 0;
+    int c;
+    while ((c = fgetc(file)) != EOF && c != '\n') {
+        buffer[position++] = c;
+        if (position >= buffer_size) {
+            buffer_size *= 2;
+            buffer = (char*)realloc(buffer, buffer_size);
+            if (!buffer) {
+                return NULL;
+            }
+            memset(buffer + position, 0, buffer_size - position);
+        }
+    }
+
+    if (position == 0 && c == EOF) {
+        free(buffer);
+        return NULL;
+    }
+    buffer[position] = '\0';
+
+    return buffer;
+}
+
+/* Loading and parsing as the old pst_parse_Parse did it */
+static int LoadWithReadLine(const char* filename) {
+    FILE* fp = fopen(filename, "r");
+    if (fp == NULL) {
+        return -1;
+    }
+
+    char* buffer = NULL;
+    char* str = NULL;
+    unsigned long str_len = 0;
+    while ((buffer = ReadLine(fp, buffer)) != NULL) {
+        str = str ? realloc(str, str_len + strlen(buffer) + 1) : malloc(strlen(buffer) + 1);
+        if (!str) {
+            fclose(fp);
+            return -1;
+        }
+        memset(str + str_len, 0, strlen(buffer) + 1);
+        strcat(str, buffer);
+        str_len += strlen(str);
+    }
+    fclose(fp);
+
+    cJSON* root = cJSON_Parse(str);
+    free(str);
+    if (root == NULL) {
+        return -1;
+    }
+    cJSON_Delete(root);
+
+    return 0;
+}
+
+static double TimeMapped(const char* filename) {
+    double start = GetSec();
+    if (pst_parse_Parse(filename) != RET_OK) {
+        return -1;
+    }
+    double elapsed = GetSec() - start;
+    pst_parse_Free();
+
+    return elapsed;
+}
+
+int main(int argc, char* argv[]) {
+    long mb = argc > 1 ? atol(argv[1]) : BENCH_DEFAULT_MB;
+    if (mb <= 0) {
+        fprintf(stderr, "Usage: %s [MB]\n", argv[0]);
+        return 1;
+    }
+
+    const char* tmpdir = getenv("TMPDIR") != NULL ? getenv("TMPDIR") : "/tmp";
+    char filename[256];
+    snprintf(filename, sizeof(filename), "%s/bench_parse_%d.json", tmpdir, (int)getpid());
+    log_set_quiet(true);
+
+    printf("%-10s %15s %15s\n", "size MB", "readline sec", "mmap sec");
+    bool old_done = false;
+    for (long size = 1; size <= mb && !old_done; size *= 2) {
+        if (WriteScenario(filename, size) != 0) {
+            fprintf(stderr, "Can not write '%s'\n", filename);
+            return 1;
+        }
+        double start = GetSec();
+        if (LoadWithReadLine(filename) != 0) {
+            fprintf(stderr, "Can not load '%s'\n", filename);
+            unlink(filename);
+            return 1;
+        }
+        double before = GetSec() - start;
+        double after = TimeMapped(filename);
+        if (after < 0) {
+            fprintf(stderr, "Can not load '%s'\n", filename);
+            unlink(filename);
+            return 1;
+        }
+        printf("%-10ld %15.3f %15.3f\n", size, before, after);
+        old_done = before > BENCH_OLD_LIMIT_SEC;
+    }
+
+    if (WriteScenario(filename, mb) != 0) {
+        fprintf(stderr, "Can not write '%s'\n", filename);
+        return 1;
+    }
+    double after = TimeMapped(filename);
+    unlink(filename);
+    if (after < 0) {
+        fprintf(stderr, "Can not load '%s'\n", filename);
+        return 1;
+    }
+    printf("%-10ld %15s %15.3f\n", mb, "-", after);
+
+    return 0;
+}
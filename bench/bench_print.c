@@ -0,0 +1,134 @@
+/* Renders a result set as the console table to /dev/null, once with one */
+/* stdio call per dash and cell as pst_print.c used to, once with */
+/* pst_print_PrintResultSet. Build with `make bench`, run */
+/* ./bench/bench_print [ROWS] */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "pst_print.h"
+
+#define BENCH_DEFAULT_ROWS 1000000
+#define BENCH_COLUMNS 6
+
+static double GetSec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* header row plus rows of generated values */
+static PstResultSet* NewResultSet(uint64_t rows) {
+    static const char* names[BENCH_COLUMNS] = { "emp_no", "birth_date", "first_name", "last_name", "gender", "hire_date" };
+    static const char* first_names[] = { "Georgi", "Bezalel", "Parto", "Chirstian", "Kyoichi", "Anneke" };
+    static const char* last_names[] = { "Facello", "Simmel", "Bamford", "Koblick", "Maliniak", "Preusig" };
+
+    PstResultSet* result_set = (PstResultSet*)calloc(1, sizeof(PstResultSet));
+    result_set->column_count = BENCH_COLUMNS;
+    result_set->row_count = rows + 1;
+    result_set->result = (PstResult**)malloc(sizeof(PstResult*) * result_set->row_count);
+    /* 16 bytes hold the longest generated value */
+    char* text = (char*)malloc(result_set->row_count * BENCH_COLUMNS * 16);
+    if (result_set->result == NULL || text == NULL) {
+        return NULL;
+    }
+
+    for (uint64_t row = 0; row < result_set->row_count; row++) {
+        result_set->result[row] = (PstResult*)calloc(BENCH_COLUMNS, sizeof(PstResult));
+        if (result_set->result[row] == NULL) {
+            return NULL;
+        }
+        for (int col = 0; col < BENCH_COLUMNS; col++) {
+            PstResult* cell = &result_set->result[row][col];
+            cell->valuestring = text + (row * BENCH_COLUMNS + col) * 16;
+            if (row == 0) {
+                strcpy(cell->valuestring, names[col]);
+            } else {
+                switch (col) {
+                case 0: sprintf(cell->valuestring, "%lu", (unsigned long)(10000 + row)); break;
+                case 1: sprintf(cell->valuestring, "19%02d-%02d-%02d", (int)(50 + row % 15), (int)(1 + row % 12), (int)(1 + row % 28)); break;
+                case 2: strcpy(cell->valuestring, first_names[row % 6]); break;
+                case 3: strcpy(cell->valuestring, last_names[row % 6]); break;
+                case 4: strcpy(cell->valuestring, row % 2 ? "M" : "F"); break;
+                default: sprintf(cell->valuestring, "19%02d-%02d-%02d", (int)(85 + row % 15), (int)(1 + row % 12), (int)(1 + row % 28)); break;
+                }
+            }
+            unsigned long length = strlen(cell->valuestring);
+            if (length > result_set->result[0][col].field_length) {
+                result_set->result[0][col].field_length = length;
+            }
+        }
+    }
+
+    return result_set;
+}
+
+/* the table as pst_print.c wrote it before it had its own buffer */
+static void PrintBorderWithStdio(FILE* stream, const PstResult* header, uint64_t column_count) {
+    fprintf(stream, "+");
+    for (uint64_t col = 0; col < column_count; col++) {
+        fprintf(stream, "-");
+        for (unsigned long i = 0; i < header[col].field_length; i++) {
+            fprintf(stream, "-");
+        }
+        fprintf(stream, "-+");
+    }
+    fprintf(stream, "\n");
+}
+
+static void PrintRowWithStdio(FILE* stream, const PstResult* header, const PstResult* row, uint64_t column_count) {
+    fprintf(stream, "|");
+    for (uint64_t col = 0; col < column_count; col++) {
+        fprintf(stream, " %-*s ", (int)header[col].field_length, row[col].valuestring);
+        fprintf(stream, "|");
+    }
+    fprintf(stream, "\n");
+}
+
+static void PrintWithStdio(FILE* stream, const PstResultSet* result_set) {
+    const PstResult* header = result_set->result[0];
+    PrintBorderWithStdio(stream, header, result_set->column_count);
+    PrintRowWithStdio(stream, header, header, result_set->column_count);
+    PrintBorderWithStdio(stream, header, result_set->column_count);
+    for (uint64_t row = 1; row < result_set->row_count; row++) {
+        PrintRowWithStdio(stream, header, result_set->result[row], result_set->column_count);
+    }
+    PrintBorderWithStdio(stream, header, result_set->column_count);
+    fflush(stream);
+}
+
+int main(int argc, char* argv[]) {
+    long rows = argc > 1 ? atol(argv[1]) : BENCH_DEFAULT_ROWS;
+    if (rows <= 0) {
+        fprintf(stderr, "Usage: %s [ROWS]\n", argv[0]);
+        return 1;
+    }
+
+    PstResultSet* result_set = NewResultSet(rows);
+    FILE* stream = fopen("/dev/null", "w");
+    if (result_set == NULL || stream == NULL) {
+        fprintf(stderr, "Can not set up the benchmark\n");
+        return 1;
+    }
+
+    double start = GetSec();
+    PrintWithStdio(stream, result_set);
+    double before = GetSec() - start;
+
+    pst_print_SetStream(stream);
+    start = GetSec();
+    pst_print_PrintResultSet(result_set);
+    pst_print_Flush();
+    double after = GetSec() - start;
+
+    printf("%ld rows x %d columns to /dev/null\n", rows, BENCH_COLUMNS);
+    printf("%-10s %10s %15s\n", "writer", "sec", "rows/sec");
+    printf("%-10s %10.3f %15.0f\n", "stdio", before, rows / before);
+    printf("%-10s %10.3f %15.0f\n", "buffered", after, rows / after);
+    printf("speedup %.1fx\n", before / after);
+
+    fclose(stream);
+
+    return 0;
+}
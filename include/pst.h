@@ -46,20 +46,210 @@ typedef enum enum_statement_syntax {
     PstSyntax_Unkown
 } PstSyntax;
 
+typedef enum enum_run_engine {
+    /* one blocking connection per thread */
+    PstEngine_Thread,
+    /* many non-blocking connections multiplexed on a few epoll loops */
+    PstEngine_Event,
+
+    PstEngine_Unknown
+} PstEngine;
+
+typedef enum enum_fetch_mode {
+    /* mysql_stmt_store_result, whole result kept client-side and printed as a table */
+    PstFetchMode_Buffered,
+    /* mysql_stmt_fetch straight off the wire into fixed buffers, row by row */
+    PstFetchMode_Stream,
+    /* read-only server-side cursor, rows fetched prefetch_rows at a time */
+    PstFetchMode_Cursor,
+
+    PstFetchMode_Unknown
+} PstFetchMode;
+
+typedef enum enum_result_layout {
+    /* one PstResult per cell, rows of cells */
+    PstLayout_Rows,
+    /* one typed vector per column */
+    PstLayout_Columns,
+
+    PstLayout_Unknown
+} PstLayout;
+
+typedef enum enum_output_format {
+    /* MySQL console box table */
+    PstOutputFormat_Table,
+    /* rows written as they are fetched, for machine consumers */
+    PstOutputFormat_Csv,
+    PstOutputFormat_Tsv,
+    PstOutputFormat_Ndjson,
+
+    PstOutputFormat_Unknown
+} PstOutputFormat;
+
+typedef enum enum_result_mode {
+    /* keep the result and print it as a table */
+    PstResultMode_Table,
+    /* fetch every row, keep only a running digest and the row and byte counts */
+    PstResultMode_Digest,
+
+    PstResultMode_Unknown
+} PstResultMode;
+
+typedef enum enum_param_format {
+    /* one JSON array of parameter objects per line */
+    PstParamFormat_Ndjson,
+    PstParamFormat_Csv,
+    PstParamFormat_Tsv,
+
+    PstParamFormat_Unknown
+} PstParamFormat;
+
+/* A value as its MYSQL_BIND takes it, resolved when the set is parsed */
 typedef struct PstPreparedStatementParameter {
-    char type[16];
+    PstFieldTypes buffer_type;
     bool is_unsigned;
+    /* valuestring points into a mapped parameter_file and is not freed */
+    bool borrowed;
+    /* numbers in the width of their type, time types in a MYSQL_TIME */
+    union {
+        signed char tiny;
+        short small;
+        int integer;
+        long long big;
+        float real;
+        double dbl;
+        MYSQL_TIME* time;
+    } value;
+    /* STRING and BLOB */
     char* valuestring;
-    double valuedouble;
+    /* bytes at pst_GetParameterBuffer, a string has no terminating NUL */
+    /* when it is borrowed */
+    unsigned long length;
 } PstParameter;
 
+/**
+ *  A scenario compiled by `PSTest compile` (.pstb), for the client library
+ *  and the architecture that wrote it:
+ *  header | statements[statements_size] | skeleton | parameter sets
+ *  Each parameter set is param_markers_count values, each value is a
+ *  PstCompiledValue followed by length bytes in the layout of the buffer
+ *  of its MYSQL_BIND, padded to 8 bytes.
+ */
+#define PST_COMPILED_MAGIC "PSTB"
+#define PST_COMPILED_VERSION 1
+
+typedef struct PstCompiledHeader {
+    char magic[4];
+    uint32_t version;
+    /* sizeof(MYSQL_TIME) of the client library */
+    uint32_t time_size;
+    uint32_t statements_size;
+    /* the scenario file without its parameter sets, JSON text */
+    uint64_t skeleton_offset;
+    uint64_t skeleton_size;
+} PstCompiledHeader;
+
+typedef struct PstCompiledStatement {
+    /* [sets_offset, sets_end) of the file */
+    uint64_t sets_offset;
+    uint64_t sets_end;
+    uint64_t sets_size;
+    uint64_t param_markers_count;
+} PstCompiledStatement;
+
+typedef struct PstCompiledValue {
+    /* enum_field_types */
+    uint8_t buffer_type;
+    uint8_t is_unsigned;
+    uint16_t reserved;
+    uint32_t length;
+} PstCompiledValue;
+
+#define PST_COMPILED_PAD(length) (((length) + 7) & ~(uint64_t)7)
+/* the bytes of a value and the value after it */
+#define PST_COMPILED_DATA(value) ((const char*)((value) + 1))
+#define PST_COMPILED_NEXT(value) \
+    ((const PstCompiledValue*)(PST_COMPILED_DATA(value) + PST_COMPILED_PAD((value)->length)))
+
+/* Parameter sets of one statement, read one at a time from the text of */
+/* its "parameter" array in the mapped scenario file, see pst_stream.h */
+typedef struct PstParamStream {
+    const char* begin;
+    const char* end;
+    const char* cursor;
+    /* pages before it were handed back to the kernel */
+    const char* released;
+    /* one set per line of a parameter_file instead of an array */
+    bool lines;
+    /* the closing bracket of the array is not found yet, end is the end */
+    /* of the document until pst_stream_Take reaches it */
+    bool unread;
+    /* the parameter_file when the stream mapped it */
+    char* map;
+    size_t map_size;
+    /* the text is mapped from a file, the pages read are handed back to */
+    /* the kernel and read again after a rewind. Text read from a pipe */
+    /* into memory stays. */
+    bool mapped;
+    /* FILE* of a parameter_file that can not be mapped, read line by line */
+    void* pipe;
+    char* line;
+    size_t line_size;
+    /* first set of a pipe, read ahead by pst_stream_Peek */
+    PstParameter* peeked;
+    unsigned long peeked_count;
+    /* ',' or '\t' for a CSV or TSV parameter_file, one field per column */
+    char delimiter;
+    PstParameter* columns;
+    unsigned long columns_size;
+    /* sets borrow strings from map, which has to stay until the end */
+    bool lent;
+    /* sets of a compiled scenario, see pst_stream_NextCompiled */
+    bool compiled;
+    unsigned long sets_size;
+    unsigned long sets_read;
+} PstParamStream;
+
+/* Text of one parameter set, taken from a stream by pst_stream_Take and */
+/* parsed by pst_stream_Parse, which needs no lock on the stream */
+typedef struct PstSetText {
+    const PstParamStream* stream;
+    const char* begin;
+    const char* end;
+    /* a line read from a pipe, which the next line is read over */
+    char* copy;
+} PstSetText;
+
+/* Expected result of one parameter set, compared with the digest of */
+/* every execution of it, see pst_verify.h */
+typedef struct PstExpect {
+    bool is_set;
+    uint64_t rows;
+    uint64_t digest;
+} PstExpect;
+
 typedef struct PstPreparedStatement {
     char* stmt;
     unsigned long stmt_len;
     PstSyntax syntax;
+    PstFetchMode fetch_mode;
+    /* rows per COM_STMT_FETCH in cursor mode */
+    unsigned long prefetch_rows;
+    /* storage of a buffered result */
+    PstLayout layout;
+    /* rows layout, fetch straight into the result set instead of copying */
+    bool zero_copy;
+    PstResultMode result_mode;
     PstParameter** params;
     unsigned long param_markers_count;
     unsigned long params_size;
+    /* parameter sets read while the statement runs instead of params, */
+    /* params_size is 0 then */
+    PstParamStream* params_stream;
+    /* one per parameter set, one for a statement without parameters; as */
+    /* many as given for streamed sets, by the order they are read in */
+    PstExpect* expects;
+    unsigned long expects_size;
 } PstPreparedStatement;
 
 typedef struct PstPreparedStatements {
@@ -77,6 +267,64 @@ typedef struct PstConnection {
     unsigned long client_flag;
 } PstConnection;
 
+typedef struct PstScenario {
+    /* worker threads, or connections with the event engine */
+    unsigned int concurrency;
+    /* passes over the prepared statement list, 0 means one pass */
+    /* or, if duration_sec is set, as many passes as fit in it */
+    unsigned long iterations;
+    /* stop replaying after this many seconds, 0 means no limit */
+    double duration_sec;
+    /* target executions per second over all workers, 0 means closed loop */
+    double rate;
+    /* export latency histograms in HdrHistogram log format, empty means no export */
+    char hdr_log[256];
+    PstEngine engine;
+    /* event engine only, threads running an epoll loop each */
+    unsigned int event_loops;
+    PstOutputFormat output_format;
+    /* print through a writer thread instead of on the executing threads */
+    bool async_output;
+    /* read parameter sets from the file as they are executed */
+    bool stream_parameters;
+    /* command line options of every statement, Unknown or 0 when not */
+    /* given, see pst_parse_SetupStatements */
+    PstFetchMode fetch_mode;
+    unsigned long prefetch_rows;
+    PstLayout layout;
+    bool zero_copy;
+    PstResultMode result_mode;
+    /* keep the first result of every parameter set, see pst_verify.h */
+    bool record;
+} PstScenario;
+
+typedef struct PstRunStats {
+    unsigned int threads;
+    /* open connections, equal to threads with the thread engine */
+    unsigned int connections;
+    unsigned long iterations;
+    unsigned long executions;
+    double seconds;
+    /* latency, measured from the intended start time in rate mode */
+    uint64_t latency_total_ns;
+    uint64_t latency_max_ns;
+    /* sends that started later than scheduled, rate mode only */
+    double rate;
+    unsigned long late_sends;
+    uint64_t lateness_total_ns;
+    uint64_t lateness_max_ns;
+    /* largest result arena of any session */
+    size_t arena_high_water;
+    /* rows and value bytes of results in digest mode */
+    uint64_t digest_rows;
+    uint64_t digest_bytes;
+    /* executions compared with an expectation, the ones that differed, */
+    /* and the expectations recorded with --record */
+    unsigned long verify_checked;
+    unsigned long verify_mismatches;
+    unsigned long verify_recorded;
+} PstRunStats;
+
 typedef struct PstResult {
     PstFieldTypes type;
     void* value;
@@ -94,20 +342,130 @@ typedef struct PstResultSet {
     uint64_t row_count;
 } PstResultSet;
 
+/* Column-major result set. Fixed size values (numbers, MYSQL_TIME) are */
+/* stored back to back in values, variable length ones (strings, decimals, */
+/* blobs) in bytes, value r spanning offsets[r] to offsets[r + 1] including */
+/* a terminating '\0'. Bit r of nulls is set when value r is NULL. */
+typedef struct PstColumn {
+    PstFieldTypes type;
+    /* 0 for variable length values */
+    unsigned long value_size;
+    unsigned char* values;
+    uint64_t* offsets;
+    char* bytes;
+    uint64_t bytes_size;
+    uint8_t* nulls;
+} PstColumn;
+
+typedef struct PstColumnSet {
+    PstColumn* columns;
+    uint64_t column_count;
+    uint64_t row_count;
+} PstColumnSet;
+
+/* Bump-pointer arena, memory is handed out in order and released all at once */
+typedef struct PstArenaBlock {
+    struct PstArenaBlock* next;
+    size_t size;
+    size_t used;
+    _Alignas(16) unsigned char data[];
+} PstArenaBlock;
+
+typedef struct PstArena {
+    PstArenaBlock* blocks;
+    size_t block_size;
+    /* bytes handed out since the last reset, and the most ever */
+    size_t used;
+    size_t high_water;
+} PstArena;
+
+typedef struct PstSession PstSession;
+
+/* Receives the rows of a streamed result one at a time, row[col].value holds */
+/* the raw bound value, row[col].valuestring its text. Begin is called once */
+/* with the field metadata, End after the last row. */
+typedef struct PstRowSink {
+    int (*Begin)(PstSession* session, const MYSQL_FIELD* fields, unsigned int field_count);
+    int (*Row)(PstSession* session, const PstResult* row, unsigned int field_count);
+    int (*End)(PstSession* session, uint64_t rows);
+} PstRowSink;
+
+/* Per-session state of the bind, execute and fetch path. */
+/* Every worker owns one session, nothing in it is shared between threads. */
+typedef struct PstSession {
+    /* connection and one prepared handle per statement */
+    MYSQL* mysql;
+    MYSQL_STMT** stmts;
+    unsigned long stmts_size;
+
+    /* parameter binding */
+    MYSQL_BIND* param_bind;
+    unsigned long param_count;
+
+    /* result of the current execution */
+    const PstPreparedStatement* prep_stmt;
+    MYSQL_STMT* stmt;
+    uint64_t exec_start_ns;
+    /* end of the fetch, 0 until the last row of a streamed result */
+    uint64_t fetch_end_ns;
+    /* a streamed result is fetched from here on, its fetch_end_ns is this */
+    /* plus the time spent in mysql_stmt_fetch, without printing the rows */
+    uint64_t stream_start_ns;
+    uint64_t rows;
+    int ret;
+    MYSQL_RES* result_metadata;
+    PstResultSet* result_set;
+    PstColumnSet* column_set;
+    MYSQL_BIND* result_bind;
+    PstResult* result;
+    /* digest mode, see pst_digest.h */
+    uint64_t digest;
+    uint64_t result_bytes;
+    bool digested;
+
+    /* streaming fetch, NULL selects the table sink */
+    const PstRowSink* sink;
+
+    /* every buffer of the current result, reset by pst_output_FreeResult */
+    PstArena arena;
+} PstSession;
+
 #define RET_OK 0
 #define RET_ERR -1
 
 /* CJSON's string type is char*, if SQL type is TIME or DATE or DATETIME or TIMESTAMP, */
 /* we need to convert it to MYSQL_TIME before using it */
 MYSQL_TIME pst_ToMySQLTime(const char* str);
+/* Text of a TIME, DATE, DATETIME or TIMESTAMP value */
+void pst_FromMySQLTime(const MYSQL_TIME* time, PstFieldTypes type, char* buffer, size_t size);
 
 #define PST_FORMAT_MSG_ERR_MYSQL "ERROR %d (%s): %s"
 #define PST_FORMAT_MSG_ERR_ALLOC "Insufficient memory available, variable '%s' was not allocated"
 #define PST_FORMAT_MSG_ERR_FOPEN "Can not open file '%s'"
 
-char* pst_Upper(const char* str);
+/* Upper case copy of str into buffer, returns buffer */
+char* pst_Upper(const char* str, char* buffer, size_t size);
+
+/* Monotonic clock in nanoseconds, used for throughput and latency measurement */
+uint64_t pst_GetMonotonicNs();
+/* Sleep until the monotonic clock reaches ns */
+void pst_SleepUntilNs(uint64_t ns);
+
+/* The whole file in one read-only mapping, size bytes without a terminator. */
+/* A pipe or FIFO can not be mapped and is read into a malloc'ed buffer */
+/* instead, *mapped tells which of the two pst_UnmapFile has to free. */
+char* pst_MapFile(const char* filename, size_t* size, bool* mapped);
+void pst_UnmapFile(char* data, size_t size, bool mapped);
 
 PstFieldTypes pst_ToMySQLFieldType(const char* type_str);
+/* The buffer of a MYSQL_BIND for the parameter, NULL for a NULL */
+const void* pst_GetParameterBuffer(const PstParameter* param);
 PstSyntax pst_GetSyntax(const char* stmt);
+PstEngine pst_ToEngine(const char* engine);
+PstFetchMode pst_ToFetchMode(const char* fetch_mode);
+PstLayout pst_ToLayout(const char* layout);
+PstResultMode pst_ToResultMode(const char* result_mode);
+PstOutputFormat pst_ToOutputFormat(const char* output_format);
+PstParamFormat pst_ToParamFormat(const char* param_format);
 
 #endif /* PST_H */
@@ -0,0 +1,20 @@
+#ifndef PST_ARENA_H
+#define PST_ARENA_H
+
+#include "pst.h"
+
+/* first block of a result arena, it grows by blocks of at least this size */
+#define PST_ARENA_BLOCK_SIZE (64 * 1024)
+
+void pst_arena_Init(PstArena* arena, size_t block_size);
+/* 16-byte aligned, uninitialized memory, NULL when out of memory */
+void* pst_arena_Alloc(PstArena* arena, size_t size);
+/* zero filled */
+void* pst_arena_Calloc(PstArena* arena, size_t size);
+/* Hand out the same memory again. Blocks are kept, and when the last */
+/* use needed more than one they are merged, so the next use of the same */
+/* size is served from one block without calling malloc */
+void pst_arena_Reset(PstArena* arena);
+void pst_arena_Free(PstArena* arena);
+
+#endif /* PST_ARENA_H */
@@ -0,0 +1,17 @@
+#ifndef PST_COMPILE_H
+#define PST_COMPILE_H
+
+#include "pst.h"
+
+/**
+ *  `PSTest compile scenario.json scenario.pstb` writes the scenario with
+ *  every parameter set resolved and encoded for its MYSQL_BIND, see
+ *  PstCompiledHeader. The sets are streamed from the scenario, so any
+ *  number of them can be compiled. A .pstb is run like the JSON file: its
+ *  sets are bound straight from the mapping, without cJSON or conversions.
+ */
+int pst_compile_Compile(const char* filename, const char* output);
+/* *header is NULL when data is not a compiled scenario */
+int pst_compile_Open(const char* data, size_t size, const PstCompiledHeader** header);
+
+#endif /* PST_COMPILE_H */
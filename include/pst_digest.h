@@ -0,0 +1,16 @@
+#ifndef PST_DIGEST_H
+#define PST_DIGEST_H
+
+#include "pst.h"
+
+/* starting value of a result digest */
+#define PST_DIGEST_INIT 0xcbf29ce484222325ULL
+
+/* Running 64-bit digest of a result, FNV-1a over 8-byte words. */
+/* Returns digest updated with size bytes of data. */
+uint64_t pst_digest_Update(uint64_t digest, const void* data, size_t size);
+/* Adds one bound column value, a NULL or its length and bytes so that */
+/* ("ab", "c") and ("a", "bc") differ. Returns the payload size in bytes. */
+size_t pst_digest_AddResult(uint64_t* digest, const PstResult* result);
+
+#endif /* PST_DIGEST_H */
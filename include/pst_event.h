@@ -0,0 +1,12 @@
+#ifndef PST_EVENT_H
+#define PST_EVENT_H
+
+#include "pst.h"
+
+/* Replay the statements over scenario->concurrency non-blocking connections */
+/* multiplexed on scenario->event_loops epoll loops. libmysqlclient has no */
+/* non-blocking prepared statement API, so statements are prepared with SQL */
+/* PREPARE and executed with EXECUTE ... USING over the async text protocol */
+int pst_event_Run(const PstConnection* conn, const PstPreparedStatements* prep_stmts, const PstScenario* scenario);
+
+#endif /* PST_EVENT_H */
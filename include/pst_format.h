@@ -0,0 +1,23 @@
+#ifndef PST_FORMAT_H
+#define PST_FORMAT_H
+
+#include "pst.h"
+
+/* Value formatters of the fetch loop. Each one writes the text of a value */
+/* plus a terminating '\0' into buffer and returns its length without the */
+/* '\0'. The text is the same as the printf format named beside it. */
+
+/* "%lld", at most 20 characters */
+size_t pst_format_Int64(char* buffer, int64_t value);
+/* "%llu", at most 20 characters */
+size_t pst_format_Uint64(char* buffer, uint64_t value);
+/* "%.2f", cut to at most 63 characters */
+size_t pst_format_Fixed2(char* buffer, double value);
+/* "%04d-%02d-%02d" */
+size_t pst_format_Date(char* buffer, const MYSQL_TIME* time);
+/* "%02d:%02d:%02d" */
+size_t pst_format_Time(char* buffer, const MYSQL_TIME* time);
+/* "%04d-%02d-%02d %02d:%02d:%02d" */
+size_t pst_format_DateTime(char* buffer, const MYSQL_TIME* time);
+
+#endif /* PST_FORMAT_H */
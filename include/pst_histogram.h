@@ -0,0 +1,47 @@
+#ifndef PST_HISTOGRAM_H
+#define PST_HISTOGRAM_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/**
+ *  High dynamic range histogram, same bucket layout as HdrHistogram
+ *  so the exported logs can be read and merged by the standard tools.
+ *
+ *  Latencies are recorded in microseconds.
+ */
+typedef struct PstHistogram {
+    int64_t lowest_discernible_value;
+    int64_t highest_trackable_value;
+    int32_t significant_figures;
+    int32_t unit_magnitude;
+    int32_t sub_bucket_half_count_magnitude;
+    int32_t sub_bucket_count;
+    int32_t sub_bucket_half_count;
+    int64_t sub_bucket_mask;
+    int32_t bucket_count;
+    int32_t counts_len;
+    int64_t min_value;
+    int64_t max_value;
+    int64_t total_count;
+    int64_t* counts;
+} PstHistogram;
+
+#define PST_HISTOGRAM_LOWEST 1
+#define PST_HISTOGRAM_HIGHEST 3600000000LL
+#define PST_HISTOGRAM_SIGNIFICANT_FIGURES 3
+
+int pst_histogram_Init(PstHistogram* h, int64_t lowest, int64_t highest, int32_t significant_figures);
+void pst_histogram_Free(PstHistogram* h);
+/* Safe to call from several threads on the same histogram */
+void pst_histogram_Record(PstHistogram* h, int64_t value);
+/* Both histograms must have been initialized with the same parameters */
+void pst_histogram_Add(PstHistogram* to, const PstHistogram* from);
+int64_t pst_histogram_ValueAtPercentile(const PstHistogram* h, double percentile);
+double pst_histogram_Mean(const PstHistogram* h);
+
+/* HdrHistogram log format version 1.3 */
+void pst_histogram_WriteLogHeader(FILE* file, double start_time);
+int pst_histogram_WriteLogInterval(FILE* file, const char* tag, double start, double length, const PstHistogram* h);
+
+#endif /* PST_HISTOGRAM_H */
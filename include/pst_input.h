@@ -3,7 +3,21 @@
 
 #include "pst.h"
 
-int pst_input_InputParameters(MYSQL_STMT* stmt, PstParameter* param, unsigned long count);
-void pst_input_FreeParameters();
+/**
+ *  Bind arrays of the parameter sets held in memory, built once before the
+ *  run: one block per statement with an array of param_markers_count binds
+ *  per set, pointing at the values of the set. Streamed and compiled sets
+ *  are bound when they are read.
+ */
+int pst_input_Init(const PstPreparedStatements* prep_stmts);
+/* session->param_bind for the set, nothing is copied */
+int pst_input_BindParameters(PstSession* session, const PstParameter* param, unsigned long count);
+int pst_input_InputParameters(PstSession* session, MYSQL_STMT* stmt, PstParameter* param, unsigned long count);
+/* Binds the array built by pst_input_Init, nothing is allocated */
+int pst_input_InputPrepared(PstSession* session, MYSQL_STMT* stmt, unsigned long stmt_index, unsigned long params_index, unsigned long count);
+/* Binds a set of a compiled scenario, the buffers point into its mapping */
+int pst_input_InputCompiled(PstSession* session, MYSQL_STMT* stmt, const PstCompiledValue* set, unsigned long count);
+void pst_input_FreeParameters(PstSession* session);
+void pst_input_Free();
 
 #endif /* PST_INPUT_H */
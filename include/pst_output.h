@@ -3,7 +3,14 @@
 
 #include "pst.h"
 
-int pst_output_OutputResult(MYSQL_STMT* stmt, PstSyntax syntax);
-void pst_output_FreeResult();
+/* Fetch the result of an executed statement into the session, nothing is */
+/* printed. A result the server streams (prep_stmt->fetch_mode) is fetched */
+/* by pst_output_PrintResult instead, row by row into session->sink. */
+int pst_output_FetchResult(PstSession* session, MYSQL_STMT* stmt, const PstPreparedStatement* prep_stmt);
+/* Print the result kept by pst_output_FetchResult */
+int pst_output_PrintResult(PstSession* session);
+void pst_output_FreeResult(PstSession* session);
+/* Statement attributes of prep_stmt->fetch_mode, set once after prepare */
+int pst_output_SetFetchMode(MYSQL_STMT* stmt, const PstPreparedStatement* prep_stmt);
 
 #endif /* PST_OUTPUT_H */
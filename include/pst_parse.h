@@ -3,9 +3,38 @@
 
 #include "pst.h"
 
+/* first room of the text kept by the scan, doubled as it grows */
+#define PST_SKELETON_SIZE (64 * 1024)
+
+/**
+ *  With "stream_parameters": true given before "prepared_statement", after
+ *  the connection, the scan of the document stops at the first parameter
+ *  array that follows the "statement" of its element. The run starts
+ *  there, the rest of the document is read by pst_parse_ReadMore once the
+ *  run has taken the sets up to the end of that array.
+ */
 int pst_parse_Parse(const char* filename);
+/* Every statement streams its parameter sets, whatever the scenario says, */
+/* and the whole document is read; call it before pst_parse_Parse */
+void pst_parse_StreamParameters();
+/* The end of the array the scan stopped at is found, the statements after */
+/* it are still to be read */
+bool pst_parse_MoreToRead();
+/* Appends the statements after the array to the prepared statements, set */
+/* up like the others; nothing may use the statements while it runs. */
+int pst_parse_ReadMore();
+/* Applies the command line options of the scenario and the verification to */
+/* every statement, and to those read later */
+int pst_parse_SetupStatements();
+/* The document without its parameter sets, as cJSON parsed it at startup, */
+/* whole for pst_parse_StreamParameters */
+const char* pst_parse_GetSkeleton(size_t* size);
 PstConnection* pst_parse_GetConnection();
+PstScenario* pst_parse_GetScenario();
 PstPreparedStatements* pst_parse_GetPreparedStatement();
+/* Expectations of a sidecar written by --record, for the parameter sets */
+/* that have none in the statement file */
+int pst_parse_ParseExpectations(const char* filename);
 void pst_parse_Free();
 
-#endif /* PST_PARSE_H */
\ No newline at end of file
+#endif /* PST_PARSE_H */
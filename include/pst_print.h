@@ -4,14 +4,61 @@
 #include <stdarg.h>
 
 #include "pst.h"
+#include "pst_histogram.h"
 
+/* Output is buffered and written in large blocks, after every execution */
+/* when the stream is a terminal. Flush before writing to the stream directly. */
 void pst_print_SetStream(void* stream);
+void pst_print_Flush();
+/* Output goes through a bounded ring to a writer thread of its own, so a */
+/* slow stream does not stall the executors until the ring is full */
+int pst_print_StartWriter();
+void pst_print_StopWriter();
+/* Table is the console output. The other formats write nothing but the */
+/* result rows to the stream, the run report goes to stderr. */
+void pst_print_SetFormat(PstOutputFormat format);
+PstOutputFormat pst_print_GetFormat();
 void pst_print_PrintExceptionMessage();
 void pst_print_PrintConnection(const PstConnection* conn);
 void pst_print_PrintStatement(const PstPreparedStatement* prep_stmt, const unsigned long  prep_stmt_index);
 void pst_print_PrintParameter(const PstParameter* param, const unsigned long param_markers_count, const unsigned long params_index);
+void pst_print_PrintCompiledParameter(const PstCompiledValue* set, const unsigned long param_markers_count, const unsigned long params_index);
 void pst_print_PrintResultSet(const PstResultSet* result_set);
+/* Pieces of the result set table for rows printed one at a time, */
+/* column widths are header[col].field_length */
+void pst_print_PrintResultSetBorder(const PstResult* header, uint64_t column_count);
+void pst_print_PrintResultSetRow(const PstResult* header, const PstResult* row, uint64_t column_count);
+/* Rows in the machine formats, written as they are fetched */
+void pst_print_BeginRows(const MYSQL_FIELD* fields, unsigned int field_count);
+void pst_print_PrintRow(const PstResult* row, unsigned int field_count);
+void pst_print_EndRows(uint64_t rows);
 void pst_print_PrintExecutionMessage(const char* fmt, ...);
+void pst_print_PrintRunSummary(const PstRunStats* stats);
+void pst_print_PrintHistogramHeader();
+void pst_print_PrintHistogram(const char* label, const PstHistogram* h, double seconds);
+void pst_print_PrintPhaseHeader();
+void pst_print_PrintPhase(const char* label, const PstHistogram* h, uint64_t total_ns);
+void pst_print_PrintPhaseSplit(uint64_t server_ns, uint64_t client_ns);
+
+/* Group output of one execution when several workers share the stream */
+void pst_print_Lock();
+void pst_print_Unlock();
+
+/* Output of one execution collected by its worker apart from the shared */
+/* buffer, the memory is kept for the next execution */
+typedef struct PstPrintChunk {
+    char* data;
+    size_t used;
+    size_t size;
+} PstPrintChunk;
+
+/* Until pst_print_EndChunk, whatever the calling thread prints goes to */
+/* chunk, without the print lock */
+void pst_print_BeginChunk(PstPrintChunk* chunk);
+void pst_print_EndChunk();
+/* The collected output, with the print lock held */
+void pst_print_PrintChunk(const PstPrintChunk* chunk);
+void pst_print_FreeChunk(PstPrintChunk* chunk);
 
 /**
  *  MySQL messages will be printed
@@ -40,6 +87,9 @@ void pst_print_PrintExecutionMessage(const char* fmt, ...);
  Msg6 EmptySet:
  Empty set (0.02 sec)
 
+ Msg7 RowsDigested:
+ 1000 rows digested, 52000 bytes, digest 5c3a1f0e9b7d2468 (0.02 sec)
+
 
  Result set will be printed as follows:
  ResultSet:
@@ -53,11 +103,12 @@ void pst_print_PrintExecutionMessage(const char* fmt, ...);
 
  /* Msg1~4 all format Msg1 now */
 
-#define pst_print_PrintRowsAffected(rows) pst_print_PrintExecutionMessage("Query OK, %d %s affected", rows, rows == 1 ? "row" : "rows")
-#define pst_print_PrintRowsAffectedAndDuplicate(rows) pst_print_PrintRowsAffected(rows)
-#define pst_print_PrintRowsAffectedIncludeWarnings(rows) pst_print_PrintRowsAffected(rows)
-#define pst_print_PrintRowsAffectedAndChanged(rows) pst_print_PrintRowsAffected(rows)
-#define pst_print_PrintRowsInSet(rows) pst_print_PrintExecutionMessage("%d %s in set", rows, rows == 1 ? "row" : "rows")
-#define pst_print_PrintEmptySet() pst_print_PrintExecutionMessage("Empty set")
+#define pst_print_PrintRowsAffected(rows, sec) pst_print_PrintExecutionMessage("Query OK, %llu %s affected (%.2f sec)", (unsigned long long)(rows), rows == 1 ? "row" : "rows", sec)
+#define pst_print_PrintRowsAffectedAndDuplicate(rows, sec) pst_print_PrintRowsAffected(rows, sec)
+#define pst_print_PrintRowsAffectedIncludeWarnings(rows, sec) pst_print_PrintRowsAffected(rows, sec)
+#define pst_print_PrintRowsAffectedAndChanged(rows, sec) pst_print_PrintRowsAffected(rows, sec)
+#define pst_print_PrintRowsInSet(rows, sec) pst_print_PrintExecutionMessage("%llu %s in set (%.2f sec)", (unsigned long long)(rows), rows == 1 ? "row" : "rows", sec)
+#define pst_print_PrintRowsDigested(rows, bytes, digest, sec) pst_print_PrintExecutionMessage("%llu %s digested, %llu bytes, digest %016llx (%.2f sec)", (unsigned long long)(rows), rows == 1 ? "row" : "rows", (unsigned long long)(bytes), (unsigned long long)(digest), sec)
+#define pst_print_PrintEmptySet(sec) pst_print_PrintExecutionMessage("Empty set (%.2f sec)", sec)
 
 #endif  /* PST_PRINT_H */
@@ -0,0 +1,60 @@
+#ifndef PST_QUEUE_H
+#define PST_QUEUE_H
+
+#include "pst.h"
+
+typedef struct PstWorkItem {
+    unsigned long stmt_index;
+    unsigned long params_index;
+    /* the parameter set, NULL for a statement without any */
+    PstParameter* param;
+    /* read from a stream for this item, see pst_queue_Release */
+    bool owns_param;
+    /* the parameter set of a compiled scenario instead of param */
+    const PstCompiledValue* compiled;
+    unsigned long iteration;
+    /* scheduled start in rate mode, 0 in closed loop */
+    uint64_t intended_start;
+    /* handed out and not released yet */
+    bool pending;
+} PstWorkItem;
+
+typedef enum enum_queue_status {
+    PstQueue_Item,
+    /* the next statement waits for the items of the one before it */
+    PstQueue_Fenced,
+    /* the run is over */
+    PstQueue_Over,
+} PstQueueStatus;
+
+/**
+ *  Shared queue of work items, walks prep_stmt[i].params[j] in order, or
+ *  reads them from prep_stmt[i].params_stream, and starts over until the
+ *  iterations or the deadline are reached.
+ *  In rate mode item n is scheduled at start + n / rate.
+ *  A statement that changes the schema or the server is fenced: it is only
+ *  handed out once every item of the statement before it is released, and
+ *  the statement after it waits for it in turn, see IsFenced.
+ *  The first pass that reaches the end of the array the scan stopped at
+ *  waits the same way, then reads the statements after it, see
+ *  pst_parse_ReadMore.
+ */
+int pst_queue_Init(const PstPreparedStatements* prep_stmts, const PstScenario* scenario);
+/* Starts the deadline and the schedule */
+void pst_queue_Start(uint64_t start);
+/* Safe to call from several threads, returns false when the run is over. */
+/* A streamed set is parsed by the caller after the queue is unlocked. */
+/* Waits at a fence until the items before it are released. */
+bool pst_queue_Next(PstWorkItem* item);
+/* pst_queue_Next for an event loop, returns at a fence instead of waiting */
+PstQueueStatus pst_queue_TryNext(PstWorkItem* item);
+/* Once the item has run, frees a streamed parameter set. Returns true when */
+/* it was the last item ahead of a fence, callers of pst_queue_TryNext that */
+/* were fenced may ask again. Does nothing for an item already released. */
+bool pst_queue_Release(PstWorkItem* item);
+/* A streamed parameter set could not be read, the run ended early */
+bool pst_queue_Failed();
+unsigned long pst_queue_GetIterations();
+void pst_queue_Free();
+
+#endif /* PST_QUEUE_H */
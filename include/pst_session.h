@@ -0,0 +1,13 @@
+#ifndef PST_SESSION_H
+#define PST_SESSION_H
+
+#include "pst.h"
+
+/* Connect, the statement handles are prepared by pst_session_GetStatement */
+int pst_session_Open(PstSession* session, const PstConnection* conn, const PstPreparedStatements* prep_stmts);
+/* Handle of prep_stmt, statement index of the list, prepared on first use */
+MYSQL_STMT* pst_session_GetStatement(PstSession* session, const PstPreparedStatement* prep_stmt, unsigned long index);
+/* Free parameters and results, close statement handles and connection */
+void pst_session_Close(PstSession* session);
+
+#endif /* PST_SESSION_H */
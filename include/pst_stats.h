@@ -0,0 +1,24 @@
+#ifndef PST_STATS_H
+#define PST_STATS_H
+
+#include "pst.h"
+
+/* a send starting later than this behind schedule is reported as late */
+#define PST_SCHEDULE_TOLERANCE_NS 1000000ULL
+
+/* Latency histograms per statement and phase timings, shared by all engines */
+int pst_stats_Init(const PstPreparedStatements* prep_stmts);
+/* Histograms of the statements read after the run started, while none runs */
+int pst_stats_AddStatements(const PstPreparedStatements* prep_stmts);
+void pst_stats_Free();
+
+/* Per-engine counters are kept in a PstRunStats and merged at the end */
+void pst_stats_RecordLatency(PstRunStats* stats, unsigned long stmt_index, uint64_t latency_ns);
+void pst_stats_RecordLateness(PstRunStats* stats, uint64_t lateness_ns);
+void pst_stats_Merge(PstRunStats* to, const PstRunStats* from);
+
+/* Summary, percentiles per statement and phase breakdown, */
+/* optionally exported as HdrHistogram log */
+void pst_stats_Report(const PstScenario* scenario, const PstRunStats* stats);
+
+#endif /* PST_STATS_H */
@@ -0,0 +1,61 @@
+#ifndef PST_STREAM_H
+#define PST_STREAM_H
+
+#include "cJSON.h"
+#include "pst.h"
+
+/* Lexical helpers over JSON text in [p, end), they check the nesting of */
+/* brackets and strings but leave the grammar to cJSON. NULL when the text */
+/* ends before the value does. */
+const char* pst_stream_SkipSpace(const char* p, const char* end);
+/* p at the opening quote, returns the position after the closing one */
+const char* pst_stream_SkipString(const char* p, const char* end);
+/* p at the first character of any value, returns the position after it */
+const char* pst_stream_SkipValue(const char* p, const char* end);
+
+/* array at the opening bracket of a "parameter" array, returns the end */
+/* of the array. The text must stay mapped while the stream is used, and */
+/* is released from memory until the sets are read when it is mapped. */
+const char* pst_stream_Open(PstParamStream* stream, const char* array, const char* end, bool mapped);
+/* The same without reading the array, end is the end of the document. The */
+/* closing bracket is found when the sets have been taken up to it, see */
+/* PstParamStream.unread. */
+void pst_stream_OpenUnread(PstParamStream* stream, const char* array, const char* end, bool mapped);
+/* A parameter_file, one set per line. "-" is stdin, which like any pipe */
+/* is read as it comes and can be read once only. */
+int pst_stream_OpenFile(PstParamStream* stream, const char* filename);
+/* Reads the file as CSV or TSV instead, one field for each of columns, */
+/* which carry the type and sign of the values. The stream frees columns. */
+void pst_stream_SetColumns(PstParamStream* stream, char delimiter, PstParameter* columns, unsigned long columns_size);
+void pst_stream_Close(PstParamStream* stream);
+
+/* any number of values, see pst_stream_Next */
+#define PST_STREAM_ANY_COUNT ((unsigned long)-1)
+
+/**
+ *  Parses the next parameter set into a new array of *count values, *param
+ *  is NULL after the last set. PST_STREAM_ANY_COUNT takes the size of the
+ *  set and returns it in *count. Text that was read is released from
+ *  memory, so a pass over any number of sets holds one set at a time.
+ */
+int pst_stream_Next(PstParamStream* stream, PstParameter** param, unsigned long* count);
+/* pst_stream_Next in two steps, for a stream shared under a lock: Take */
+/* moves the stream past the next set and leaves its text, or *param when */
+/* it is parsed already, and Parse turns the text into *param without */
+/* touching the stream. text->begin is NULL when there is none to parse. */
+int pst_stream_Take(PstParamStream* stream, PstParameter** param, unsigned long* count, PstSetText* text);
+int pst_stream_Parse(PstSetText* text, PstParameter** param, unsigned long* count);
+/* Sets of a statement in a mapped compiled scenario, see PstCompiledHeader */
+void pst_stream_OpenCompiled(PstParamStream* stream, const char* begin, const char* end, unsigned long sets_size, bool mapped);
+/* *set is the first of count values of the next set in the mapping, NULL */
+/* after the last. Nothing is parsed or allocated. */
+int pst_stream_NextCompiled(PstParamStream* stream, unsigned long count, const PstCompiledValue** set);
+/* *count is the size of the first set, PST_STREAM_ANY_COUNT without any */
+int pst_stream_Peek(PstParamStream* stream, unsigned long* count);
+/* Start over from the first set, a pipe stays at its end */
+void pst_stream_Rewind(PstParamStream* stream);
+/* "type" and "unsigned" of a parameter object, or of a column */
+int pst_stream_ParseType(const cJSON* object, PstParameter* param);
+void pst_stream_FreeParameters(PstParameter* param, unsigned long count);
+
+#endif /* PST_STREAM_H */
@@ -0,0 +1,28 @@
+#ifndef PST_TIMING_H
+#define PST_TIMING_H
+
+#include "pst.h"
+
+/* Client side phases of one execution */
+typedef enum enum_timing_phase {
+    PstPhase_Prepare,
+    PstPhase_Bind,
+    PstPhase_Execute,
+    PstPhase_Store,
+    PstPhase_Fetch,
+    PstPhase_Format,
+    PstPhase_Print,
+    /* from the start of mysql_stmt_execute to the first and the last row */
+    PstPhase_FirstRow,
+    PstPhase_LastRow,
+
+    PstPhase_Count
+} PstPhase;
+
+int pst_timing_Init();
+void pst_timing_Free();
+/* Safe to call from several workers at once */
+void pst_timing_Record(PstPhase phase, uint64_t ns);
+void pst_timing_Report();
+
+#endif /* PST_TIMING_H */
@@ -0,0 +1,33 @@
+#ifndef PST_VERIFY_H
+#define PST_VERIFY_H
+
+#include "pst.h"
+
+typedef enum enum_verify_result {
+    /* no expectation for the parameter set */
+    PstVerify_None,
+    PstVerify_Match,
+    PstVerify_Mismatch,
+    /* first result of the parameter set under --record, kept as expectation */
+    PstVerify_Recorded,
+} PstVerifyResult;
+
+/**
+ *  Golden-result verification. The rows and digest of every digested
+ *  execution are compared with the expectation of its parameter set,
+ *  nothing of the result is kept. With record, parameter sets without
+ *  expectation take their first result as one, later executions are
+ *  compared with it, and pst_verify_Write saves them all.
+ */
+int pst_verify_Init(const PstPreparedStatements* prep_stmts, bool record);
+/* Expectations of the statements read after the run started */
+int pst_verify_AddStatements(const PstPreparedStatements* prep_stmts);
+bool pst_verify_HasExpectations(const PstPreparedStatement* prep_stmt);
+/* Safe to call from several workers at once */
+PstVerifyResult pst_verify_Check(unsigned long stmt_index, unsigned long params_index, uint64_t rows, uint64_t digest);
+unsigned long pst_verify_GetMismatches();
+/* Sidecar in the "prepared_statement" / "expect" form of the statement file */
+int pst_verify_Write(const char* filename);
+void pst_verify_Free();
+
+#endif /* PST_VERIFY_H */
@@ -0,0 +1,11 @@
+#ifndef PST_WORKER_H
+#define PST_WORKER_H
+
+#include "pst.h"
+
+/* Replay every (statement, parameter set) pair on scenario->concurrency workers */
+/* for the configured iterations or duration, each worker owns its own */
+/* connection and prepared statement handles */
+int pst_worker_Run(const PstConnection* conn, const PstPreparedStatements* prep_stmts, const PstScenario* scenario);
+
+#endif /* PST_WORKER_H */
@@ -2,49 +2,232 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
 #include <mysql/mysql.h>
 
 #include "log.h"
 #include "pst.h"
+#include "pst_compile.h"
 #include "pst_parse.h"
 #include "pst_print.h"
-#include "pst_input.h"
-#include "pst_output.h"
+#include "pst_worker.h"
+#include "pst_event.h"
+#include "pst_verify.h"
 
-static void FreeResources(FILE* log_file, MYSQL* mysql, MYSQL_STMT* stmt) {
-    pst_input_FreeParameters();
-    pst_output_FreeResult();
+static pthread_mutex_t log_mutex = PTHREAD_MUTEX_INITIALIZER;
 
-    if (stmt) {
-        mysql_stmt_close(stmt);
-        stmt = NULL;
+static void LockLog(bool lock, void* udata) {
+    if (lock) {
+        pthread_mutex_lock((pthread_mutex_t*)udata);
+    } else {
+        pthread_mutex_unlock((pthread_mutex_t*)udata);
     }
+}
 
-    if (mysql) {
-        mysql_close(mysql);
-        mysql = NULL;
-    }
+static void PrintUsage(const char* prog) {
+    fprintf(stderr, "Usage: %s [--threads N] [--iterations N] [--duration SEC] [--rate N] [--hdr-log FILE] [--engine thread|event] [--event-loops N] [--fetch buffered|stream|cursor] [--prefetch-rows N] [--layout rows|columns] [--zero-copy] [--result-mode table|digest] [--record] [--format table|csv|tsv|ndjson] [--async-output] [JSON PATH]\n"
+        "       %s compile JSON_PATH PSTB_PATH\n", prog, prog);
+}
+
+static void FreeResources(FILE* log_file) {
+    pst_print_StopWriter();
 
     if (log_file) {
         fclose(log_file);
         log_file = NULL;
     }
 
+    pst_verify_Free();
     pst_parse_Free();
 }
 
+/* PSTest compile scenario.json scenario.pstb */
+static int Compile(int argc, char* argv[]) {
+    if (argc != 4) {
+        PrintUsage(argv[0]);
+        return RET_ERR;
+    }
+
+    FILE* file_log = fopen("pst.log", "a+");
+    if (file_log == NULL) {
+        fprintf(stderr, "Can not open log file.\n");
+        return RET_ERR;
+    }
+
+    log_set_level(LOG_ERROR);
+    log_set_lock(LockLog, &log_mutex);
+    log_add_fp(file_log, LOG_TRACE);
+
+    pst_print_SetStream(stdout);
+    if (pst_compile_Compile(argv[2], argv[3]) != RET_OK) {
+        FreeResources(file_log);
+        pst_print_PrintExceptionMessage();
+        return RET_ERR;
+    }
+    fprintf(stdout, "Compiled '%s' into '%s'.\n", argv[2], argv[3]);
+    FreeResources(file_log);
+
+    return RET_OK;
+}
+
 int main(int argc, char* argv[]) {
+    if (argc > 1 && strcmp(argv[1], "compile") == 0) {
+        return Compile(argc, argv);
+    }
+
     /* Check arguments */
+    unsigned int threads = 0;
+    unsigned long iterations = 0;
+    double duration_sec = 0;
+    double rate = 0;
+    const char* hdr_log = NULL;
+    PstEngine engine = PstEngine_Unknown;
+    unsigned int event_loops = 0;
+    PstFetchMode fetch_mode = PstFetchMode_Unknown;
+    unsigned long prefetch_rows = 0;
+    PstLayout layout = PstLayout_Unknown;
+    bool zero_copy = false;
+    PstResultMode result_mode = PstResultMode_Unknown;
+    bool record = false;
+    PstOutputFormat output_format = PstOutputFormat_Unknown;
+    bool async_output = false;
+
+    static struct option long_options[] = {
+        { "threads",    required_argument, NULL, 't' },
+        { "iterations", required_argument, NULL, 'n' },
+        { "duration",   required_argument, NULL, 'd' },
+        { "rate",       required_argument, NULL, 'r' },
+        { "hdr-log",    required_argument, NULL, 'l' },
+        { "engine",     required_argument, NULL, 'e' },
+        { "event-loops", required_argument, NULL, 'L' },
+        { "fetch",      required_argument, NULL, 'f' },
+        { "prefetch-rows", required_argument, NULL, 'p' },
+        { "layout",     required_argument, NULL, 'y' },
+        { "zero-copy",  no_argument,       NULL, 'z' },
+        { "result-mode", required_argument, NULL, 'm' },
+        { "record",     no_argument,       NULL, 'R' },
+        { "format",     required_argument, NULL, 'F' },
+        { "async-output", no_argument,     NULL, 'A' },
+        { "help",    no_argument,       NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "t:n:d:r:l:e:L:f:p:y:zm:RF:Ah", long_options, NULL)) != -1) {
+        switch (opt) {
+        case 't':
+            threads = (unsigned int)strtoul(optarg, NULL, 10);
+            if (threads == 0) {
+                fprintf(stderr, "Invalid number of threads '%s'.\n", optarg);
+                return RET_ERR;
+            }
+            break;
+        case 'n':
+            iterations = strtoul(optarg, NULL, 10);
+            if (iterations == 0) {
+                fprintf(stderr, "Invalid number of iterations '%s'.\n", optarg);
+                return RET_ERR;
+            }
+            break;
+        case 'd':
+            duration_sec = strtod(optarg, NULL);
+            if (duration_sec <= 0) {
+                fprintf(stderr, "Invalid duration '%s'.\n", optarg);
+                return RET_ERR;
+            }
+            break;
+        case 'r':
+            rate = strtod(optarg, NULL);
+            if (rate <= 0) {
+                fprintf(stderr, "Invalid rate '%s'.\n", optarg);
+                return RET_ERR;
+            }
+            break;
+        case 'l':
+            if (strlen(optarg) >= sizeof(((PstScenario*)0)->hdr_log)) {
+                fprintf(stderr, "Histogram log path '%s' is too long.\n", optarg);
+                return RET_ERR;
+            }
+            hdr_log = optarg;
+            break;
+        case 'e':
+            engine = pst_ToEngine(optarg);
+            if (engine == PstEngine_Unknown) {
+                fprintf(stderr, "Invalid engine '%s'.\n", optarg);
+                return RET_ERR;
+            }
+            break;
+        case 'L':
+            event_loops = (unsigned int)strtoul(optarg, NULL, 10);
+            if (event_loops == 0) {
+                fprintf(stderr, "Invalid number of event loops '%s'.\n", optarg);
+                return RET_ERR;
+            }
+            break;
+        case 'f':
+            fetch_mode = pst_ToFetchMode(optarg);
+            if (fetch_mode == PstFetchMode_Unknown) {
+                fprintf(stderr, "Invalid fetch mode '%s'.\n", optarg);
+                return RET_ERR;
+            }
+            break;
+        case 'p':
+            prefetch_rows = strtoul(optarg, NULL, 10);
+            if (prefetch_rows == 0) {
+                fprintf(stderr, "Invalid number of prefetch rows '%s'.\n", optarg);
+                return RET_ERR;
+            }
+            break;
+        case 'y':
+            layout = pst_ToLayout(optarg);
+            if (layout == PstLayout_Unknown) {
+                fprintf(stderr, "Invalid layout '%s'.\n", optarg);
+                return RET_ERR;
+            }
+            break;
+        case 'z':
+            zero_copy = true;
+            break;
+        case 'm':
+            result_mode = pst_ToResultMode(optarg);
+            if (result_mode == PstResultMode_Unknown) {
+                fprintf(stderr, "Invalid result mode '%s'.\n", optarg);
+                return RET_ERR;
+            }
+            break;
+        case 'R':
+            record = true;
+            break;
+        case 'F':
+            output_format = pst_ToOutputFormat(optarg);
+            if (output_format == PstOutputFormat_Unknown) {
+                fprintf(stderr, "Invalid output format '%s'.\n", optarg);
+                return RET_ERR;
+            }
+            break;
+        case 'A':
+            async_output = true;
+            break;
+        case 'h':
+            PrintUsage(argv[0]);
+            return 0;
+        default:
+            PrintUsage(argv[0]);
+            return RET_ERR;
+        }
+    }
+
     char file_json[256];
     memset(file_json, 0, sizeof(file_json));
-    if (argc < 2) {
+    if (optind == argc) {
         strcpy(file_json, argv[0]);
         char* p = strrchr(file_json, '/');
         p[0] = 0;
         strcat(file_json, "/statement.json");
         fprintf(stdout, "No arguments is provided, the default file '%s' will be input.\n", file_json);
-    } else if (argc == 2) {
-        strcpy(file_json, argv[1]);
+    } else if (optind == argc - 1) {
+        strcpy(file_json, argv[optind]);
     } else {
         fprintf(stderr, "Too many arguments is provided.\n");
         return RET_ERR;
@@ -63,6 +246,7 @@ int main(int argc, char* argv[]) {
     }
 
     log_set_level(LOG_ERROR);
+    log_set_lock(LockLog, &log_mutex);
     log_add_fp(file_log, LOG_TRACE);
 
     /* Set stream for output */
@@ -70,133 +254,129 @@ int main(int argc, char* argv[]) {
 
     /* Parse statement json */
     if (pst_parse_Parse(file_json) != RET_OK) {
-        FreeResources(file_log, NULL, NULL);
+        FreeResources(file_log);
         pst_print_PrintExceptionMessage();
         return RET_ERR;
     }
 
     PstConnection* connection = pst_parse_GetConnection();
     if (connection == NULL) {
-        FreeResources(file_log, NULL, NULL);
+        FreeResources(file_log);
         pst_print_PrintExceptionMessage();
         return RET_ERR;
     }
     log_info("Get connection information successfully.");
+
+    PstScenario* scenario = pst_parse_GetScenario();
+    if (threads > 0) {
+        /* command line overrides the JSON */
+        scenario->concurrency = threads;
+    }
+    if (iterations > 0) {
+        scenario->iterations = iterations;
+    }
+    if (duration_sec > 0) {
+        scenario->duration_sec = duration_sec;
+    }
+    if (rate > 0) {
+        scenario->rate = rate;
+    }
+    if (hdr_log != NULL) {
+        strcpy(scenario->hdr_log, hdr_log);
+    }
+    if (engine != PstEngine_Unknown) {
+        scenario->engine = engine;
+    }
+    if (event_loops > 0) {
+        scenario->event_loops = event_loops;
+    }
+    if (output_format != PstOutputFormat_Unknown) {
+        scenario->output_format = output_format;
+    }
+    if (async_output) {
+        scenario->async_output = true;
+    }
+    pst_print_SetFormat(scenario->output_format);
+    if (scenario->async_output && pst_print_StartWriter() != RET_OK) {
+        FreeResources(file_log);
+        pst_print_PrintExceptionMessage();
+        return RET_ERR;
+    }
     pst_print_PrintConnection(connection);
 
     PstPreparedStatements* prepared_statements = pst_parse_GetPreparedStatement();
     if (prepared_statements == NULL) {
-        FreeResources(file_log, NULL, NULL);
+        FreeResources(file_log);
         pst_print_PrintExceptionMessage();
         return RET_ERR;
     }
     log_info("Get prepared statements successfully.");
 
-    /* Connect MySQL database */
-    MYSQL* mysql = NULL;
+    /* expectations recorded by an earlier --record run */
+    char file_expect[sizeof(file_json) + 8];
+    snprintf(file_expect, sizeof(file_expect), "%s.expect", file_json);
+    if (!record && access(file_expect, R_OK) == 0) {
+        if (pst_parse_ParseExpectations(file_expect) != RET_OK) {
+            FreeResources(file_log);
+            pst_print_PrintExceptionMessage();
+            return RET_ERR;
+        }
+        log_info("Loaded expectations from '%s'.", file_expect);
+    }
 
-    mysql = mysql_init(NULL);
-    if (mysql == NULL) {
-        log_error("Failed to initialize MySQL client");
-        FreeResources(file_log, mysql, NULL);
+    /* options of every statement, also of those read once the run started */
+    scenario->fetch_mode = fetch_mode;
+    scenario->prefetch_rows = prefetch_rows;
+    scenario->layout = layout;
+    scenario->zero_copy = zero_copy;
+    scenario->result_mode = result_mode;
+    scenario->record = record;
+    if (pst_parse_SetupStatements() != RET_OK) {
+        FreeResources(file_log);
+        pst_print_PrintExceptionMessage();
+        return RET_ERR;
+    }
+    if (pst_verify_Init(prepared_statements, record) != RET_OK) {
+        FreeResources(file_log);
         pst_print_PrintExceptionMessage();
         return RET_ERR;
     }
-    log_info("Successfully initialized MySQL client.");
 
-    if (mysql_real_connect(mysql,
-        connection->host, connection->user, connection->password, connection->database, connection->port,
-        connection->unix_socket, connection->client_flag) == NULL) {
-        log_error(PST_FORMAT_MSG_ERR_MYSQL, mysql_errno(mysql), mysql_sqlstate(mysql), mysql_error(mysql));
-        FreeResources(file_log, mysql, NULL);
+    /* MySQL client library must be initialized before any worker thread starts */
+    if (mysql_library_init(0, NULL, NULL) != 0) {
+        log_error("Failed to initialize MySQL client library");
+        FreeResources(file_log);
         pst_print_PrintExceptionMessage();
         return RET_ERR;
     }
-    log_info("Successfully connected to database.");
+    log_info("Successfully initialized MySQL client.");
 
-    /*  Prepare statements */
-    MYSQL_STMT* stmt = mysql_stmt_init(mysql);
-    if (stmt == NULL) {
-        log_error(PST_FORMAT_MSG_ERR_MYSQL, mysql_errno(mysql), mysql_sqlstate(mysql), mysql_error(mysql));
-        FreeResources(file_log, mysql, stmt);
+    /* Connect, prepare and execute statements on the workers or event loops */
+    int ret = scenario->engine == PstEngine_Event ?
+        pst_event_Run(connection, prepared_statements, scenario) :
+        pst_worker_Run(connection, prepared_statements, scenario);
+    if (ret != RET_OK) {
+        mysql_library_end();
+        FreeResources(file_log);
         pst_print_PrintExceptionMessage();
         return RET_ERR;
     }
-    log_info("MySQL statement initialized");
 
-    for (unsigned long i = 0; i < prepared_statements->prep_stmt_size; i++) {
+    mysql_library_end();
+    log_info("MySQL client closed.");
 
-        if (mysql_stmt_prepare(stmt, prepared_statements->prep_stmt[i].stmt, prepared_statements->prep_stmt[i].stmt_len) != 0) {
-            log_error(PST_FORMAT_MSG_ERR_MYSQL, mysql_stmt_errno(stmt), mysql_stmt_sqlstate(stmt), mysql_stmt_error(stmt));
-            FreeResources(file_log, mysql, stmt);
+    if (record) {
+        if (pst_verify_Write(file_expect) != RET_OK) {
+            FreeResources(file_log);
             pst_print_PrintExceptionMessage();
             return RET_ERR;
         }
-        log_info("Statement prepared");
-
-        pst_print_PrintStatement(&prepared_statements->prep_stmt[i], i);
-
-        PstSyntax syntax = pst_GetSyntax(prepared_statements->prep_stmt[i].stmt);
-        log_info("Syntax : %d", syntax);
-
-        if (prepared_statements->prep_stmt[i].params_size == 0) {
-            if (mysql_stmt_execute(stmt) != 0) {
-                log_error(PST_FORMAT_MSG_ERR_MYSQL, mysql_stmt_errno(stmt), mysql_stmt_sqlstate(stmt), mysql_stmt_error(stmt));
-                FreeResources(file_log, mysql, stmt);
-                pst_print_PrintExceptionMessage();
-                return RET_ERR;
-            }
-
-            if (pst_output_OutputResult(stmt, syntax) != RET_OK) {
-                FreeResources(file_log, mysql, stmt);
-                pst_print_PrintExceptionMessage();
-                return RET_ERR;
-            }
-
-            if (mysql_stmt_reset(stmt) != 0) {
-                FreeResources(file_log, mysql, stmt);
-                pst_print_PrintExceptionMessage();
-                return RET_ERR;
-            }
-        }
-
-        for (unsigned long j = 0; j < prepared_statements->prep_stmt[i].params_size; j++) {
-            if (pst_input_InputParameters(stmt, prepared_statements->prep_stmt[i].params[j], prepared_statements->prep_stmt[i].param_markers_count) != RET_OK) {
-                FreeResources(file_log, mysql, stmt);
-                pst_print_PrintExceptionMessage();
-                return RET_ERR;
-            }
-            pst_print_PrintParameter(prepared_statements->prep_stmt[i].params[j], prepared_statements->prep_stmt[i].param_markers_count, j);
-
-            if (mysql_stmt_execute(stmt) != 0) {
-                log_error(PST_FORMAT_MSG_ERR_MYSQL, mysql_stmt_errno(stmt), mysql_stmt_sqlstate(stmt), mysql_stmt_error(stmt));
-                FreeResources(file_log, mysql, stmt);
-                pst_print_PrintExceptionMessage();
-                return RET_ERR;
-            }
-
-            pst_input_FreeParameters();
-
-            if (pst_output_OutputResult(stmt, syntax) != RET_OK) {
-                FreeResources(file_log, mysql, stmt);
-                pst_print_PrintExceptionMessage();
-                return RET_ERR;
-            }
-
-            pst_output_FreeResult();
-
-            if (mysql_stmt_reset(stmt) != 0) {
-                FreeResources(file_log, mysql, stmt);
-                pst_print_PrintExceptionMessage();
-                return RET_ERR;
-            }
-
-        }
+        fprintf(stderr, "Expectations recorded to '%s'.\n", file_expect);
     }
 
-    FreeResources(file_log, mysql, stmt);
-
-    log_info("MySQL client closed.");
+    /* a run with mismatches fails like a run with errors */
+    unsigned long mismatches = pst_verify_GetMismatches();
+    FreeResources(file_log);
 
-    return 0;
+    return mismatches > 0 ? RET_ERR : 0;
 }
@@ -1,21 +1,41 @@
+#include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
+#include "log.h"
 #include "pst.h"
 
+/* first read of a pipe, the buffer doubles from there */
+#define PST_READ_BUFFER_SIZE 65536
+
+static char* ReadFile(int fd, const char* filename, size_t* size);
+
 MYSQL_TIME pst_ToMySQLTime(const char* str) {
     MYSQL_TIME time;
     char format[30];
     memset(&time, 0, sizeof(MYSQL_TIME));
     memset(format, 0, sizeof(format));
 
+    if (strlen(str) == 8) {
+        /* TIME FORMAT: HH:MM:SS */
+        strcpy(format, "%02d:%02d:%02d");
+        sscanf(str, format,
+            &time.hour,
+            &time.minute,
+            &time.second);
+        return time;
+    }
+
     if (strlen(str) == 10) {
         /* DATE FORMAT: YYYY-MM-DD */
         strcpy(format, "%04d-%02d-%02d");
-    } else if (strlen(str) == 19) {
-        /* TIME FORMAT: HH:MM:SS */
-        strcpy(format, "%02d:%02d:%02d");
     } else {
         /* DATETIME FORMAT: YYYY-MM-DD HH:MM:SS */
         strcpy(format, "%04d-%02d-%02d %02d:%02d:%02d");
@@ -31,11 +51,21 @@ MYSQL_TIME pst_ToMySQLTime(const char* str) {
     return time;
 }
 
-char* pst_Upper(const char* str) {
-    static char buffer[256];
-    int i = 0;
+void pst_FromMySQLTime(const MYSQL_TIME* time, PstFieldTypes type, char* buffer, size_t size) {
+    if (type == MYSQL_TYPE_DATE) {
+        snprintf(buffer, size, "%04u-%02u-%02u", time->year, time->month, time->day);
+    } else if (type == MYSQL_TYPE_TIME) {
+        snprintf(buffer, size, "%02u:%02u:%02u", time->hour, time->minute, time->second);
+    } else {
+        snprintf(buffer, size, "%04u-%02u-%02u %02u:%02u:%02u",
+            time->year, time->month, time->day, time->hour, time->minute, time->second);
+    }
+}
 
-    while (str[i] != '\0' && i < sizeof(buffer) - 1) {
+char* pst_Upper(const char* str, char* buffer, size_t size) {
+    size_t i = 0;
+
+    while (str[i] != '\0' && i < size - 1) {
         buffer[i] = toupper((unsigned char)str[i]);
         i++;
     }
@@ -44,10 +74,72 @@ char* pst_Upper(const char* str) {
     return buffer;
 }
 
+uint64_t pst_GetMonotonicNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+void pst_SleepUntilNs(uint64_t ns) {
+    struct timespec ts;
+    ts.tv_sec = ns / 1000000000ULL;
+    ts.tv_nsec = ns % 1000000000ULL;
+    /* interrupted by a signal, sleep the rest; any other error returns */
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+    }
+}
+
+char* pst_MapFile(const char* filename, size_t* size, bool* mapped) {
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        log_error(PST_FORMAT_MSG_ERR_FOPEN, filename);
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        log_error("Can not stat file '%s': %s", filename, strerror(errno));
+        close(fd);
+        return NULL;
+    }
+    if (!S_ISREG(st.st_mode)) {
+        *mapped = false;
+        char* data = ReadFile(fd, filename, size);
+        close(fd);
+        return data;
+    }
+    if (st.st_size == 0) {
+        log_error("File '%s' is empty", filename);
+        close(fd);
+        return NULL;
+    }
+
+    char* data = (char*)mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        log_error("Can not map file '%s': %s", filename, strerror(errno));
+        return NULL;
+    }
+    /* read once from start to end */
+    madvise(data, (size_t)st.st_size, MADV_SEQUENTIAL);
+
+    *size = (size_t)st.st_size;
+    *mapped = true;
+    return data;
+}
+
+void pst_UnmapFile(char* data, size_t size, bool mapped) {
+    if (mapped) {
+        munmap(data, size);
+    } else {
+        free(data);
+    }
+}
 
 PstFieldTypes pst_ToMySQLFieldType(const char* type) {
     if (!type) return MYSQL_TYPE_NULL;
-    const char* upperType = pst_Upper(type);
+    char buffer[16];
+    const char* upperType = pst_Upper(type, buffer, sizeof(buffer));
     if (strcmp(upperType, "TINYINT") == 0) return MYSQL_TYPE_TINY;
     if (strcmp(upperType, "SMALLINT") == 0) return MYSQL_TYPE_SHORT;
     if (strcmp(upperType, "INT") == 0) return MYSQL_TYPE_LONG;
@@ -69,6 +161,92 @@ PstFieldTypes pst_ToMySQLFieldType(const char* type) {
     return MYSQL_TYPE_NULL;
 }
 
+const void* pst_GetParameterBuffer(const PstParameter* param) {
+    switch (param->buffer_type) {
+    case MYSQL_TYPE_TINY:
+    case MYSQL_TYPE_SHORT:
+    case MYSQL_TYPE_LONG:
+    case MYSQL_TYPE_LONGLONG:
+    case MYSQL_TYPE_FLOAT:
+    case MYSQL_TYPE_DOUBLE:
+        return &param->value;
+    case MYSQL_TYPE_TIME:
+    case MYSQL_TYPE_DATE:
+    case MYSQL_TYPE_DATETIME:
+    case MYSQL_TYPE_TIMESTAMP:
+        return param->value.time;
+    case MYSQL_TYPE_STRING:
+    case MYSQL_TYPE_BLOB:
+        return param->valuestring;
+    default:
+        return NULL;
+    }
+}
+
+PstEngine pst_ToEngine(const char* engine) {
+    if (!engine) return PstEngine_Unknown;
+    char buffer[16];
+    const char* upperEngine = pst_Upper(engine, buffer, sizeof(buffer));
+    if (strcmp(upperEngine, "THREAD") == 0) return PstEngine_Thread;
+    if (strcmp(upperEngine, "EVENT") == 0) return PstEngine_Event;
+
+    return PstEngine_Unknown;
+}
+
+PstFetchMode pst_ToFetchMode(const char* fetch_mode) {
+    if (!fetch_mode) return PstFetchMode_Unknown;
+    char buffer[16];
+    const char* upperFetchMode = pst_Upper(fetch_mode, buffer, sizeof(buffer));
+    if (strcmp(upperFetchMode, "BUFFERED") == 0) return PstFetchMode_Buffered;
+    if (strcmp(upperFetchMode, "STREAM") == 0) return PstFetchMode_Stream;
+    if (strcmp(upperFetchMode, "CURSOR") == 0) return PstFetchMode_Cursor;
+
+    return PstFetchMode_Unknown;
+}
+
+PstLayout pst_ToLayout(const char* layout) {
+    if (!layout) return PstLayout_Unknown;
+    char buffer[16];
+    const char* upperLayout = pst_Upper(layout, buffer, sizeof(buffer));
+    if (strcmp(upperLayout, "ROWS") == 0) return PstLayout_Rows;
+    if (strcmp(upperLayout, "COLUMNS") == 0) return PstLayout_Columns;
+
+    return PstLayout_Unknown;
+}
+
+PstResultMode pst_ToResultMode(const char* result_mode) {
+    if (!result_mode) return PstResultMode_Unknown;
+    char buffer[16];
+    const char* upperResultMode = pst_Upper(result_mode, buffer, sizeof(buffer));
+    if (strcmp(upperResultMode, "TABLE") == 0) return PstResultMode_Table;
+    if (strcmp(upperResultMode, "DIGEST") == 0) return PstResultMode_Digest;
+
+    return PstResultMode_Unknown;
+}
+
+PstOutputFormat pst_ToOutputFormat(const char* output_format) {
+    if (!output_format) return PstOutputFormat_Unknown;
+    char buffer[16];
+    const char* upperOutputFormat = pst_Upper(output_format, buffer, sizeof(buffer));
+    if (strcmp(upperOutputFormat, "TABLE") == 0) return PstOutputFormat_Table;
+    if (strcmp(upperOutputFormat, "CSV") == 0) return PstOutputFormat_Csv;
+    if (strcmp(upperOutputFormat, "TSV") == 0) return PstOutputFormat_Tsv;
+    if (strcmp(upperOutputFormat, "NDJSON") == 0) return PstOutputFormat_Ndjson;
+
+    return PstOutputFormat_Unknown;
+}
+
+PstParamFormat pst_ToParamFormat(const char* param_format) {
+    if (!param_format) return PstParamFormat_Unknown;
+    char buffer[16];
+    const char* upperParamFormat = pst_Upper(param_format, buffer, sizeof(buffer));
+    if (strcmp(upperParamFormat, "NDJSON") == 0) return PstParamFormat_Ndjson;
+    if (strcmp(upperParamFormat, "CSV") == 0) return PstParamFormat_Csv;
+    if (strcmp(upperParamFormat, "TSV") == 0) return PstParamFormat_Tsv;
+
+    return PstParamFormat_Unknown;
+}
+
 PstSyntax pst_GetSyntax(const char* stmt) {
     PstSyntax syntax = PstSyntax_Unkown;
     char* str = malloc(strlen(stmt) + 1);
@@ -188,3 +366,51 @@ PstSyntax pst_GetSyntax(const char* stmt) {
     str = NULL;
     return syntax;
 }
+
+/* static functions */
+/* Reads fd to its end into a malloc'ed buffer, for files that can not be mapped */
+static char* ReadFile(int fd, const char* filename, size_t* size) {
+    size_t capacity = PST_READ_BUFFER_SIZE;
+    size_t used = 0;
+    char* data = (char*)malloc(capacity);
+    if (data == NULL) {
+        log_error(PST_FORMAT_MSG_ERR_ALLOC, "data");
+        return NULL;
+    }
+
+    while (1) {
+        if (used == capacity) {
+            char* grown = (char*)realloc(data, capacity * 2);
+            if (grown == NULL) {
+                log_error(PST_FORMAT_MSG_ERR_ALLOC, "data");
+                free(data);
+                return NULL;
+            }
+            data = grown;
+            capacity *= 2;
+        }
+
+        ssize_t n = read(fd, data + used, capacity - used);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            log_error("Can not read file '%s': %s", filename, strerror(errno));
+            free(data);
+            return NULL;
+        }
+        if (n == 0) {
+            break;
+        }
+        used += (size_t)n;
+    }
+
+    if (used == 0) {
+        log_error("File '%s' is empty", filename);
+        free(data);
+        return NULL;
+    }
+
+    *size = used;
+    return data;
+}
@@ -0,0 +1,100 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "log.h"
+#include "pst_arena.h"
+
+#define PST_ARENA_ALIGN 16
+
+static PstArenaBlock* NewBlock(size_t size) {
+    PstArenaBlock* block = (PstArenaBlock*)malloc(sizeof(PstArenaBlock) + size);
+    if (block == NULL) {
+        log_error(PST_FORMAT_MSG_ERR_ALLOC, "arena block");
+        return NULL;
+    }
+    block->next = NULL;
+    block->size = size;
+    block->used = 0;
+
+    return block;
+}
+
+static void FreeBlocks(PstArena* arena) {
+    PstArenaBlock* block = arena->blocks;
+    while (block != NULL) {
+        PstArenaBlock* next = block->next;
+        free(block);
+        block = next;
+    }
+    arena->blocks = NULL;
+}
+
+void pst_arena_Init(PstArena* arena, size_t block_size) {
+    memset(arena, 0, sizeof(PstArena));
+    arena->block_size = block_size;
+}
+
+void* pst_arena_Alloc(PstArena* arena, size_t size) {
+    size = (size + PST_ARENA_ALIGN - 1) & ~(size_t)(PST_ARENA_ALIGN - 1);
+
+    /* the newest block is first in the list, older ones are full */
+    PstArenaBlock* block = arena->blocks;
+    if (block == NULL || block->size - block->used < size) {
+        size_t block_size = arena->block_size;
+        if (block != NULL && block->size * 2 > block_size) {
+            block_size = block->size * 2;
+        }
+        if (size > block_size) {
+            block_size = size;
+        }
+
+        block = NewBlock(block_size);
+        if (block == NULL) {
+            return NULL;
+        }
+        block->next = arena->blocks;
+        arena->blocks = block;
+    }
+
+    void* ptr = block->data + block->used;
+    block->used += size;
+
+    arena->used += size;
+    if (arena->used > arena->high_water) {
+        arena->high_water = arena->used;
+    }
+
+    return ptr;
+}
+
+void* pst_arena_Calloc(PstArena* arena, size_t size) {
+    void* ptr = pst_arena_Alloc(arena, size);
+    if (ptr != NULL) {
+        memset(ptr, 0, size);
+    }
+
+    return ptr;
+}
+
+void pst_arena_Reset(PstArena* arena) {
+    if (arena->blocks != NULL && arena->blocks->next != NULL) {
+        size_t size = 0;
+        for (PstArenaBlock* block = arena->blocks; block != NULL; block = block->next) {
+            size += block->size;
+        }
+        FreeBlocks(arena);
+        /* on failure the next allocation simply starts a new block */
+        arena->blocks = NewBlock(size);
+    }
+
+    if (arena->blocks != NULL) {
+        arena->blocks->used = 0;
+    }
+    arena->used = 0;
+}
+
+void pst_arena_Free(PstArena* arena) {
+    FreeBlocks(arena);
+    arena->used = 0;
+}
@@ -0,0 +1,185 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "log.h"
+#include "pst_compile.h"
+#include "pst_parse.h"
+#include "pst_stream.h"
+
+#define PST_COMPILE_BUFFER_SIZE (4 * 1024 * 1024)
+
+static int WriteStatement(FILE* fp, const PstPreparedStatement* prep_stmt, PstCompiledStatement* compiled_stmt);
+static int WriteSet(FILE* fp, const PstParameter* param, unsigned long count);
+static int WritePadded(FILE* fp, const void* data, size_t length);
+
+int pst_compile_Compile(const char* filename, const char* output) {
+    pst_parse_StreamParameters();
+    if (pst_parse_Parse(filename) != RET_OK) {
+        return RET_ERR;
+    }
+
+    const PstPreparedStatements* prep_stmts = pst_parse_GetPreparedStatement();
+    for (unsigned long i = 0; i < prep_stmts->prep_stmt_size; i++) {
+        if (prep_stmts->prep_stmt[i].params_stream != NULL && prep_stmts->prep_stmt[i].params_stream->compiled) {
+            log_error("'%s' is compiled already", filename);
+            return RET_ERR;
+        }
+    }
+
+    PstCompiledStatement* compiled_stmts = (PstCompiledStatement*)calloc(prep_stmts->prep_stmt_size, sizeof(PstCompiledStatement));
+    if (compiled_stmts == NULL) {
+        log_error(PST_FORMAT_MSG_ERR_ALLOC, "compiled statement");
+        return RET_ERR;
+    }
+
+    FILE* fp = fopen(output, "wb");
+    if (fp == NULL) {
+        log_error(PST_FORMAT_MSG_ERR_FOPEN, output);
+        free(compiled_stmts);
+        return RET_ERR;
+    }
+    setvbuf(fp, NULL, _IOFBF, PST_COMPILE_BUFFER_SIZE);
+
+    size_t skeleton_size = 0;
+    const char* skeleton = pst_parse_GetSkeleton(&skeleton_size);
+
+    PstCompiledHeader header;
+    memset(&header, 0, sizeof(PstCompiledHeader));
+    memcpy(header.magic, PST_COMPILED_MAGIC, sizeof(header.magic));
+    header.version = PST_COMPILED_VERSION;
+    header.time_size = sizeof(MYSQL_TIME);
+    header.statements_size = (uint32_t)prep_stmts->prep_stmt_size;
+    header.skeleton_offset = sizeof(PstCompiledHeader) + prep_stmts->prep_stmt_size * sizeof(PstCompiledStatement);
+    header.skeleton_size = skeleton_size;
+
+    /* the statements are written again once their sets are */
+    int ret = fwrite(&header, sizeof(PstCompiledHeader), 1, fp) == 1 &&
+        fwrite(compiled_stmts, sizeof(PstCompiledStatement), prep_stmts->prep_stmt_size, fp) == prep_stmts->prep_stmt_size &&
+        WritePadded(fp, skeleton, skeleton_size) == RET_OK ? RET_OK : RET_ERR;
+    for (unsigned long i = 0; ret == RET_OK && i < prep_stmts->prep_stmt_size; i++) {
+        ret = WriteStatement(fp, &prep_stmts->prep_stmt[i], &compiled_stmts[i]);
+    }
+    if (ret == RET_OK && (fseek(fp, sizeof(PstCompiledHeader), SEEK_SET) != 0 ||
+        fwrite(compiled_stmts, sizeof(PstCompiledStatement), prep_stmts->prep_stmt_size, fp) != prep_stmts->prep_stmt_size)) {
+        ret = RET_ERR;
+    }
+    if (fclose(fp) != 0) {
+        ret = RET_ERR;
+    }
+
+    if (ret != RET_OK) {
+        log_error("Can not write compiled scenario '%s'", output);
+        remove(output);
+    }
+    free(compiled_stmts);
+
+    return ret;
+}
+
+int pst_compile_Open(const char* data, size_t size, const PstCompiledHeader** header) {
+    *header = NULL;
+    if (size < sizeof(PstCompiledHeader) || memcmp(data, PST_COMPILED_MAGIC, strlen(PST_COMPILED_MAGIC)) != 0) {
+        return RET_OK;
+    }
+
+    const PstCompiledHeader* compiled = (const PstCompiledHeader*)data;
+    if (compiled->version != PST_COMPILED_VERSION || compiled->time_size != sizeof(MYSQL_TIME)) {
+        log_error("Compiled scenario is of another version or client library, compile it again");
+        return RET_ERR;
+    }
+
+    uint64_t statements_end = sizeof(PstCompiledHeader) + (uint64_t)compiled->statements_size * sizeof(PstCompiledStatement);
+    if (statements_end > size || compiled->skeleton_offset < statements_end ||
+        compiled->skeleton_offset > size || compiled->skeleton_size > size - compiled->skeleton_offset) {
+        log_error("Compiled scenario is truncated");
+        return RET_ERR;
+    }
+
+    const PstCompiledStatement* compiled_stmts = (const PstCompiledStatement*)(compiled + 1);
+    for (uint32_t i = 0; i < compiled->statements_size; i++) {
+        if (compiled_stmts[i].sets_offset % 8 != 0 || compiled_stmts[i].sets_offset > compiled_stmts[i].sets_end ||
+            compiled_stmts[i].sets_end > size) {
+            log_error("Compiled scenario is truncated");
+            return RET_ERR;
+        }
+    }
+    log_debug("compiled statements: %u", compiled->statements_size);
+
+    *header = compiled;
+    return RET_OK;
+}
+
+/* static functions */
+static int WriteStatement(FILE* fp, const PstPreparedStatement* prep_stmt, PstCompiledStatement* compiled_stmt) {
+    compiled_stmt->param_markers_count = prep_stmt->param_markers_count;
+    compiled_stmt->sets_offset = (uint64_t)ftello(fp);
+
+    if (prep_stmt->params_stream != NULL) {
+        while (true) {
+            PstParameter* param = NULL;
+            unsigned long count = prep_stmt->param_markers_count;
+            if (pst_stream_Next(prep_stmt->params_stream, &param, &count) != RET_OK) {
+                return RET_ERR;
+            }
+            if (param == NULL) {
+                break;
+            }
+
+            int ret = WriteSet(fp, param, count);
+            pst_stream_FreeParameters(param, count);
+            if (ret != RET_OK) {
+                return RET_ERR;
+            }
+            compiled_stmt->sets_size++;
+        }
+    } else {
+        for (unsigned long j = 0; j < prep_stmt->params_size; j++) {
+            if (WriteSet(fp, prep_stmt->params[j], prep_stmt->param_markers_count) != RET_OK) {
+                return RET_ERR;
+            }
+            compiled_stmt->sets_size++;
+        }
+    }
+
+    compiled_stmt->sets_end = (uint64_t)ftello(fp);
+    log_info("Compiled %lu parameter sets of '%s'", (unsigned long)compiled_stmt->sets_size, prep_stmt->stmt);
+
+    return RET_OK;
+}
+
+/* The buffer of each value, as pst_input_BindParameters points at it */
+static int WriteSet(FILE* fp, const PstParameter* param, unsigned long count) {
+    for (unsigned long i = 0; i < count; i++) {
+        if (param[i].length > UINT32_MAX) {
+            log_error("Parameter value of %lu bytes can not be compiled", param[i].length);
+            return RET_ERR;
+        }
+
+        PstCompiledValue value;
+        memset(&value, 0, sizeof(PstCompiledValue));
+        value.buffer_type = (uint8_t)param[i].buffer_type;
+        value.is_unsigned = param[i].is_unsigned;
+        value.length = (uint32_t)param[i].length;
+
+        if (fwrite(&value, sizeof(PstCompiledValue), 1, fp) != 1 ||
+            WritePadded(fp, pst_GetParameterBuffer(&param[i]), param[i].length) != RET_OK) {
+            return RET_ERR;
+        }
+    }
+
+    return RET_OK;
+}
+
+static int WritePadded(FILE* fp, const void* data, size_t length) {
+    static const char zeros[8];
+    if (length > 0 && fwrite(data, 1, length, fp) != length) {
+        return RET_ERR;
+    }
+    size_t padding = PST_COMPILED_PAD(length) - length;
+    if (padding > 0 && fwrite(zeros, 1, padding, fp) != padding) {
+        return RET_ERR;
+    }
+
+    return RET_OK;
+}
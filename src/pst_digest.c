@@ -0,0 +1,91 @@
+#include <string.h>
+
+#include "pst_digest.h"
+
+#define PST_DIGEST_PRIME 0x100000001b3ULL
+/* length recorded for a NULL value, no real value is this long */
+#define PST_DIGEST_NULL UINT64_MAX
+
+uint64_t pst_digest_Update(uint64_t digest, const void* data, size_t size) {
+    const unsigned char* bytes = (const unsigned char*)data;
+    while (size >= sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, bytes, sizeof(word));
+        digest = (digest ^ word) * PST_DIGEST_PRIME;
+        bytes += sizeof(word);
+        size -= sizeof(word);
+    }
+    while (size > 0) {
+        digest = (digest ^ *bytes++) * PST_DIGEST_PRIME;
+        size--;
+    }
+
+    return digest;
+}
+
+size_t pst_digest_AddResult(uint64_t* digest, const PstResult* result) {
+    uint64_t length = PST_DIGEST_NULL;
+    if (result->is_null) {
+        *digest = pst_digest_Update(*digest, &length, sizeof(length));
+        return 0;
+    }
+
+    const void* data = result->value;
+    int64_t integer;
+    uint32_t time[8];
+    switch (result->type) {
+    case MYSQL_TYPE_TINY:
+        integer = *(signed char*)result->value;
+        data = &integer;
+        length = sizeof(integer);
+        break;
+    case MYSQL_TYPE_SHORT:
+    case MYSQL_TYPE_YEAR:
+        integer = *(short*)result->value;
+        data = &integer;
+        length = sizeof(integer);
+        break;
+    case MYSQL_TYPE_INT24:
+    case MYSQL_TYPE_LONG:
+        integer = *(int*)result->value;
+        data = &integer;
+        length = sizeof(integer);
+        break;
+    case MYSQL_TYPE_LONGLONG:
+        length = sizeof(long long);
+        break;
+    case MYSQL_TYPE_FLOAT:
+        length = sizeof(float);
+        break;
+    case MYSQL_TYPE_DOUBLE:
+        length = sizeof(double);
+        break;
+    case MYSQL_TYPE_TIME:
+    case MYSQL_TYPE_DATE:
+    case MYSQL_TYPE_DATETIME:
+    case MYSQL_TYPE_TIMESTAMP: {
+        /* the fields only, MYSQL_TIME has padding */
+        const MYSQL_TIME* t = (const MYSQL_TIME*)result->value;
+        time[0] = t->year;
+        time[1] = t->month;
+        time[2] = t->day;
+        time[3] = t->hour;
+        time[4] = t->minute;
+        time[5] = t->second;
+        time[6] = (uint32_t)t->second_part;
+        time[7] = t->neg;
+        data = time;
+        length = sizeof(time);
+        break;
+    }
+    default:
+        /* strings, decimals, blobs and bits as fetched */
+        length = result->length;
+        break;
+    }
+
+    *digest = pst_digest_Update(*digest, &length, sizeof(length));
+    *digest = pst_digest_Update(*digest, data, length);
+
+    return length;
+}
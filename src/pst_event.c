@@ -0,0 +1,804 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+#include "log.h"
+#include "pst_event.h"
+#include "pst_queue.h"
+#include "pst_stats.h"
+#include "pst_timing.h"
+
+#define PST_EVENT_MAX_EVENTS 256
+
+typedef enum enum_event_state {
+    PstEventState_Connect,
+    PstEventState_Query,
+    PstEventState_Store,
+    PstEventState_Fetch,
+    PstEventState_Free,
+    PstEventState_NextResult,
+    PstEventState_Idle,
+    /* rate mode, waiting for the scheduled start */
+    PstEventState_Wait,
+    /* the next statement is fenced, waiting for the items before it */
+    PstEventState_Fenced,
+    PstEventState_Done
+} PstEventState;
+
+typedef struct PstEventConnection {
+    unsigned int id;
+    MYSQL* mysql;
+    PstEventState state;
+    /* the epoll interest of the socket, 0 while it is not registered */
+    uint32_t events;
+    /* one per statement, prepared on its first execution on the connection */
+    bool* prepared;
+    unsigned long prepared_size;
+    /* the query in flight is the PREPARE of item */
+    bool preparing;
+
+    PstWorkItem item;
+    /* latency is measured from here, the intended start in rate mode */
+    uint64_t start;
+    uint64_t phase_start;
+    uint64_t rows;
+    MYSQL_RES* result;
+
+    char* query;
+    unsigned long query_len;
+    unsigned long query_size;
+
+    /* FIFO of connections waiting for their scheduled start */
+    struct PstEventConnection* next_waiting;
+} PstEventConnection;
+
+typedef struct PstEventLoop {
+    pthread_t thread;
+    unsigned int id;
+    int epoll_fd;
+    int timer_fd;
+    /* written when a fence is lifted, see WakeLoops */
+    int wake_fd;
+    PstEventConnection* conns;
+    unsigned int conns_size;
+    unsigned int active;
+    PstEventConnection* waiting_head;
+    PstEventConnection* waiting_tail;
+    PstRunStats stats;
+    int ret;
+} PstEventLoop;
+
+/* global variables */
+static const PstConnection* g_conn;
+static const PstPreparedStatements* g_prep_stmts;
+static atomic_int g_abort;
+static PstEventLoop* g_loops;
+static unsigned int g_loops_size;
+
+static int CheckOptions(const PstScenario* scenario);
+static void* RunLoop(void* arg);
+static void WakeLoops();
+static void AbortLoops();
+
+int pst_event_Run(const PstConnection* conn, const PstPreparedStatements* prep_stmts, const PstScenario* scenario) {
+    unsigned int concurrency = scenario->concurrency;
+    unsigned int loops_size = scenario->event_loops < concurrency ? scenario->event_loops : concurrency;
+
+    g_conn = conn;
+    g_prep_stmts = prep_stmts;
+    atomic_store(&g_abort, 0);
+
+    if (CheckOptions(scenario) != RET_OK) {
+        return RET_ERR;
+    }
+
+    if (pst_queue_Init(prep_stmts, scenario) != RET_OK) {
+        return RET_ERR;
+    }
+
+    if (pst_stats_Init(prep_stmts) != RET_OK) {
+        pst_stats_Free();
+        pst_queue_Free();
+        return RET_ERR;
+    }
+
+    PstEventLoop* loops = (PstEventLoop*)malloc(loops_size * sizeof(PstEventLoop));
+    PstEventConnection* conns = (PstEventConnection*)malloc(concurrency * sizeof(PstEventConnection));
+    if (loops == NULL || conns == NULL) {
+        log_error(PST_FORMAT_MSG_ERR_ALLOC, "event loops");
+        free(loops);
+        free(conns);
+        pst_stats_Free();
+        pst_queue_Free();
+        return RET_ERR;
+    }
+    memset(loops, 0, loops_size * sizeof(PstEventLoop));
+    memset(conns, 0, concurrency * sizeof(PstEventConnection));
+    int ret = RET_OK;
+    for (unsigned int i = 0; i < loops_size; i++) {
+        loops[i].epoll_fd = -1;
+        loops[i].timer_fd = -1;
+        /* created before any loop runs, a loop may wake the others at once */
+        loops[i].wake_fd = eventfd(0, EFD_NONBLOCK);
+        if (loops[i].wake_fd < 0) {
+            log_error("Failed to create wakeup for event loop %u", i);
+            ret = RET_ERR;
+        }
+    }
+    g_loops = loops;
+    g_loops_size = loops_size;
+
+    /* connections are split evenly, loop i owns a contiguous slice */
+    unsigned int offset = 0;
+    for (unsigned int i = 0; i < loops_size; i++) {
+        loops[i].id = i;
+        loops[i].conns = &conns[offset];
+        loops[i].conns_size = concurrency / loops_size + (i < concurrency % loops_size ? 1 : 0);
+        for (unsigned int j = 0; j < loops[i].conns_size; j++) {
+            loops[i].conns[j].id = offset + j;
+        }
+        offset += loops[i].conns_size;
+    }
+
+    uint64_t start = pst_GetMonotonicNs();
+    pst_queue_Start(start);
+
+    unsigned int started = 0;
+    for (unsigned int i = 0; ret == RET_OK && i < loops_size; i++) {
+        if (pthread_create(&loops[i].thread, NULL, RunLoop, &loops[i]) != 0) {
+            log_error("Failed to create event loop thread %u", i);
+            AbortLoops();
+            ret = RET_ERR;
+            break;
+        }
+        started++;
+    }
+
+    PstRunStats stats;
+    memset(&stats, 0, sizeof(PstRunStats));
+    for (unsigned int i = 0; i < started; i++) {
+        pthread_join(loops[i].thread, NULL);
+        if (loops[i].ret != RET_OK) {
+            ret = RET_ERR;
+        }
+        pst_stats_Merge(&stats, &loops[i].stats);
+    }
+    /* closed once no loop can wake it any more */
+    for (unsigned int i = 0; i < loops_size; i++) {
+        if (loops[i].wake_fd >= 0) {
+            close(loops[i].wake_fd);
+        }
+    }
+
+    uint64_t elapsed = pst_GetMonotonicNs() - start;
+    if (pst_queue_Failed()) {
+        ret = RET_ERR;
+    }
+
+    if (ret == RET_OK) {
+        stats.threads = loops_size;
+        stats.connections = concurrency;
+        stats.iterations = pst_queue_GetIterations();
+        stats.seconds = elapsed / 1e9;
+        stats.rate = scenario->rate;
+        pst_stats_Report(scenario, &stats);
+    }
+
+    free(conns);
+    conns = NULL;
+    g_loops = NULL;
+    g_loops_size = 0;
+    free(loops);
+    loops = NULL;
+    pst_stats_Free();
+    pst_queue_Free();
+
+    return ret;
+}
+
+/* static functions */
+/* Results are received over the text protocol and counted, the options of */
+/* the statements are checked by pst_parse_SetupStatements */
+static int CheckOptions(const PstScenario* scenario) {
+    if (scenario->output_format != PstOutputFormat_Table) {
+        log_error("The event engine prints no result rows, format must be table");
+        return RET_ERR;
+    }
+
+    return RET_OK;
+}
+
+static int ConnectionError(PstEventConnection* ec) {
+    log_error(PST_FORMAT_MSG_ERR_MYSQL, mysql_errno(ec->mysql), mysql_sqlstate(ec->mysql), mysql_error(ec->mysql));
+    return RET_ERR;
+}
+
+static int ReserveQuery(PstEventConnection* ec, unsigned long size) {
+    if (ec->query_len + size < ec->query_size) {
+        return RET_OK;
+    }
+
+    unsigned long query_size = ec->query_size == 0 ? 256 : ec->query_size;
+    while (query_size <= ec->query_len + size) {
+        query_size *= 2;
+    }
+
+    char* query = (char*)realloc(ec->query, query_size);
+    if (query == NULL) {
+        log_error(PST_FORMAT_MSG_ERR_ALLOC, "query");
+        return RET_ERR;
+    }
+    ec->query = query;
+    ec->query_size = query_size;
+
+    return RET_OK;
+}
+
+static int AppendQuery(PstEventConnection* ec, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(NULL, 0, format, args);
+    va_end(args);
+
+    if (len < 0 || ReserveQuery(ec, (unsigned long)len) != RET_OK) {
+        return RET_ERR;
+    }
+
+    va_start(args, format);
+    vsnprintf(ec->query + ec->query_len, ec->query_size - ec->query_len, format, args);
+    va_end(args);
+    ec->query_len += len;
+
+    return RET_OK;
+}
+
+/* 'str' with quotes and escapes for the connection character set */
+static int AppendQuoted(PstEventConnection* ec, const char* str, unsigned long len) {
+    if (ReserveQuery(ec, len * 2 + 2) != RET_OK) {
+        return RET_ERR;
+    }
+
+    ec->query[ec->query_len++] = '\'';
+    ec->query_len += mysql_real_escape_string(ec->mysql, ec->query + ec->query_len, str, len);
+    ec->query[ec->query_len++] = '\'';
+    ec->query[ec->query_len] = '\0';
+
+    return RET_OK;
+}
+
+/* A parameter value from the buffer of its MYSQL_BIND as an SQL literal */
+static int AppendLiteral(PstEventConnection* ec, PstFieldTypes type, bool is_unsigned, const void* data, unsigned long length) {
+    char time[32];
+    switch (type) {
+    case MYSQL_TYPE_TINY:
+        return is_unsigned ? AppendQuery(ec, "%u", *(const unsigned char*)data)
+            : AppendQuery(ec, "%d", *(const signed char*)data);
+    case MYSQL_TYPE_SHORT:
+        return is_unsigned ? AppendQuery(ec, "%u", *(const unsigned short*)data)
+            : AppendQuery(ec, "%d", *(const short*)data);
+    case MYSQL_TYPE_LONG:
+        return is_unsigned ? AppendQuery(ec, "%u", *(const unsigned int*)data)
+            : AppendQuery(ec, "%d", *(const int*)data);
+    case MYSQL_TYPE_LONGLONG:
+        return is_unsigned ? AppendQuery(ec, "%llu", *(const unsigned long long*)data)
+            : AppendQuery(ec, "%lld", *(const long long*)data);
+    case MYSQL_TYPE_FLOAT:
+        return AppendQuery(ec, "%.9g", *(const float*)data);
+    case MYSQL_TYPE_DOUBLE:
+        return AppendQuery(ec, "%.17g", *(const double*)data);
+    case MYSQL_TYPE_TIME:
+    case MYSQL_TYPE_DATE:
+    case MYSQL_TYPE_DATETIME:
+    case MYSQL_TYPE_TIMESTAMP:
+        pst_FromMySQLTime((const MYSQL_TIME*)data, type, time, sizeof(time));
+        return AppendQuoted(ec, time, strlen(time));
+    case MYSQL_TYPE_STRING:
+    case MYSQL_TYPE_BLOB:
+        return AppendQuoted(ec, data != NULL ? (const char*)data : "", length);
+    default:
+        return AppendQuery(ec, "NULL");
+    }
+}
+
+static int BuildPrepareQuery(PstEventConnection* ec, unsigned long stmt_index) {
+    ec->query_len = 0;
+    if (AppendQuery(ec, "PREPARE pst_stmt_%lu FROM ", stmt_index) != RET_OK ||
+        AppendQuoted(ec, g_prep_stmts->prep_stmt[stmt_index].stmt, g_prep_stmts->prep_stmt[stmt_index].stmt_len) != RET_OK) {
+        return RET_ERR;
+    }
+
+    return RET_OK;
+}
+
+/* SET @pst_p0=...,@pst_p1=...;EXECUTE pst_stmt_N USING @pst_p0,@pst_p1 */
+/* sent as one multi-statement round trip */
+static int BuildExecuteQuery(PstEventConnection* ec, const PstWorkItem* item) {
+    const PstPreparedStatement* prep_stmt = &g_prep_stmts->prep_stmt[item->stmt_index];
+    unsigned long count = item->param == NULL && item->compiled == NULL ? 0 : prep_stmt->param_markers_count;
+
+    ec->query_len = 0;
+    if (count > 0) {
+        const PstParameter* param = item->param;
+        const PstCompiledValue* value = item->compiled;
+        for (unsigned long i = 0; i < count; i++) {
+            if (AppendQuery(ec, i == 0 ? "SET @pst_p%lu=" : ",@pst_p%lu=", i) != RET_OK) {
+                return RET_ERR;
+            }
+            if (value != NULL) {
+                if (AppendLiteral(ec, (PstFieldTypes)value->buffer_type, value->is_unsigned,
+                    PST_COMPILED_DATA(value), value->length) != RET_OK) {
+                    return RET_ERR;
+                }
+                value = PST_COMPILED_NEXT(value);
+            } else if (AppendLiteral(ec, param[i].buffer_type, param[i].is_unsigned,
+                pst_GetParameterBuffer(&param[i]), param[i].length) != RET_OK) {
+                return RET_ERR;
+            }
+        }
+        if (AppendQuery(ec, ";") != RET_OK) {
+            return RET_ERR;
+        }
+    }
+
+    if (AppendQuery(ec, "EXECUTE pst_stmt_%lu", item->stmt_index) != RET_OK) {
+        return RET_ERR;
+    }
+    for (unsigned long i = 0; i < count; i++) {
+        if (AppendQuery(ec, i == 0 ? " USING @pst_p%lu" : ",@pst_p%lu", i) != RET_OK) {
+            return RET_ERR;
+        }
+    }
+
+    return RET_OK;
+}
+
+/**
+ * The socket of a connection and the direction its pending non-blocking call
+ * is blocked on. The async API has no accessor for either, both are read from
+ * the NET of libmysqlclient 8.0 (net.vio, net.fd and the NET_ASYNC behind
+ * net.extension) and have to follow that layout.
+ */
+static int GetSocket(MYSQL* mysql, uint32_t* events) {
+    const NET_ASYNC* async = NET_ASYNC_DATA(&mysql->net);
+    /* the socket only exists once the connect has started */
+    if (mysql->net.vio == NULL || async == NULL) {
+        return -1;
+    }
+
+    switch (async->async_blocking_state) {
+    case NET_NONBLOCKING_READ:
+        *events = EPOLLIN;
+        break;
+    case NET_NONBLOCKING_WRITE:
+    case NET_NONBLOCKING_CONNECT:
+        *events = EPOLLOUT;
+        break;
+    }
+
+    return mysql->net.fd;
+}
+
+/**
+ * Sets the level-triggered epoll interest of a connection, 0 takes it out of
+ * epoll while it has no call pending, so a peer that hangs up can not report
+ * a readiness nobody consumes.
+ */
+static int WatchConnection(PstEventLoop* loop, PstEventConnection* ec, bool pending) {
+    uint32_t events = 0;
+    int fd = GetSocket(ec->mysql, &events);
+    if (!pending) {
+        events = 0;
+    }
+    if (events == ec->events) {
+        return RET_OK;
+    }
+
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = events;
+    event.data.ptr = ec;
+    int op = ec->events == 0 ? EPOLL_CTL_ADD : events == 0 ? EPOLL_CTL_DEL : EPOLL_CTL_MOD;
+    if (fd < 0 || epoll_ctl(loop->epoll_fd, op, fd, &event) != 0) {
+        log_error("Failed to watch connection %u in epoll", ec->id);
+        return RET_ERR;
+    }
+    ec->events = events;
+
+    return RET_OK;
+}
+
+static void ArmTimer(PstEventLoop* loop) {
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    if (loop->waiting_head != NULL) {
+        uint64_t ns = loop->waiting_head->item.intended_start;
+        spec.it_value.tv_sec = ns / 1000000000ULL;
+        spec.it_value.tv_nsec = ns % 1000000000ULL;
+    }
+    timerfd_settime(loop->timer_fd, TFD_TIMER_ABSTIME, &spec, NULL);
+}
+
+static int StartItem(PstEventLoop* loop, PstEventConnection* ec) {
+    uint64_t now = pst_GetMonotonicNs();
+    if (ec->item.intended_start != 0) {
+        ec->start = ec->item.intended_start;
+        pst_stats_RecordLateness(&loop->stats, now - ec->item.intended_start);
+    } else {
+        ec->start = now;
+    }
+
+    ec->rows = 0;
+    ec->phase_start = now;
+    ec->state = PstEventState_Query;
+
+    /* statements read after the run started, see pst_parse_ReadMore */
+    if (ec->item.stmt_index >= ec->prepared_size) {
+        unsigned long size = g_prep_stmts->prep_stmt_size;
+        bool* prepared = (bool*)realloc(ec->prepared, size * sizeof(bool));
+        if (prepared == NULL) {
+            log_error(PST_FORMAT_MSG_ERR_ALLOC, "prepared");
+            return RET_ERR;
+        }
+        memset(prepared + ec->prepared_size, 0, (size - ec->prepared_size) * sizeof(bool));
+        ec->prepared = prepared;
+        ec->prepared_size = size;
+    }
+
+    /* prepared on its first execution; a fenced statement only gets here */
+    /* after the statements before it have run, see pst_queue */
+    if (!ec->prepared[ec->item.stmt_index]) {
+        ec->preparing = true;
+        return BuildPrepareQuery(ec, ec->item.stmt_index);
+    }
+
+    return BuildExecuteQuery(ec, &ec->item);
+}
+
+static int TakeItem(PstEventLoop* loop, PstEventConnection* ec) {
+    PstQueueStatus status = atomic_load(&g_abort) ? PstQueue_Over : pst_queue_TryNext(&ec->item);
+    if (status == PstQueue_Over) {
+        ec->state = PstEventState_Done;
+        loop->active--;
+        return RET_OK;
+    }
+    if (status == PstQueue_Fenced) {
+        ec->state = PstEventState_Fenced;
+        return RET_OK;
+    }
+
+    /* items come out of the queue in schedule order, */
+    /* so the waiting list of each loop stays sorted */
+    if (ec->item.intended_start > pst_GetMonotonicNs()) {
+        ec->state = PstEventState_Wait;
+        ec->next_waiting = NULL;
+        if (loop->waiting_tail != NULL) {
+            loop->waiting_tail->next_waiting = ec;
+        } else {
+            loop->waiting_head = ec;
+            ArmTimer(loop);
+        }
+        loop->waiting_tail = ec;
+        return RET_OK;
+    }
+
+    return StartItem(loop, ec);
+}
+
+static int FinishQuery(PstEventLoop* loop, PstEventConnection* ec) {
+    uint64_t now = pst_GetMonotonicNs();
+
+    if (ec->preparing) {
+        pst_timing_Record(PstPhase_Prepare, now - ec->phase_start);
+        ec->preparing = false;
+        ec->prepared[ec->item.stmt_index] = true;
+
+        int ret = BuildExecuteQuery(ec, &ec->item);
+        ec->phase_start = now;
+        ec->state = PstEventState_Query;
+        return ret;
+    }
+
+    pst_stats_RecordLatency(&loop->stats, ec->item.stmt_index, now - ec->start);
+    ec->state = PstEventState_Idle;
+    if (pst_queue_Release(&ec->item)) {
+        WakeLoops();
+    }
+    return RET_OK;
+}
+
+/* Drive the connection until it has to wait for the socket or the schedule. */
+/* The library only reports NET_ASYNC_NOT_READY once the socket itself would */
+/* block, nothing is left buffered that epoll could not see */
+static int StepConnection(PstEventLoop* loop, PstEventConnection* ec) {
+    enum net_async_status status;
+    MYSQL_ROW row;
+
+    for (;;) {
+        switch (ec->state) {
+        case PstEventState_Connect:
+            status = mysql_real_connect_nonblocking(ec->mysql,
+                g_conn->host, g_conn->user, g_conn->password, g_conn->database, g_conn->port,
+                g_conn->unix_socket, g_conn->client_flag | CLIENT_MULTI_STATEMENTS);
+            if (status == NET_ASYNC_NOT_READY) {
+                return WatchConnection(loop, ec, true);
+            }
+            if (status == NET_ASYNC_ERROR) {
+                return ConnectionError(ec);
+            }
+            log_info("Connection %u connected.", ec->id);
+            ec->state = PstEventState_Idle;
+            break;
+        case PstEventState_Query:
+            status = mysql_real_query_nonblocking(ec->mysql, ec->query, ec->query_len);
+            if (status == NET_ASYNC_NOT_READY) {
+                return WatchConnection(loop, ec, true);
+            }
+            if (status == NET_ASYNC_ERROR) {
+                return ConnectionError(ec);
+            }
+            if (!ec->preparing) {
+                pst_timing_Record(PstPhase_Execute, pst_GetMonotonicNs() - ec->phase_start);
+            }
+            ec->state = PstEventState_Store;
+            break;
+        case PstEventState_Store:
+            if (mysql_field_count(ec->mysql) == 0) {
+                ec->state = PstEventState_NextResult;
+                break;
+            }
+            status = mysql_store_result_nonblocking(ec->mysql, &ec->result);
+            if (status == NET_ASYNC_NOT_READY) {
+                return WatchConnection(loop, ec, true);
+            }
+            if (status == NET_ASYNC_ERROR || ec->result == NULL) {
+                return ConnectionError(ec);
+            }
+            ec->state = PstEventState_Fetch;
+            break;
+        case PstEventState_Fetch:
+            status = mysql_fetch_row_nonblocking(ec->result, &row);
+            if (status == NET_ASYNC_NOT_READY) {
+                return WatchConnection(loop, ec, true);
+            }
+            if (status == NET_ASYNC_ERROR) {
+                return ConnectionError(ec);
+            }
+            if (row != NULL) {
+                ec->rows++;
+            } else {
+                ec->state = PstEventState_Free;
+            }
+            break;
+        case PstEventState_Free:
+            status = mysql_free_result_nonblocking(ec->result);
+            if (status == NET_ASYNC_NOT_READY) {
+                return WatchConnection(loop, ec, true);
+            }
+            ec->result = NULL;
+            ec->state = PstEventState_NextResult;
+            break;
+        case PstEventState_NextResult:
+            /* SET and EXECUTE come back as separate results, */
+            /* a CALL may add more, all are drained before the next query */
+            status = mysql_next_result_nonblocking(ec->mysql);
+            if (status == NET_ASYNC_NOT_READY) {
+                return WatchConnection(loop, ec, true);
+            }
+            if (status == NET_ASYNC_ERROR) {
+                return ConnectionError(ec);
+            }
+            if (status == NET_ASYNC_COMPLETE) {
+                ec->state = PstEventState_Store;
+                break;
+            }
+            if (FinishQuery(loop, ec) != RET_OK) {
+                return RET_ERR;
+            }
+            break;
+        case PstEventState_Idle:
+            if (TakeItem(loop, ec) != RET_OK) {
+                return RET_ERR;
+            }
+            break;
+        case PstEventState_Wait:
+        case PstEventState_Fenced:
+        case PstEventState_Done:
+            return WatchConnection(loop, ec, false);
+        }
+    }
+}
+
+static int StartWaiting(PstEventLoop* loop) {
+    uint64_t expirations;
+    if (read(loop->timer_fd, &expirations, sizeof(expirations)) < 0) {
+        /* spurious wakeup, nothing to do */
+    }
+
+    uint64_t now = pst_GetMonotonicNs();
+    while (loop->waiting_head != NULL && loop->waiting_head->item.intended_start <= now) {
+        PstEventConnection* ec = loop->waiting_head;
+        loop->waiting_head = ec->next_waiting;
+        if (loop->waiting_head == NULL) {
+            loop->waiting_tail = NULL;
+        }
+        ec->next_waiting = NULL;
+
+        if (StartItem(loop, ec) != RET_OK || StepConnection(loop, ec) != RET_OK) {
+            return RET_ERR;
+        }
+    }
+    ArmTimer(loop);
+
+    return RET_OK;
+}
+
+/* A fence was lifted, every loop asks the queue again for its fenced connections */
+static void WakeLoops() {
+    uint64_t one = 1;
+    for (unsigned int i = 0; i < g_loops_size; i++) {
+        if (g_loops[i].wake_fd >= 0 && write(g_loops[i].wake_fd, &one, sizeof(one)) < 0) {
+            /* the counter is already pending */
+        }
+    }
+}
+
+static void AbortLoops() {
+    atomic_store(&g_abort, 1);
+    WakeLoops();
+}
+
+static int StartFenced(PstEventLoop* loop) {
+    uint64_t wakeups;
+    if (read(loop->wake_fd, &wakeups, sizeof(wakeups)) < 0) {
+        /* spurious wakeup, nothing to do */
+    }
+
+    for (unsigned int i = 0; i < loop->conns_size; i++) {
+        PstEventConnection* ec = &loop->conns[i];
+        if (ec->state != PstEventState_Fenced) {
+            continue;
+        }
+        ec->state = PstEventState_Idle;
+        if (StepConnection(loop, ec) != RET_OK) {
+            return RET_ERR;
+        }
+    }
+
+    return RET_OK;
+}
+
+/* The first step of each connection starts its connect */
+static int StartConnections(PstEventLoop* loop) {
+    for (unsigned int i = 0; i < loop->conns_size; i++) {
+        if (StepConnection(loop, &loop->conns[i]) != RET_OK) {
+            return RET_ERR;
+        }
+    }
+
+    return RET_OK;
+}
+
+static int OpenLoop(PstEventLoop* loop) {
+    loop->epoll_fd = epoll_create1(0);
+    loop->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    if (loop->epoll_fd < 0 || loop->timer_fd < 0) {
+        log_error("Failed to create epoll or timer for event loop %u", loop->id);
+        return RET_ERR;
+    }
+
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.ptr = NULL;
+    if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, loop->timer_fd, &event) != 0) {
+        log_error("Failed to add timer to epoll for event loop %u", loop->id);
+        return RET_ERR;
+    }
+    event.data.ptr = loop;
+    if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, loop->wake_fd, &event) != 0) {
+        log_error("Failed to add wakeup to epoll for event loop %u", loop->id);
+        return RET_ERR;
+    }
+
+    for (unsigned int i = 0; i < loop->conns_size; i++) {
+        PstEventConnection* ec = &loop->conns[i];
+        ec->mysql = mysql_init(NULL);
+        if (ec->mysql == NULL) {
+            log_error("Failed to initialize MySQL client");
+            return RET_ERR;
+        }
+        ec->prepared = (bool*)calloc(g_prep_stmts->prep_stmt_size + 1, sizeof(bool));
+        if (ec->prepared == NULL) {
+            log_error(PST_FORMAT_MSG_ERR_ALLOC, "prepared");
+            return RET_ERR;
+        }
+        ec->prepared_size = g_prep_stmts->prep_stmt_size;
+        ec->state = PstEventState_Connect;
+        loop->active++;
+    }
+
+    return RET_OK;
+}
+
+static void CloseLoop(PstEventLoop* loop) {
+    for (unsigned int i = 0; i < loop->conns_size; i++) {
+        PstEventConnection* ec = &loop->conns[i];
+        if (ec->result) {
+            mysql_free_result(ec->result);
+            ec->result = NULL;
+        }
+        if (ec->mysql) {
+            mysql_close(ec->mysql);
+            ec->mysql = NULL;
+        }
+        free(ec->query);
+        ec->query = NULL;
+        free(ec->prepared);
+        ec->prepared = NULL;
+        /* an item cut short by an error */
+        if (pst_queue_Release(&ec->item)) {
+            WakeLoops();
+        }
+    }
+
+    if (loop->timer_fd >= 0) {
+        close(loop->timer_fd);
+    }
+
+    if (loop->epoll_fd >= 0) {
+        close(loop->epoll_fd);
+    }
+}
+
+static void* RunLoop(void* arg) {
+    PstEventLoop* loop = (PstEventLoop*)arg;
+    loop->ret = RET_OK;
+
+    mysql_thread_init();
+
+    if (OpenLoop(loop) != RET_OK || StartConnections(loop) != RET_OK) {
+        loop->ret = RET_ERR;
+    }
+
+    struct epoll_event events[PST_EVENT_MAX_EVENTS];
+    while (loop->ret == RET_OK && loop->active > 0) {
+        if (atomic_load(&g_abort)) {
+            loop->ret = RET_ERR;
+            break;
+        }
+
+        /* an abort elsewhere comes in through the wakeup, see AbortLoops */
+        int count = epoll_wait(loop->epoll_fd, events, PST_EVENT_MAX_EVENTS, -1);
+        for (int i = 0; i < count && loop->ret == RET_OK; i++) {
+            int ret;
+            if (events[i].data.ptr == NULL) {
+                ret = StartWaiting(loop);
+            } else if (events[i].data.ptr == loop) {
+                ret = StartFenced(loop);
+            } else {
+                ret = StepConnection(loop, (PstEventConnection*)events[i].data.ptr);
+            }
+            if (ret != RET_OK) {
+                loop->ret = RET_ERR;
+            }
+        }
+    }
+
+    if (loop->ret != RET_OK) {
+        AbortLoops();
+    }
+
+    CloseLoop(loop);
+    log_info("Event loop %u finished after %lu executions.", loop->id, loop->stats.executions);
+
+    mysql_thread_end();
+
+    return NULL;
+}
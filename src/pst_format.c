@@ -0,0 +1,144 @@
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "pst_format.h"
+
+/* values at or above this are left to snprintf, below it value * 100 */
+/* is known to well under one cent */
+#define PST_FORMAT_FIXED2_LIMIT 1e12
+
+/* "00" to "99" */
+static const char g_digit_pairs[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+/* Digits of value written backwards from end, returns the first one */
+static char* WriteDigits(char* end, uint64_t value) {
+    while (value >= 100) {
+        const char* pair = &g_digit_pairs[(value % 100) * 2];
+        value /= 100;
+        *--end = pair[1];
+        *--end = pair[0];
+    }
+    if (value >= 10) {
+        const char* pair = &g_digit_pairs[value * 2];
+        *--end = pair[1];
+        *--end = pair[0];
+    } else {
+        *--end = (char)('0' + value);
+    }
+
+    return end;
+}
+
+/* value zero padded to at least width digits, "%0*u" */
+static size_t WritePadded(char* buffer, unsigned int value, size_t width) {
+    char digits[20];
+    char* first = WriteDigits(digits + sizeof(digits), value);
+    size_t length = digits + sizeof(digits) - first;
+
+    size_t pad = 0;
+    while (length + pad < width) {
+        buffer[pad++] = '0';
+    }
+    memcpy(buffer + pad, first, length);
+
+    return pad + length;
+}
+
+/* "%.2f" through snprintf, cut to the 63 characters callers make room for */
+static size_t PrintFixed2(char* buffer, double value) {
+    int length = snprintf(buffer, 64, "%.2f", value);
+    return length < 64 ? (size_t)length : 63;
+}
+
+size_t pst_format_Uint64(char* buffer, uint64_t value) {
+    char digits[20];
+    char* first = WriteDigits(digits + sizeof(digits), value);
+    size_t length = digits + sizeof(digits) - first;
+
+    memcpy(buffer, first, length);
+    buffer[length] = '\0';
+
+    return length;
+}
+
+size_t pst_format_Int64(char* buffer, int64_t value) {
+    if (value >= 0) {
+        return pst_format_Uint64(buffer, (uint64_t)value);
+    }
+
+    /* negate as unsigned, INT64_MIN has no positive counterpart */
+    buffer[0] = '-';
+    return 1 + pst_format_Uint64(buffer + 1, 0 - (uint64_t)value);
+}
+
+size_t pst_format_Fixed2(char* buffer, double value) {
+    double magnitude = fabs(value);
+    if (!(magnitude < PST_FORMAT_FIXED2_LIMIT)) {
+        /* infinity, nan and values too large for the fast path */
+        return PrintFixed2(buffer, value);
+    }
+
+    /* printf rounds the exact binary value, ties to even. Scaling by 100 */
+    /* is off by up to half an ulp, so a result that close to a tie cannot */
+    /* be decided here */
+    double scaled = magnitude * 100.0;
+    double fraction = scaled - floor(scaled);
+    if (fabs(fraction - 0.5) <= scaled * 1e-15) {
+        return PrintFixed2(buffer, value);
+    }
+
+    uint64_t cents = (uint64_t)(scaled + 0.5);
+    size_t length = 0;
+    if (signbit(value)) {
+        buffer[length++] = '-';
+    }
+    length += pst_format_Uint64(buffer + length, cents / 100);
+    const char* pair = &g_digit_pairs[(cents % 100) * 2];
+    buffer[length++] = '.';
+    buffer[length++] = pair[0];
+    buffer[length++] = pair[1];
+    buffer[length] = '\0';
+
+    return length;
+}
+
+size_t pst_format_Date(char* buffer, const MYSQL_TIME* time) {
+    size_t length = WritePadded(buffer, time->year, 4);
+    buffer[length++] = '-';
+    length += WritePadded(buffer + length, time->month, 2);
+    buffer[length++] = '-';
+    length += WritePadded(buffer + length, time->day, 2);
+    buffer[length] = '\0';
+
+    return length;
+}
+
+size_t pst_format_Time(char* buffer, const MYSQL_TIME* time) {
+    size_t length = WritePadded(buffer, time->hour, 2);
+    buffer[length++] = ':';
+    length += WritePadded(buffer + length, time->minute, 2);
+    buffer[length++] = ':';
+    length += WritePadded(buffer + length, time->second, 2);
+    buffer[length] = '\0';
+
+    return length;
+}
+
+size_t pst_format_DateTime(char* buffer, const MYSQL_TIME* time) {
+    size_t length = pst_format_Date(buffer, time);
+    buffer[length++] = ' ';
+    length += pst_format_Time(buffer + length, time);
+
+    return length;
+}
@@ -0,0 +1,360 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <zlib.h>
+
+#include "log.h"
+#include "pst.h"
+#include "pst_histogram.h"
+
+/* V2 encoding, see HdrHistogram's EncodableHistogram, 0x10 marks the LEB128 word size */
+#define V2_ENCODING_COOKIE (0x1c849303 | 0x10)
+#define V2_COMPRESSION_COOKIE (0x1c849304 | 0x10)
+#define V2_ENCODING_HEADER_SIZE 40
+#define V2_COMPRESSION_HEADER_SIZE 8
+/* the log carries Interval_Max in milliseconds */
+#define MAX_VALUE_UNIT_RATIO 1000.0
+
+static int32_t GetBucketIndex(const PstHistogram* h, int64_t value);
+static int32_t GetSubBucketIndex(const PstHistogram* h, int64_t value, int32_t bucket_index);
+static int32_t GetCountsIndex(const PstHistogram* h, int32_t bucket_index, int32_t sub_bucket_index);
+static int32_t GetCountsIndexFor(const PstHistogram* h, int64_t value);
+static int64_t GetValueAtIndex(const PstHistogram* h, int32_t index);
+static int64_t GetSizeOfEquivalentRange(const PstHistogram* h, int64_t value);
+static int64_t GetLowestEquivalentValue(const PstHistogram* h, int64_t value);
+static int64_t GetHighestEquivalentValue(const PstHistogram* h, int64_t value);
+static void PutInt32(unsigned char* buffer, uint32_t value);
+static void PutInt64(unsigned char* buffer, uint64_t value);
+static int32_t PutZigZag(unsigned char* buffer, int64_t signed_value);
+static int Encode(const PstHistogram* h, char** base64);
+static char* Base64Encode(const unsigned char* data, size_t length);
+
+int pst_histogram_Init(PstHistogram* h, int64_t lowest, int64_t highest, int32_t significant_figures) {
+    memset(h, 0, sizeof(PstHistogram));
+
+    if (lowest < 1 || highest < 2 * lowest || significant_figures < 1 || significant_figures > 5) {
+        log_error("Invalid histogram range %lld..%lld with %d significant figures", (long long)lowest, (long long)highest, significant_figures);
+        return RET_ERR;
+    }
+
+    int64_t largest_value_with_single_unit_resolution = 2 * (int64_t)pow(10, significant_figures);
+    int32_t sub_bucket_count_magnitude = (int32_t)ceil(log2((double)largest_value_with_single_unit_resolution));
+
+    h->lowest_discernible_value = lowest;
+    h->highest_trackable_value = highest;
+    h->significant_figures = significant_figures;
+    h->unit_magnitude = (int32_t)floor(log2((double)lowest));
+    h->sub_bucket_half_count_magnitude = (sub_bucket_count_magnitude > 1 ? sub_bucket_count_magnitude : 1) - 1;
+    h->sub_bucket_count = 1 << (h->sub_bucket_half_count_magnitude + 1);
+    h->sub_bucket_half_count = h->sub_bucket_count / 2;
+    h->sub_bucket_mask = ((int64_t)h->sub_bucket_count - 1) << h->unit_magnitude;
+
+    int64_t smallest_untrackable_value = ((int64_t)h->sub_bucket_count) << h->unit_magnitude;
+    int32_t buckets_needed = 1;
+    while (smallest_untrackable_value <= highest) {
+        if (smallest_untrackable_value > INT64_MAX / 2) {
+            buckets_needed++;
+            break;
+        }
+        smallest_untrackable_value <<= 1;
+        buckets_needed++;
+    }
+    h->bucket_count = buckets_needed;
+    h->counts_len = (h->bucket_count + 1) * (h->sub_bucket_count / 2);
+    h->min_value = INT64_MAX;
+    h->max_value = 0;
+
+    h->counts = (int64_t*)malloc(h->counts_len * sizeof(int64_t));
+    if (h->counts == NULL) {
+        log_error(PST_FORMAT_MSG_ERR_ALLOC, "histogram->counts");
+        return RET_ERR;
+    }
+    memset(h->counts, 0, h->counts_len * sizeof(int64_t));
+
+    return RET_OK;
+}
+
+void pst_histogram_Free(PstHistogram* h) {
+    if (h->counts) {
+        free(h->counts);
+        h->counts = NULL;
+    }
+}
+
+void pst_histogram_Record(PstHistogram* h, int64_t value) {
+    if (value < 0) {
+        value = 0;
+    }
+    if (value > h->highest_trackable_value) {
+        value = h->highest_trackable_value;
+    }
+
+    int32_t index = GetCountsIndexFor(h, value);
+    __atomic_fetch_add(&h->counts[index], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&h->total_count, 1, __ATOMIC_RELAXED);
+
+    int64_t current = __atomic_load_n(&h->min_value, __ATOMIC_RELAXED);
+    while (value < current && !__atomic_compare_exchange_n(&h->min_value, &current, value, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+    current = __atomic_load_n(&h->max_value, __ATOMIC_RELAXED);
+    while (value > current && !__atomic_compare_exchange_n(&h->max_value, &current, value, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+void pst_histogram_Add(PstHistogram* to, const PstHistogram* from) {
+    for (int32_t i = 0; i < from->counts_len && i < to->counts_len; i++) {
+        to->counts[i] += from->counts[i];
+    }
+    to->total_count += from->total_count;
+    if (from->total_count > 0) {
+        if (from->min_value < to->min_value) {
+            to->min_value = from->min_value;
+        }
+        if (from->max_value > to->max_value) {
+            to->max_value = from->max_value;
+        }
+    }
+}
+
+int64_t pst_histogram_ValueAtPercentile(const PstHistogram* h, double percentile) {
+    if (h->total_count == 0) {
+        return 0;
+    }
+
+    double requested = percentile < 100.0 ? percentile : 100.0;
+    int64_t count_at_percentile = (int64_t)((requested / 100.0) * h->total_count + 0.5);
+    if (count_at_percentile < 1) {
+        count_at_percentile = 1;
+    }
+
+    int64_t total = 0;
+    for (int32_t i = 0; i < h->counts_len; i++) {
+        total += h->counts[i];
+        if (total >= count_at_percentile) {
+            return GetHighestEquivalentValue(h, GetValueAtIndex(h, i));
+        }
+    }
+
+    return 0;
+}
+
+double pst_histogram_Mean(const PstHistogram* h) {
+    if (h->total_count == 0) {
+        return 0;
+    }
+
+    double total = 0;
+    for (int32_t i = 0; i < h->counts_len; i++) {
+        if (h->counts[i] > 0) {
+            int64_t value = GetValueAtIndex(h, i);
+            /* median equivalent value of the bucket */
+            total += (double)(GetLowestEquivalentValue(h, value) + GetSizeOfEquivalentRange(h, value) / 2) * h->counts[i];
+        }
+    }
+
+    return total / h->total_count;
+}
+
+void pst_histogram_WriteLogHeader(FILE* file, double start_time) {
+    char date[64];
+    time_t seconds = (time_t)start_time;
+    struct tm tm;
+    localtime_r(&seconds, &tm);
+    strftime(date, sizeof(date), "%a %b %d %H:%M:%S %Z %Y", &tm);
+
+    fprintf(file, "#[Histogram log format version 1.3]\n");
+    fprintf(file, "#[StartTime: %.3f (seconds since epoch), %s]\n", start_time, date);
+    fprintf(file, "#[BaseTime: %.3f (seconds since epoch)]\n", start_time);
+    fprintf(file, "\"StartTimestamp\",\"Interval_Length\",\"Interval_Max\",\"Interval_Compressed_Histogram\"\n");
+}
+
+int pst_histogram_WriteLogInterval(FILE* file, const char* tag, double start, double length, const PstHistogram* h) {
+    char* base64 = NULL;
+    if (Encode(h, &base64) != RET_OK) {
+        return RET_ERR;
+    }
+
+    if (tag != NULL) {
+        fprintf(file, "Tag=%s,", tag);
+    }
+    fprintf(file, "%.3f,%.3f,%.3f,%s\n", start, length, h->max_value / MAX_VALUE_UNIT_RATIO, base64);
+
+    free(base64);
+    base64 = NULL;
+
+    return RET_OK;
+}
+
+/* static functions */
+static int32_t GetBucketIndex(const PstHistogram* h, int64_t value) {
+    /* smallest power of 2 containing value */
+    int32_t pow2ceiling = 64 - __builtin_clzll((uint64_t)(value | h->sub_bucket_mask));
+    return pow2ceiling - h->unit_magnitude - (h->sub_bucket_half_count_magnitude + 1);
+}
+
+static int32_t GetSubBucketIndex(const PstHistogram* h, int64_t value, int32_t bucket_index) {
+    return (int32_t)(value >> (bucket_index + h->unit_magnitude));
+}
+
+static int32_t GetCountsIndex(const PstHistogram* h, int32_t bucket_index, int32_t sub_bucket_index) {
+    int32_t bucket_base_index = (bucket_index + 1) << h->sub_bucket_half_count_magnitude;
+    int32_t offset_in_bucket = sub_bucket_index - h->sub_bucket_half_count;
+    return bucket_base_index + offset_in_bucket;
+}
+
+static int32_t GetCountsIndexFor(const PstHistogram* h, int64_t value) {
+    int32_t bucket_index = GetBucketIndex(h, value);
+    int32_t sub_bucket_index = GetSubBucketIndex(h, value, bucket_index);
+    return GetCountsIndex(h, bucket_index, sub_bucket_index);
+}
+
+static int64_t GetValueAtIndex(const PstHistogram* h, int32_t index) {
+    int32_t bucket_index = (index >> h->sub_bucket_half_count_magnitude) - 1;
+    int32_t sub_bucket_index = (index & (h->sub_bucket_half_count - 1)) + h->sub_bucket_half_count;
+    if (bucket_index < 0) {
+        sub_bucket_index -= h->sub_bucket_half_count;
+        bucket_index = 0;
+    }
+    return ((int64_t)sub_bucket_index) << (bucket_index + h->unit_magnitude);
+}
+
+static int64_t GetSizeOfEquivalentRange(const PstHistogram* h, int64_t value) {
+    int32_t bucket_index = GetBucketIndex(h, value);
+    int32_t sub_bucket_index = GetSubBucketIndex(h, value, bucket_index);
+    int32_t adjusted_bucket = sub_bucket_index >= h->sub_bucket_count ? bucket_index + 1 : bucket_index;
+    return 1LL << (h->unit_magnitude + adjusted_bucket);
+}
+
+static int64_t GetLowestEquivalentValue(const PstHistogram* h, int64_t value) {
+    int32_t bucket_index = GetBucketIndex(h, value);
+    int32_t sub_bucket_index = GetSubBucketIndex(h, value, bucket_index);
+    return ((int64_t)sub_bucket_index) << (bucket_index + h->unit_magnitude);
+}
+
+static int64_t GetHighestEquivalentValue(const PstHistogram* h, int64_t value) {
+    return GetLowestEquivalentValue(h, value) + GetSizeOfEquivalentRange(h, value) - 1;
+}
+
+static void PutInt32(unsigned char* buffer, uint32_t value) {
+    for (int i = 3; i >= 0; i--) {
+        buffer[3 - i] = (unsigned char)(value >> (i * 8));
+    }
+}
+
+static void PutInt64(unsigned char* buffer, uint64_t value) {
+    for (int i = 7; i >= 0; i--) {
+        buffer[7 - i] = (unsigned char)(value >> (i * 8));
+    }
+}
+
+/* LEB128 of the zig-zag value, the 9th byte carries the full remaining 8 bits */
+static int32_t PutZigZag(unsigned char* buffer, int64_t signed_value) {
+    uint64_t value = ((uint64_t)signed_value << 1) ^ (uint64_t)(signed_value >> 63);
+    for (int32_t i = 0; i < 8; i++) {
+        if ((value >> (7 * (i + 1))) == 0) {
+            buffer[i] = (unsigned char)(value >> (7 * i));
+            return i + 1;
+        }
+        buffer[i] = (unsigned char)(((value >> (7 * i)) & 0x7F) | 0x80);
+    }
+    buffer[8] = (unsigned char)(value >> 56);
+    return 9;
+}
+
+static int Encode(const PstHistogram* h, char** base64) {
+    int32_t counts_limit = h->total_count > 0 ? GetCountsIndexFor(h, h->max_value) + 1 : 0;
+    size_t encoded_size = V2_ENCODING_HEADER_SIZE + (size_t)(counts_limit > 0 ? counts_limit : 1) * 9;
+
+    unsigned char* encoded = (unsigned char*)malloc(encoded_size);
+    if (encoded == NULL) {
+        log_error(PST_FORMAT_MSG_ERR_ALLOC, "encoded histogram");
+        return RET_ERR;
+    }
+    memset(encoded, 0, encoded_size);
+
+    /* zero runs are written as negative counts */
+    int32_t payload_length = 0;
+    int32_t i = 0;
+    while (i < counts_limit) {
+        int64_t value = h->counts[i];
+        i++;
+        if (value == 0) {
+            int64_t zeros = 1;
+            while (i < counts_limit && h->counts[i] == 0) {
+                zeros++;
+                i++;
+            }
+            payload_length += PutZigZag(encoded + V2_ENCODING_HEADER_SIZE + payload_length, -zeros);
+        } else {
+            payload_length += PutZigZag(encoded + V2_ENCODING_HEADER_SIZE + payload_length, value);
+        }
+    }
+
+    double conversion_ratio = 1.0;
+    uint64_t conversion_ratio_bits;
+    memcpy(&conversion_ratio_bits, &conversion_ratio, sizeof(uint64_t));
+
+    PutInt32(encoded, V2_ENCODING_COOKIE);
+    PutInt32(encoded + 4, (uint32_t)payload_length);
+    PutInt32(encoded + 8, 0);
+    PutInt32(encoded + 12, (uint32_t)h->significant_figures);
+    PutInt64(encoded + 16, (uint64_t)h->lowest_discernible_value);
+    PutInt64(encoded + 24, (uint64_t)h->highest_trackable_value);
+    PutInt64(encoded + 32, conversion_ratio_bits);
+
+    uLong source_length = V2_ENCODING_HEADER_SIZE + payload_length;
+    uLongf compressed_length = compressBound(source_length);
+    unsigned char* compressed = (unsigned char*)malloc(V2_COMPRESSION_HEADER_SIZE + compressed_length);
+    if (compressed == NULL) {
+        log_error(PST_FORMAT_MSG_ERR_ALLOC, "compressed histogram");
+        free(encoded);
+        return RET_ERR;
+    }
+
+    if (compress2(compressed + V2_COMPRESSION_HEADER_SIZE, &compressed_length, encoded, source_length, Z_DEFAULT_COMPRESSION) != Z_OK) {
+        log_error("Failed to compress histogram");
+        free(compressed);
+        free(encoded);
+        return RET_ERR;
+    }
+    PutInt32(compressed, V2_COMPRESSION_COOKIE);
+    PutInt32(compressed + 4, (uint32_t)compressed_length);
+
+    *base64 = Base64Encode(compressed, V2_COMPRESSION_HEADER_SIZE + compressed_length);
+
+    free(compressed);
+    compressed = NULL;
+    free(encoded);
+    encoded = NULL;
+
+    return *base64 != NULL ? RET_OK : RET_ERR;
+}
+
+static char* Base64Encode(const unsigned char* data, size_t length) {
+    static const char table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+    size_t output_length = 4 * ((length + 2) / 3);
+    char* output = (char*)malloc(output_length + 1);
+    if (output == NULL) {
+        log_error(PST_FORMAT_MSG_ERR_ALLOC, "base64 histogram");
+        return NULL;
+    }
+    memset(output, 0, output_length + 1);
+
+    size_t j = 0;
+    for (size_t i = 0; i < length; i += 3) {
+        uint32_t octet_a = data[i];
+        uint32_t octet_b = i + 1 < length ? data[i + 1] : 0;
+        uint32_t octet_c = i + 2 < length ? data[i + 2] : 0;
+        uint32_t triple = (octet_a << 16) | (octet_b << 8) | octet_c;
+
+        output[j++] = table[(triple >> 18) & 0x3F];
+        output[j++] = table[(triple >> 12) & 0x3F];
+        output[j++] = i + 1 < length ? table[(triple >> 6) & 0x3F] : '=';
+        output[j++] = i + 2 < length ? table[triple & 0x3F] : '=';
+    }
+
+    return output;
+}
@@ -5,156 +5,178 @@
 #include "log.h"
 #include "pst_input.h"
 
-/* global variable for parameter binding */
-static MYSQL_BIND* bind = NULL;
-static unsigned long g_count;
-
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdbool.h>
 #include <string.h>
 #include <mysql/mysql.h>
 
-static int BindParameters(PstParameter* param, unsigned long count) {
-    /* free previous parameter binding */
-    pst_input_FreeParameters();
+/* one block per statement, params_size arrays of param_markers_count binds */
+static MYSQL_BIND** g_binds;
+static unsigned long g_binds_size;
 
-    bind = (MYSQL_BIND*)malloc(count * sizeof(MYSQL_BIND));
-    if (bind == NULL) {
-        log_error(PST_FORMAT_MSG_ERR_ALLOC, "bind");
+static void FillBinds(MYSQL_BIND* bind, const PstParameter* param, unsigned long count);
+static int CheckParamCount(MYSQL_STMT* stmt, unsigned long count);
+
+int pst_input_Init(const PstPreparedStatements* prep_stmts) {
+    g_binds = (MYSQL_BIND**)calloc(prep_stmts->prep_stmt_size, sizeof(MYSQL_BIND*));
+    if (g_binds == NULL) {
+        log_error(PST_FORMAT_MSG_ERR_ALLOC, "binds");
         return RET_ERR;
     }
-    memset(bind, 0, count * sizeof(MYSQL_BIND));
+    g_binds_size = prep_stmts->prep_stmt_size;
 
-    for (int i = 0; i < count; i++) {
-        bind[i].length = 0;
-        bind[i].is_null = (bool*)false;
+    for (unsigned long i = 0; i < prep_stmts->prep_stmt_size; i++) {
+        const PstPreparedStatement* prep_stmt = &prep_stmts->prep_stmt[i];
+        unsigned long count = prep_stmt->param_markers_count;
+        if (prep_stmt->params_size == 0 || count == 0) {
+            continue;
+        }
 
-        bind[i].is_unsigned = param[i].is_unsigned;
-        bind[i].buffer_type = pst_ToMySQLFieldType(param[i].type);
-        switch (bind[i].buffer_type) {
-        case MYSQL_TYPE_TINY:
-            bind[i].buffer = malloc(sizeof(signed char));
-            if (bind[i].buffer == NULL) {
-                log_error(PST_FORMAT_MSG_ERR_ALLOC, "bind->buffer");
-                return RET_ERR;
-            }
-            memset(bind[i].buffer, 0, sizeof(signed char));
-            *(signed char*)bind[i].buffer = (signed char)param[i].valuedouble;
-            break;
-        case MYSQL_TYPE_SHORT:
-            bind[i].buffer = malloc(sizeof(short));
-            if (bind[i].buffer == NULL) {
-                log_error(PST_FORMAT_MSG_ERR_ALLOC, "bind->buffer");
-                return RET_ERR;
-            }
-            memset(bind[i].buffer, 0, sizeof(short));
-            *(short*)bind[i].buffer = (short)param[i].valuedouble;
-            break;
-        case MYSQL_TYPE_LONG:
-            bind[i].buffer = malloc(sizeof(int));
-            if (bind[i].buffer == NULL) {
-                log_error(PST_FORMAT_MSG_ERR_ALLOC, "bind->buffer");
-                return RET_ERR;
-            }
-            memset(bind[i].buffer, 0, sizeof(int));
-            *(int*)bind[i].buffer = (int)param[i].valuedouble;
-            break;
-        case MYSQL_TYPE_LONGLONG:
-            bind[i].buffer = malloc(sizeof(long long));
-            if (bind[i].buffer == NULL) {
-                log_error(PST_FORMAT_MSG_ERR_ALLOC, "bind->buffer");
-                return RET_ERR;
-            }
-            memset(bind[i].buffer, 0, sizeof(long long));
-            *(long long*)bind[i].buffer = (long long)param[i].valuedouble;
-            break;
-        case MYSQL_TYPE_FLOAT:
-            bind[i].buffer = malloc(sizeof(float));
-            if (bind[i].buffer == NULL) {
-                log_error(PST_FORMAT_MSG_ERR_ALLOC, "bind->buffer");
-                return RET_ERR;
-            }
-            memset(bind[i].buffer, 0, sizeof(float));
-            *(float*)bind[i].buffer = (float)param[i].valuedouble;
-            break;
-        case MYSQL_TYPE_DOUBLE:
-            bind[i].buffer = malloc(sizeof(double));
-            if (bind[i].buffer == NULL) {
-                log_error(PST_FORMAT_MSG_ERR_ALLOC, "bind->buffer");
-                return RET_ERR;
-            }
-            memset(bind[i].buffer, 0, sizeof(double));
-            *(double*)bind[i].buffer = (double)param[i].valuedouble;
-            break;
-        case MYSQL_TYPE_TIME:
-        case MYSQL_TYPE_DATE:
-        case MYSQL_TYPE_DATETIME:
-        case MYSQL_TYPE_TIMESTAMP:
-            bind[i].buffer = malloc(sizeof(MYSQL_TIME));
-            if (bind[i].buffer == NULL) {
-                log_error(PST_FORMAT_MSG_ERR_ALLOC, "bind->buffer");
-                return RET_ERR;
-            }
-            memset(bind[i].buffer, 0, sizeof(MYSQL_TIME));
-            *(MYSQL_TIME*)bind[i].buffer = pst_ToMySQLTime(param[i].valuestring);
-            break;
-        case MYSQL_TYPE_STRING:
-        case MYSQL_TYPE_BLOB:
-            bind[i].buffer_length = strlen(param[i].valuestring) + 1;
-            bind[i].length = &bind[i].buffer_length;
-            bind[i].buffer = malloc(bind[i].buffer_length);
-            if (bind[i].buffer == NULL) {
-                log_error(PST_FORMAT_MSG_ERR_ALLOC, "bind->buffer");
-                return RET_ERR;
-            }
-            memset(bind[i].buffer, 0, bind[i].buffer_length);
-            memcpy(bind[i].buffer, param[i].valuestring, bind[i].buffer_length);
-            break;
-        case MYSQL_TYPE_NULL:
-            bind[i].is_null = (bool*)true;
-        default:
-            break;
+        g_binds[i] = (MYSQL_BIND*)calloc(prep_stmt->params_size * count, sizeof(MYSQL_BIND));
+        if (g_binds[i] == NULL) {
+            log_error(PST_FORMAT_MSG_ERR_ALLOC, "binds");
+            pst_input_Free();
+            return RET_ERR;
         }
+        for (unsigned long j = 0; j < prep_stmt->params_size; j++) {
+            FillBinds(g_binds[i] + j * count, prep_stmt->params[j], count);
+        }
+        log_debug("Statement[%lu]: %lu bind arrays, %lu bytes", i, prep_stmt->params_size,
+            prep_stmt->params_size * count * sizeof(MYSQL_BIND));
     }
 
     return RET_OK;
 }
 
-int pst_input_InputParameters(MYSQL_STMT* stmt, PstParameter* param, unsigned long count) {
-    g_count = count;
-    if (g_count != mysql_stmt_param_count(stmt)) {
-        log_error("Param count not match, statement param count is %lu, input parameter count is %lu",
-            mysql_stmt_param_count(stmt), g_count);
+int pst_input_BindParameters(PstSession* session, const PstParameter* param, unsigned long count) {
+    /* free previous parameter binding */
+    pst_input_FreeParameters(session);
+
+    session->param_bind = (MYSQL_BIND*)calloc(count, sizeof(MYSQL_BIND));
+    if (session->param_bind == NULL) {
+        log_error(PST_FORMAT_MSG_ERR_ALLOC, "bind");
+        return RET_ERR;
+    }
+    session->param_count = count;
+    FillBinds(session->param_bind, param, count);
+
+    return RET_OK;
+}
+
+int pst_input_InputParameters(PstSession* session, MYSQL_STMT* stmt, PstParameter* param, unsigned long count) {
+    session->param_count = count;
+    if (CheckParamCount(stmt, count) != RET_OK) {
         return RET_ERR;
     }
 
-    if (g_count == 0) {
+    if (session->param_count == 0) {
         return RET_OK;
     }
 
-    if (BindParameters(param, g_count) != RET_OK) {
+    if (pst_input_BindParameters(session, param, session->param_count) != RET_OK) {
+        return RET_ERR;
+    }
+
+    if (mysql_stmt_bind_param(stmt, session->param_bind) != 0) {
+        log_error(PST_FORMAT_MSG_ERR_MYSQL, mysql_stmt_errno(stmt), mysql_stmt_sqlstate(stmt), mysql_stmt_error(stmt));
+        return RET_ERR;
+    }
+
+    return RET_OK;
+
+}
+
+int pst_input_InputPrepared(PstSession* session, MYSQL_STMT* stmt, unsigned long stmt_index, unsigned long params_index, unsigned long count) {
+    pst_input_FreeParameters(session);
+
+    if (CheckParamCount(stmt, count) != RET_OK) {
         return RET_ERR;
     }
+    if (count == 0) {
+        return RET_OK;
+    }
 
+    /* the library copies the array into the statement, workers share it */
+    MYSQL_BIND* bind = g_binds[stmt_index] + params_index * count;
     if (mysql_stmt_bind_param(stmt, bind) != 0) {
         log_error(PST_FORMAT_MSG_ERR_MYSQL, mysql_stmt_errno(stmt), mysql_stmt_sqlstate(stmt), mysql_stmt_error(stmt));
         return RET_ERR;
     }
 
     return RET_OK;
+}
 
+int pst_input_InputCompiled(PstSession* session, MYSQL_STMT* stmt, const PstCompiledValue* set, unsigned long count) {
+    pst_input_FreeParameters(session);
+
+    if (CheckParamCount(stmt, count) != RET_OK) {
+        return RET_ERR;
+    }
+    if (count == 0) {
+        return RET_OK;
+    }
+
+    session->param_bind = (MYSQL_BIND*)calloc(count, sizeof(MYSQL_BIND));
+    if (session->param_bind == NULL) {
+        log_error(PST_FORMAT_MSG_ERR_ALLOC, "bind");
+        return RET_ERR;
+    }
+    session->param_count = count;
+
+    /* the values are already in the layout of the buffers */
+    const PstCompiledValue* value = set;
+    for (unsigned long i = 0; i < count; i++) {
+        session->param_bind[i].buffer_type = (PstFieldTypes)value->buffer_type;
+        session->param_bind[i].is_unsigned = value->is_unsigned;
+        session->param_bind[i].buffer = (void*)PST_COMPILED_DATA(value);
+        session->param_bind[i].buffer_length = value->length;
+        session->param_bind[i].length = &session->param_bind[i].buffer_length;
+        value = PST_COMPILED_NEXT(value);
+    }
+
+    if (mysql_stmt_bind_param(stmt, session->param_bind) != 0) {
+        log_error(PST_FORMAT_MSG_ERR_MYSQL, mysql_stmt_errno(stmt), mysql_stmt_sqlstate(stmt), mysql_stmt_error(stmt));
+        return RET_ERR;
+    }
+
+    return RET_OK;
 }
 
-void pst_input_FreeParameters() {
-    if (bind) {
-        for (unsigned long i = 0; i < g_count; i++) {
-            if (bind[i].buffer) {
-                free(bind[i].buffer);
-                bind[i].buffer = NULL;
-            }
-        }
-        free(bind);
-        bind = NULL;
+void pst_input_FreeParameters(PstSession* session) {
+    /* the buffers belong to the parameter sets */
+    free(session->param_bind);
+    session->param_bind = NULL;
+}
+
+void pst_input_Free() {
+    for (unsigned long i = 0; i < g_binds_size; i++) {
+        free(g_binds[i]);
+    }
+    free(g_binds);
+    g_binds = NULL;
+    g_binds_size = 0;
+}
+
+/* static functions */
+/* The values were resolved when the set was parsed, the buffers point at */
+/* them and the set outlives the execution */
+static void FillBinds(MYSQL_BIND* bind, const PstParameter* param, unsigned long count) {
+    for (unsigned long i = 0; i < count; i++) {
+        bind[i].buffer_type = param[i].buffer_type;
+        bind[i].is_unsigned = param[i].is_unsigned;
+        bind[i].buffer = (void*)pst_GetParameterBuffer(&param[i]);
+        bind[i].buffer_length = param[i].length;
+        bind[i].length = &bind[i].buffer_length;
     }
 }
+
+static int CheckParamCount(MYSQL_STMT* stmt, unsigned long count) {
+    if (count != mysql_stmt_param_count(stmt)) {
+        log_error("Param count not match, statement param count is %lu, input parameter count is %lu",
+            mysql_stmt_param_count(stmt), count);
+        return RET_ERR;
+    }
+
+    return RET_OK;
+}
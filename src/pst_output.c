@@ -4,658 +4,1414 @@
 
 #include "log.h"
 #include "pst_output.h"
+#include "pst_digest.h"
+#include "pst_format.h"
 #include "pst_print.h"
+#include "pst_timing.h"
+#include "pst_arena.h"
+
+/* streamed string columns start with buffers of at most this size, */
+/* longer values grow the buffer on MYSQL_DATA_TRUNCATED */
+#define PST_STREAM_BUFFER_LENGTH 4096
+/* widest column of the streamed table, longer values overflow the border */
+#define PST_STREAM_COLUMN_WIDTH 32
+
+static double GetElapsedSec(const PstSession* session);
+static void GetRowsAffected(PstSession* session);
+static int InitResultSet(PstSession* session);
+static int StoreHeader(PstSession* session, const MYSQL_FIELD* fields);
+static size_t FormatResult(PstResult* result);
+static unsigned long GetValueSize(PstFieldTypes type);
+static int FetchResultSet(PstSession* session);
+static int FetchRowsInPlace(PstSession* session);
+static int BindRowBuffers(PstSession* session, const MYSQL_FIELD* fields, unsigned int field_count);
+static bool IsStreamed(const PstSession* session);
+static int StreamResultSet(PstSession* session);
+static int DigestResultSet(PstSession* session);
+static bool HasResultSet(PstSyntax syntax);
+static int FetchColumnSet(PstSession* session);
+static void GetColumnRow(PstSession* session, uint64_t row, PstResult* row_view);
+static void PrintColumnSet(PstSession* session);
+static void GetResultSet(PstSession* session);
+static void PrintResultSet(PstSession* session);
+static void PrintFormatRows(PstSession* session);
+
+/* Prints the streamed rows as a table, column widths come from the metadata */
+static int BeginTable(PstSession* session, const MYSQL_FIELD* fields, unsigned int field_count);
+static int PrintTableRow(PstSession* session, const PstResult* row, unsigned int field_count);
+static int EndTable(PstSession* session, uint64_t rows);
+
+static const PstRowSink g_table_sink = { BeginTable, PrintTableRow, EndTable };
+
+/* Rows in the machine formats of pst_print.c */
+static int BeginFormat(PstSession* session, const MYSQL_FIELD* fields, unsigned int field_count);
+static int PrintFormatRow(PstSession* session, const PstResult* row, unsigned int field_count);
+static int EndFormat(PstSession* session, uint64_t rows);
+
+static const PstRowSink g_format_sink = { BeginFormat, PrintFormatRow, EndFormat };
 
-static MYSQL_STMT* g_stmt = NULL;
-static uint64_t rows;
-static int ret;
-static MYSQL_RES* result_metadata = NULL;
-static PstResultSet* result_set = NULL;
-static MYSQL_BIND* bind = NULL;
-static PstResult* result = NULL;
+/* Output of SQL Syntax Permitted in Prepared Statements */
+static void PrintAlterTable(PstSession* session);
+static void PrintAlterUser(PstSession* session);
+static void PrintAnalyzeTable(PstSession* session);
+static void PrintCacheIndex(PstSession* session);
+static void PrintCall(PstSession* session);
+static void PrintChange(PstSession* session);
+static void PrintCheckSum(PstSession* session);
+static void PrintCommit(PstSession* session);
+static void PrintCreateOrDropIndex(PstSession* session);
+static void PrintCreateOrRenameOrDropDatabase(PstSession* session);
+static void PrintCreateOrDropTable(PstSession* session);
+static void PrintCreateOrRenameOrDropUser(PstSession* session);
+static void PrintCreateOrDropView(PstSession* session);
+static void PrintDelete(PstSession* session);
+static void PrintDo(PstSession* session);
+static void PrintFlush(PstSession* session);
+static void PrintGrant(PstSession* session);
+static void PrintInsert(PstSession* session);
+static void PrintInsertSelect(PstSession* session);
+static void PrintInstallPlugin(PstSession* session);
+static void PrintKill(PstSession* session);
+static void PrintLoadIndexIntoCache(PstSession* session);
+static void PrintOptimizeTable(PstSession* session);
+static void PrintRenameTable(PstSession* session);
+static void PrintRepairTable(PstSession* session);
+static void PrintReplace(PstSession* session);
+static void PrintReset(PstSession* session);
+static void PrintRevoke(PstSession* session);
+static void PrintSelect(PstSession* session);
+static void PrintSet(PstSession* session);
+static void PrintShow(PstSession* session);
+static void PrintShowCreate(PstSession* session);
+static void PrintStartOrStopReplica(PstSession* session);
+static void PrintTruncate(PstSession* session);
+static void PrintUninstallPlugin(PstSession* session);
+static void PrintUpdate(PstSession* session);
+
+int pst_output_FetchResult(PstSession* session, MYSQL_STMT* stmt, const PstPreparedStatement* prep_stmt) {
+    session->prep_stmt = prep_stmt;
+    session->stmt = stmt;
+    session->rows = 0;
+    session->ret = RET_OK;
+    session->digest = PST_DIGEST_INIT;
+    session->result_bytes = 0;
+    session->digested = false;
+    session->fetch_end_ns = 0;
+
+    /* digest mode replaces the table of any statement that returns rows */
+    if (prep_stmt->result_mode == PstResultMode_Digest && mysql_stmt_field_count(stmt) > 0) {
+        if (InitResultSet(session) != RET_OK || DigestResultSet(session) != RET_OK) {
+            return RET_ERR;
+        }
+        session->digested = true;
+    } else if (!HasResultSet(prep_stmt->syntax)) {
+        GetRowsAffected(session);
+    } else if (!IsStreamed(session)) {
+        GetResultSet(session);
+    } else {
+        /* rows the server streams are fetched while they are printed */
+        session->stream_start_ns = pst_GetMonotonicNs();
+        return RET_OK;
+    }
+    session->fetch_end_ns = pst_GetMonotonicNs();
 
-static void GetRowsAffected();
-static int InitResultSet();
-static int FetchResultSet();
-static void GetResultSet();
+    return session->ret;
+}
 
-/* Output of SQL Syntax Permitted in Prepared Statements */
-static void PrintAlterTable();
-static void PrintAlterUser();
-static void PrintAnalyzeTable();
-static void PrintCacheIndex();
-static void PrintCall();
-static void PrintChange();
-static void PrintCheckSum();
-static void PrintCommit();
-static void PrintCreateOrDropIndex();
-static void PrintCreateOrRenameOrDropDatabase();
-static void PrintCreateOrDropTable();
-static void PrintCreateOrRenameOrDropUser();
-static void PrintCreateOrDropView();
-static void PrintDelete();
-static void PrintDo();
-static void PrintFlush();
-static void PrintGrant();
-static void PrintInsert();
-static void PrintInsertSelect();
-static void PrintInstallPlugin();
-static void PrintKill();
-static void PrintLoadIndexIntoCache();
-static void PrintOptimizeTable();
-static void PrintRenameTable();
-static void PrintRepairTable();
-static void PrintReplace();
-static void PrintReset();
-static void PrintRevoke();
-static void PrintSelect();
-static void PrintSet();
-static void PrintShow();
-static void PrintShowCreate();
-static void PrintStartOrStopReplica();
-static void PrintTruncate();
-static void PrintUninstallPlugin();
-static void PrintUpdate();
-
-int pst_output_OutputResult(MYSQL_STMT* stmt, PstSyntax syntax) {
-    g_stmt = stmt;
-    rows = 0;
-    ret = RET_OK;
+int pst_output_PrintResult(PstSession* session) {
+    if (session->digested) {
+        pst_print_PrintRowsDigested(session->rows, session->result_bytes, session->digest, GetElapsedSec(session));
+        return session->ret;
+    }
 
-    switch (syntax) {
-    case PstSyntax_AlterTable: PrintAlterTable(); break;
-    case PstSyntax_AlterUser: PrintAlterUser(); break;
-    case PstSyntax_AnalyzeTable: PrintAnalyzeTable(); break;
-    case PstSyntax_CacheIndex: PrintCacheIndex(); break;
-    case PstSyntax_Call: PrintCall(); break;
-    case PstSyntax_Change: PrintChange(); break;
-    case PstSyntax_CheckSum: PrintCheckSum(); break;
-    case PstSyntax_Commit: PrintCommit(); break;
-    case PstSyntax_CreateOrDropIndex: PrintCreateOrDropIndex(); break;
-    case PstSyntax_CreateOrRenameOrDropDatabase: PrintCreateOrRenameOrDropDatabase(); break;
-    case PstSyntax_CreateOrDropTable: PrintCreateOrDropTable(); break;
-    case PstSyntax_CreateOrRenameOrDropUser: PrintCreateOrRenameOrDropUser(); break;
-    case PstSyntax_CreateOrDropView: PrintCreateOrDropView(); break;
-    case PstSyntax_Delete: PrintDelete(); break;
-    case PstSyntax_Do: PrintDo(); break;
-    case PstSyntax_Flush: PrintFlush(); break;
-    case PstSyntax_Grant: PrintGrant(); break;
-    case PstSyntax_Insert: PrintInsert(); break;
-    case PstSyntax_InsertSelect: PrintInsertSelect(); break;
-    case PstSyntax_InstallPlugin: PrintInstallPlugin(); break;
-    case PstSyntax_Kill: PrintKill(); break;
-    case PstSyntax_LoadIndexIntoCache: PrintLoadIndexIntoCache(); break;
-    case PstSyntax_OptimizeTable: PrintOptimizeTable(); break;
-    case PstSyntax_RenameTable: PrintRenameTable(); break;
-    case PstSyntax_RepairTable: PrintRepairTable(); break;
-    case PstSyntax_Replace: PrintReplace(); break;
-    case PstSyntax_Reset: PrintReset(); break;
-    case PstSyntax_Revoke: PrintRevoke(); break;
-    case PstSyntax_Select: PrintSelect(); break;
-    case PstSyntax_Set: PrintSet(); break;
-    case PstSyntax_Show: PrintShow(); break;
-    case PstSyntax_ShowCreate: PrintShowCreate(); break;
-    case PstSyntax_StartOrStopReplica: PrintStartOrStopReplica(); break;
-    case PstSyntax_Truncate: PrintTruncate(); break;
-    case PstSyntax_UninstallPlugin: PrintUninstallPlugin(); break;
-    case PstSyntax_Update: PrintUpdate(); break;
-
-    default: ret = RET_ERR; break;
+    switch (session->prep_stmt->syntax) {
+    case PstSyntax_AlterTable: PrintAlterTable(session); break;
+    case PstSyntax_AlterUser: PrintAlterUser(session); break;
+    case PstSyntax_AnalyzeTable: PrintAnalyzeTable(session); break;
+    case PstSyntax_CacheIndex: PrintCacheIndex(session); break;
+    case PstSyntax_Call: PrintCall(session); break;
+    case PstSyntax_Change: PrintChange(session); break;
+    case PstSyntax_CheckSum: PrintCheckSum(session); break;
+    case PstSyntax_Commit: PrintCommit(session); break;
+    case PstSyntax_CreateOrDropIndex: PrintCreateOrDropIndex(session); break;
+    case PstSyntax_CreateOrRenameOrDropDatabase: PrintCreateOrRenameOrDropDatabase(session); break;
+    case PstSyntax_CreateOrDropTable: PrintCreateOrDropTable(session); break;
+    case PstSyntax_CreateOrRenameOrDropUser: PrintCreateOrRenameOrDropUser(session); break;
+    case PstSyntax_CreateOrDropView: PrintCreateOrDropView(session); break;
+    case PstSyntax_Delete: PrintDelete(session); break;
+    case PstSyntax_Do: PrintDo(session); break;
+    case PstSyntax_Flush: PrintFlush(session); break;
+    case PstSyntax_Grant: PrintGrant(session); break;
+    case PstSyntax_Insert: PrintInsert(session); break;
+    case PstSyntax_InsertSelect: PrintInsertSelect(session); break;
+    case PstSyntax_InstallPlugin: PrintInstallPlugin(session); break;
+    case PstSyntax_Kill: PrintKill(session); break;
+    case PstSyntax_LoadIndexIntoCache: PrintLoadIndexIntoCache(session); break;
+    case PstSyntax_OptimizeTable: PrintOptimizeTable(session); break;
+    case PstSyntax_RenameTable: PrintRenameTable(session); break;
+    case PstSyntax_RepairTable: PrintRepairTable(session); break;
+    case PstSyntax_Replace: PrintReplace(session); break;
+    case PstSyntax_Reset: PrintReset(session); break;
+    case PstSyntax_Revoke: PrintRevoke(session); break;
+    case PstSyntax_Select: PrintSelect(session); break;
+    case PstSyntax_Set: PrintSet(session); break;
+    case PstSyntax_Show: PrintShow(session); break;
+    case PstSyntax_ShowCreate: PrintShowCreate(session); break;
+    case PstSyntax_StartOrStopReplica: PrintStartOrStopReplica(session); break;
+    case PstSyntax_Truncate: PrintTruncate(session); break;
+    case PstSyntax_UninstallPlugin: PrintUninstallPlugin(session); break;
+    case PstSyntax_Update: PrintUpdate(session); break;
+
+    default: session->ret = RET_ERR; break;
     }
 
-    return ret;
+    return session->ret;
 }
 
-void pst_output_FreeResult() {
-    if (result != NULL) {
-        for (uint64_t col = 0; col < result_set->column_count; col++) {
-            if (result[col].valuestring != NULL) {
-                free(result[col].valuestring);
-                result[col].valuestring = NULL;
-            }
-            if (result[col].value != NULL) {
-                free(result[col].value);
-                result[col].value = NULL;
-            }
-        }
-        free(result);
-        result = NULL;
-    }
-
-    if (result_set != NULL) {
-        if (result_set->result != NULL) {
-            for (uint64_t row = 0; row < result_set->row_count; row++) {
-                if (result_set->result[row] != NULL) {
-                    for (uint64_t col = 0; col < result_set->column_count; col++) {
-                        if (result_set->result[row][col].valuestring != NULL) {
-                            free(result_set->result[row][col].valuestring);
-                            result_set->result[row][col].valuestring = NULL;
-                        }
-                        if (result_set->result[row][col].value != NULL) {
-                            free(result_set->result[row][col].value);
-                            result_set->result[row][col].value = NULL;
-                        }
-                    }
-                    free(result_set->result[row]);
-                    result_set->result[row] = NULL;
-                }
-            }
-            free(result_set->result);
-            result_set->result = NULL;
+void pst_output_FreeResult(PstSession* session) {
+    /* the string bytes of the column layout grow outside the arena */
+    if (session->column_set != NULL && session->column_set->columns != NULL) {
+        for (uint64_t col = 0; col < session->column_set->column_count; col++) {
+            free(session->column_set->columns[col].bytes);
         }
-        free(result_set);
-        result_set = NULL;
     }
 
-    if (bind != NULL) {
-        free(bind);
-        bind = NULL;
+    /* result set, bindings and buffers all live in the arena */
+    session->result = NULL;
+    session->result_set = NULL;
+    session->column_set = NULL;
+    session->result_bind = NULL;
+    pst_arena_Reset(&session->arena);
+
+    if (session->result_metadata != NULL) {
+        mysql_free_result(session->result_metadata);
+        session->result_metadata = NULL;
+    }
+    if (session->stmt != NULL) {
+        mysql_stmt_free_result(session->stmt);
+    }
+}
+
+int pst_output_SetFetchMode(MYSQL_STMT* stmt, const PstPreparedStatement* prep_stmt) {
+    unsigned long cursor_type = CURSOR_TYPE_NO_CURSOR;
+    unsigned long prefetch_rows = 1;
+    if (prep_stmt->fetch_mode == PstFetchMode_Cursor) {
+        /* the server keeps the result, every mysql_stmt_fetch that runs out */
+        /* of rows asks for the next prefetch_rows with COM_STMT_FETCH */
+        cursor_type = CURSOR_TYPE_READ_ONLY;
+        prefetch_rows = prep_stmt->prefetch_rows;
     }
 
-    mysql_free_result(result_metadata);
-    mysql_stmt_free_result(g_stmt);
+    if (mysql_stmt_attr_set(stmt, STMT_ATTR_CURSOR_TYPE, &cursor_type) ||
+        mysql_stmt_attr_set(stmt, STMT_ATTR_PREFETCH_ROWS, &prefetch_rows)) {
+        log_error(PST_FORMAT_MSG_ERR_MYSQL, mysql_stmt_errno(stmt), mysql_stmt_sqlstate(stmt), mysql_stmt_error(stmt));
+        return RET_ERR;
+    }
+
+    return RET_OK;
+}
+
+/* execution and fetch time, as the mysql client reports it */
+static double GetElapsedSec(const PstSession* session) {
+    uint64_t end = session->fetch_end_ns != 0 ? session->fetch_end_ns : pst_GetMonotonicNs();
+    return (end - session->exec_start_ns) / 1e9;
 }
 
-static void GetRowsAffected() {
-    rows = mysql_stmt_affected_rows(g_stmt);
+static void GetRowsAffected(PstSession* session) {
+    session->rows = mysql_stmt_affected_rows(session->stmt);
 }
 
-static int InitResultSet() {
-    result_set = (PstResultSet*)malloc(sizeof(PstResultSet));
-    if (result_set == NULL) {
+static int InitResultSet(PstSession* session) {
+    session->result_set = (PstResultSet*)pst_arena_Calloc(&session->arena, sizeof(PstResultSet));
+    if (session->result_set == NULL) {
         log_error(PST_FORMAT_MSG_ERR_ALLOC, "result_set");
         return RET_ERR;
     }
-    memset(result_set, 0, sizeof(PstResultSet));
 
-    bind = NULL;
-    result = NULL;
+    session->result_bind = NULL;
+    session->result = NULL;
 
     return RET_OK;
 }
 
-static int FetchResultSet() {
+static int FetchResultSet(PstSession* session) {
     /* Get metadata */
-    result_metadata = mysql_stmt_result_metadata(g_stmt);
-    if (result_metadata == NULL) {
-        log_error(PST_FORMAT_MSG_ERR_MYSQL, mysql_stmt_errno(g_stmt), mysql_stmt_sqlstate(g_stmt), mysql_stmt_error(g_stmt));
+    session->result_metadata = mysql_stmt_result_metadata(session->stmt);
+    if (session->result_metadata == NULL) {
+        log_error(PST_FORMAT_MSG_ERR_MYSQL, mysql_stmt_errno(session->stmt), mysql_stmt_sqlstate(session->stmt), mysql_stmt_error(session->stmt));
         return RET_ERR;
     }
 
     /* Get fields and max length */
-    unsigned int field_count = mysql_num_fields(result_metadata);
-    MYSQL_FIELD* fields = mysql_fetch_fields(result_metadata);
+    unsigned int field_count = mysql_num_fields(session->result_metadata);
+    MYSQL_FIELD* fields = mysql_fetch_fields(session->result_metadata);
 
     int update_max_length = 1;
-    if (mysql_stmt_attr_set(g_stmt, STMT_ATTR_UPDATE_MAX_LENGTH, &update_max_length)) {
-        log_error(PST_FORMAT_MSG_ERR_MYSQL, mysql_stmt_errno(g_stmt), mysql_stmt_sqlstate(g_stmt), mysql_stmt_error(g_stmt));
+    if (mysql_stmt_attr_set(session->stmt, STMT_ATTR_UPDATE_MAX_LENGTH, &update_max_length)) {
+        log_error(PST_FORMAT_MSG_ERR_MYSQL, mysql_stmt_errno(session->stmt), mysql_stmt_sqlstate(session->stmt), mysql_stmt_error(session->stmt));
         return RET_ERR;
     }
 
     /* Store result */
-    if (mysql_stmt_store_result(g_stmt)) {
-        log_error(PST_FORMAT_MSG_ERR_MYSQL, mysql_stmt_errno(g_stmt), mysql_stmt_sqlstate(g_stmt), mysql_stmt_error(g_stmt));
+    uint64_t store_start = pst_GetMonotonicNs();
+    if (mysql_stmt_store_result(session->stmt)) {
+        log_error(PST_FORMAT_MSG_ERR_MYSQL, mysql_stmt_errno(session->stmt), mysql_stmt_sqlstate(session->stmt), mysql_stmt_error(session->stmt));
         return RET_ERR;
     }
+    uint64_t store_end = pst_GetMonotonicNs();
+    pst_timing_Record(PstPhase_Store, store_end - store_start);
 
     /* Get columns and rows */
-    result_set->column_count = field_count;
-    rows = mysql_stmt_num_rows(g_stmt);
-    if (rows == 0) {
+    session->result_set->column_count = field_count;
+    session->rows = mysql_stmt_num_rows(session->stmt);
+    if (session->rows == 0) {
+        pst_timing_Record(PstPhase_LastRow, store_end - session->exec_start_ns);
         return RET_OK;
     }
-    result_set->row_count = rows + 1;
+    session->result_set->row_count = session->rows + 1;
 
-    result_set->result = (PstResult**)malloc(sizeof(PstResult*) * result_set->row_count);
-    if (result_set->result == NULL) {
+    /* one block of cells, rows point into it */
+    session->result_set->result = (PstResult**)pst_arena_Alloc(&session->arena, sizeof(PstResult*) * session->result_set->row_count);
+    PstResult* cells = (PstResult*)pst_arena_Calloc(&session->arena, sizeof(PstResult) * session->result_set->row_count * session->result_set->column_count);
+    if (session->result_set->result == NULL || cells == NULL) {
         log_error(PST_FORMAT_MSG_ERR_ALLOC, "result");
         return RET_ERR;
     }
-    memset(result_set->result, 0, sizeof(PstResult*) * result_set->row_count);
-
-    for (uint64_t row = 0; row < result_set->row_count; row++) {
-        result_set->result[row] = (PstResult*)malloc(sizeof(PstResult) * result_set->column_count);
-        if (result_set->result[row] == NULL) {
-            log_error(PST_FORMAT_MSG_ERR_ALLOC, "result");
-            return RET_ERR;
-        }
-        memset(result_set->result[row], 0, sizeof(PstResult) * result_set->column_count);
+    for (uint64_t row = 0; row < session->result_set->row_count; row++) {
+        session->result_set->result[row] = &cells[row * session->result_set->column_count];
     }
 
     /* Bind results */
-    bind = (MYSQL_BIND*)malloc(sizeof(MYSQL_BIND) * result_set->column_count);
-    if (bind == NULL) {
+    session->result_bind = (MYSQL_BIND*)pst_arena_Calloc(&session->arena, sizeof(MYSQL_BIND) * session->result_set->column_count);
+    if (session->result_bind == NULL) {
         log_error(PST_FORMAT_MSG_ERR_ALLOC, "bind");
         return RET_ERR;
     }
-    memset(bind, 0, sizeof(MYSQL_BIND) * result_set->column_count);
 
-    result = (PstResult*)malloc(sizeof(PstResult) * result_set->column_count);
-    if (result == NULL) {
+    session->result = (PstResult*)pst_arena_Calloc(&session->arena, sizeof(PstResult) * session->result_set->column_count);
+    if (session->result == NULL) {
         log_error(PST_FORMAT_MSG_ERR_ALLOC, "result");
         return RET_ERR;
     }
-    memset(result, 0, sizeof(PstResult) * result_set->column_count);
 
-    for (uint64_t col = 0; col < result_set->column_count; col++) {
-        result[col].type = fields[col].type;
-        result[col].max_length = fields[col].max_length + 1;
-        result[col].value = malloc(result[col].max_length + 63);
-        if (result[col].value == NULL) {
+    for (uint64_t col = 0; col < session->result_set->column_count; col++) {
+        session->result[col].type = fields[col].type;
+        session->result[col].max_length = fields[col].max_length + 1;
+        session->result[col].value = pst_arena_Calloc(&session->arena, session->result[col].max_length + 63);
+        if (session->result[col].value == NULL) {
             log_error(PST_FORMAT_MSG_ERR_ALLOC, "result->value");
             return RET_ERR;
         }
-        memset(result[col].value, 0, result[col].max_length + 63);
-        memset(&bind[col], 0, sizeof(MYSQL_BIND));
-        bind[col].buffer_type = result[col].type;
-        bind[col].buffer = result[col].value;
-        bind[col].buffer_length = result[col].max_length;
-        bind[col].length = &result[col].length;
-        bind[col].is_null = &result[col].is_null;
-        bind[col].error = &result[col].error;
+        memset(&session->result_bind[col], 0, sizeof(MYSQL_BIND));
+        session->result_bind[col].buffer_type = session->result[col].type;
+        session->result_bind[col].buffer = session->result[col].value;
+        session->result_bind[col].buffer_length = session->result[col].max_length;
+        session->result_bind[col].length = &session->result[col].length;
+        session->result_bind[col].is_null = &session->result[col].is_null;
+        session->result_bind[col].error = &session->result[col].error;
     }
 
-    if (mysql_stmt_bind_result(g_stmt, bind)) {
-        log_error(PST_FORMAT_MSG_ERR_MYSQL, mysql_stmt_errno(g_stmt), mysql_stmt_sqlstate(g_stmt), mysql_stmt_error(g_stmt));
+    if (mysql_stmt_bind_result(session->stmt, session->result_bind)) {
+        log_error(PST_FORMAT_MSG_ERR_MYSQL, mysql_stmt_errno(session->stmt), mysql_stmt_sqlstate(session->stmt), mysql_stmt_error(session->stmt));
         return RET_ERR;
     }
 
 
     /* Store fields */
-    /* Metadata */
-    for (uint64_t col = 0; col < result_set->column_count; col++) {
-        result_set->result[0][col].type = fields[col].type;
-        result_set->result[0][col].length = 56;
-        result_set->result[0][col].max_length = fields[col].max_length + 1;
-        result_set->result[0][col].field_length = fields[col].name_length;
-        result_set->result[0][col].valuestring = malloc(result_set->result[0][col].field_length + 63);
-        if (result_set->result[0][col].valuestring == NULL) {
-            log_error(PST_FORMAT_MSG_ERR_ALLOC, "result->value");
-            return RET_ERR;
-        }
-        memset(result_set->result[0][col].valuestring, 0, result_set->result[0][col].field_length + 63);
-        strcpy(result_set->result[0][col].valuestring, fields[col].name);
-        result_set->result[0][col].value = malloc(result_set->result[0][col].field_length + 63);
-        if (result_set->result[0][col].value == NULL) {
-            log_error(PST_FORMAT_MSG_ERR_ALLOC, "result->value");
-            return RET_ERR;
-        }
-        memset(result_set->result[0][col].value, 0, result_set->result[0][col].field_length + 63);
-        memcpy(result_set->result[0][col].value, result_set->result[0][col].valuestring, result_set->result[0][col].field_length + 63);
-        result_set->result[0][col].is_null = 0;
-        result_set->result[0][col].error = 0;
+    if (StoreHeader(session, fields) != RET_OK) {
+        return RET_ERR;
+    }
+
+    if (session->prep_stmt->zero_copy) {
+        return FetchRowsInPlace(session);
     }
 
     /* Data */
     int row = 0;
+    uint64_t fetch_ns = 0;
+    uint64_t format_ns = 0;
     while (1) {
-        int ret = mysql_stmt_fetch(g_stmt);
-        if (ret == 1 || ret == MYSQL_NO_DATA) {
+        uint64_t fetch_start = pst_GetMonotonicNs();
+        int status = mysql_stmt_fetch(session->stmt);
+        uint64_t fetch_end = pst_GetMonotonicNs();
+        fetch_ns += fetch_end - fetch_start;
+        if (status == 1 || status == MYSQL_NO_DATA) {
+            pst_timing_Record(PstPhase_LastRow, fetch_end - session->exec_start_ns);
             break;
         }
+        if (row == 0) {
+            pst_timing_Record(PstPhase_FirstRow, fetch_end - session->exec_start_ns);
+        }
 
-        if (row > result_set->row_count) {
+        if (row + 1 >= session->result_set->row_count) {
             log_error("The number of rows obtained using mysql_stmt_fetch does not match the number of rows obtained using mysql_stmt_num_rows.");
             return RET_ERR;
         }
 
-        for (uint64_t col = 0; col < result_set->column_count; col++) {
+        for (uint64_t col = 0; col < session->result_set->column_count; col++) {
+            PstResult* cell = &session->result_set->result[row + 1][col];
 
-            result[col].valuestring = malloc(result_set->result[0][col].max_length + 63);
-            if (result[col].valuestring == NULL) {
-                log_error(PST_FORMAT_MSG_ERR_ALLOC, "result->valuestring");
+            /* the text is formatted straight into the cell */
+            cell->valuestring = (char*)pst_arena_Alloc(&session->arena, session->result_set->result[0][col].max_length + 63);
+            cell->value = pst_arena_Alloc(&session->arena, session->result[col].max_length + 63);
+            if (cell->valuestring == NULL || cell->value == NULL) {
+                log_error(PST_FORMAT_MSG_ERR_ALLOC, "result_set->result->value");
                 return RET_ERR;
             }
-            memset(result[col].valuestring, 0, result_set->result[0][col].max_length + 63);
-
-            switch (result[col].type) {
-            case MYSQL_TYPE_TINY:
-                sprintf(result[col].valuestring, "%c", *(unsigned char*)result[col].value);
-                break;
-            case MYSQL_TYPE_SHORT:
-                sprintf(result[col].valuestring, "%hd", *(short*)result[col].value);
-                break;
-            case MYSQL_TYPE_INT24:
-            case MYSQL_TYPE_LONG:
-                sprintf(result[col].valuestring, "%d", *(int*)result[col].value);
-                break;
-            case MYSQL_TYPE_LONGLONG:
-                sprintf(result[col].valuestring, "%lld", *(long long*)result[col].value);
-                break;
-            case MYSQL_TYPE_FLOAT:
-                sprintf(result[col].valuestring, "%.2f", *(float*)result[col].value);
-                break;
-            case MYSQL_TYPE_DOUBLE:
-                sprintf(result[col].valuestring, "%.2lf", *(double*)result[col].value);
-                break;
-            case MYSQL_TYPE_NEWDECIMAL:
-                sprintf(result[col].valuestring, "%-*s", (int)result[col].max_length, (char*)result[col].value);
-                break;
-            case MYSQL_TYPE_YEAR:
-                sprintf(result[col].valuestring, "%hd", *(short*)result[col].value);
-                break;
-            case MYSQL_TYPE_TIME:
-                sprintf(result[col].valuestring, "%02d:%02d:%02d",
-                    ((MYSQL_TIME*)result[col].value)->hour,
-                    ((MYSQL_TIME*)result[col].value)->minute,
-                    ((MYSQL_TIME*)result[col].value)->second);
-                break;
-            case MYSQL_TYPE_DATE:
-                sprintf(result[col].valuestring, "%04d-%02d-%02d",
-                    ((MYSQL_TIME*)result[col].value)->year,
-                    ((MYSQL_TIME*)result[col].value)->month,
-                    ((MYSQL_TIME*)result[col].value)->day);
-                break;
-            case MYSQL_TYPE_DATETIME:
-            case MYSQL_TYPE_TIMESTAMP:
-                sprintf(result[col].valuestring, "%04d-%02d-%02d %02d:%02d:%02d",
-                    ((MYSQL_TIME*)result[col].value)->year,
-                    ((MYSQL_TIME*)result[col].value)->month,
-                    ((MYSQL_TIME*)result[col].value)->day,
-                    ((MYSQL_TIME*)result[col].value)->hour,
-                    ((MYSQL_TIME*)result[col].value)->minute,
-                    ((MYSQL_TIME*)result[col].value)->second);
-                break;
-            case MYSQL_TYPE_STRING:
-            case MYSQL_TYPE_VAR_STRING:
-            case MYSQL_TYPE_TINY_BLOB:
-            case MYSQL_TYPE_BLOB:
-            case MYSQL_TYPE_MEDIUM_BLOB:
-            case MYSQL_TYPE_LONG_BLOB:
-            case MYSQL_TYPE_BIT:
-                sprintf(result[col].valuestring, "%-*s", (int)result[col].max_length, (char*)result[col].value);
-                break;
-            default:
-                sprintf(result[col].valuestring, "(Unknown type: %d)", result[col].type);
-                break;
+            session->result[col].valuestring = cell->valuestring;
+
+            unsigned long text_length = FormatResult(&session->result[col]);
+            if (text_length > session->result_set->result[0][col].field_length) {
+                session->result_set->result[0][col].field_length = text_length;
             }
 
-            /* Trim space in the end of valuestring */
-            for (int i = strlen(result[col].valuestring) - 1; i >= 0; i--) {
-                if (result[col].valuestring[i] == ' ') {
-                    result[col].valuestring[i] = '\0';
-                } else {
-                    break;
+            /* Result set */
+            cell->type = session->result[col].type;
+            memcpy(cell->value, session->result[col].value, session->result[col].max_length + 63);
+            cell->max_length = session->result[col].max_length;
+            cell->length = session->result[col].length;
+            cell->is_null = session->result[col].is_null;
+            cell->error = session->result[col].error;
+        }
+
+        format_ns += pst_GetMonotonicNs() - fetch_end;
+        row++;
+    }
+    pst_timing_Record(PstPhase_Fetch, fetch_ns);
+    pst_timing_Record(PstPhase_Format, format_ns);
+
+    return RET_OK;
+
+}
+
+/* Fetch every row straight into its cells. The bound buffers are re-pointed */
+/* at the row's slots in one row-strided block before each mysql_stmt_fetch, */
+/* so values land in their final place and nothing is copied afterwards. */
+static int FetchRowsInPlace(PstSession* session) {
+    PstResultSet* result_set = session->result_set;
+    uint64_t column_count = result_set->column_count;
+    uint64_t row_count = session->rows;
+
+    /* slot sizes, rounded up to keep every slot aligned */
+    size_t value_stride = 0;
+    size_t text_stride = 0;
+    for (uint64_t col = 0; col < column_count; col++) {
+        unsigned long value_size = GetValueSize(session->result[col].type);
+        if (value_size < session->result[col].max_length) {
+            value_size = session->result[col].max_length;
+        }
+        value_stride += (value_size + 15) & ~(size_t)15;
+        text_stride += (result_set->result[0][col].max_length + 63 + 15) & ~(size_t)15;
+    }
+
+    unsigned char* values = (unsigned char*)pst_arena_Alloc(&session->arena, value_stride * row_count);
+    char* texts = (char*)pst_arena_Alloc(&session->arena, text_stride * row_count);
+    if (values == NULL || texts == NULL) {
+        log_error(PST_FORMAT_MSG_ERR_ALLOC, "result_set->result->value");
+        return RET_ERR;
+    }
+
+    uint64_t row = 0;
+    uint64_t fetch_ns = 0;
+    uint64_t format_ns = 0;
+    while (1) {
+        uint64_t fetch_start = pst_GetMonotonicNs();
+        if (row < row_count) {
+            unsigned char* value = values + row * value_stride;
+            char* text = texts + row * text_stride;
+            for (uint64_t col = 0; col < column_count; col++) {
+                PstResult* cell = &result_set->result[row + 1][col];
+                unsigned long value_size = GetValueSize(session->result[col].type);
+                if (value_size < session->result[col].max_length) {
+                    value_size = session->result[col].max_length;
                 }
-            }
 
-            if (strlen(result[col].valuestring) > result_set->result[0][col].field_length) {
-                result_set->result[0][col].field_length = strlen(result[col].valuestring);
+                cell->type = session->result[col].type;
+                cell->max_length = session->result[col].max_length;
+                cell->value = value;
+                cell->valuestring = text;
+                session->result_bind[col].buffer = cell->value;
+                session->result_bind[col].length = &cell->length;
+                session->result_bind[col].is_null = &cell->is_null;
+                session->result_bind[col].error = &cell->error;
+
+                value += (value_size + 15) & ~(size_t)15;
+                text += (result_set->result[0][col].max_length + 63 + 15) & ~(size_t)15;
             }
-
-            /* Result set */
-            result_set->result[row + 1][col].type = result->type;
-            result_set->result[row + 1][col].value = malloc(result[col].max_length + 63);
-            if (result_set->result[row + 1][col].value == NULL) {
-                log_error(PST_FORMAT_MSG_ERR_ALLOC, "result_set->result->value");
+            if (mysql_stmt_bind_result(session->stmt, session->result_bind)) {
+                log_error(PST_FORMAT_MSG_ERR_MYSQL, mysql_stmt_errno(session->stmt), mysql_stmt_sqlstate(session->stmt), mysql_stmt_error(session->stmt));
                 return RET_ERR;
             }
-            memset(result_set->result[row + 1][col].value, 0, result[col].max_length + 63);
-            memcpy(result_set->result[row + 1][col].value, result[col].value, result[col].max_length + 63);
-            result_set->result[row + 1][col].max_length = result[col].max_length;
-            result_set->result[row + 1][col].length = result[col].length;
-            result_set->result[row + 1][col].is_null = result[col].is_null;
-            result_set->result[row + 1][col].error = result[col].error;
-            result_set->result[row + 1][col].valuestring = malloc(result_set->result[0][col].max_length + 63);
-            if (result_set->result[row + 1][col].valuestring == NULL) {
-                log_error(PST_FORMAT_MSG_ERR_ALLOC, "result_set->result->valuestring");
-                return RET_ERR;
+        }
+
+        int status = mysql_stmt_fetch(session->stmt);
+        uint64_t fetch_end = pst_GetMonotonicNs();
+        fetch_ns += fetch_end - fetch_start;
+        if (status == 1 || status == MYSQL_NO_DATA) {
+            pst_timing_Record(PstPhase_LastRow, fetch_end - session->exec_start_ns);
+            break;
+        }
+        if (row == 0) {
+            pst_timing_Record(PstPhase_FirstRow, fetch_end - session->exec_start_ns);
+        }
+        if (row >= row_count) {
+            log_error("The number of rows obtained using mysql_stmt_fetch does not match the number of rows obtained using mysql_stmt_num_rows.");
+            return RET_ERR;
+        }
+
+        for (uint64_t col = 0; col < column_count; col++) {
+            PstResult* cell = &result_set->result[row + 1][col];
+            unsigned long text_length = FormatResult(cell);
+            if (text_length > result_set->result[0][col].field_length) {
+                result_set->result[0][col].field_length = text_length;
             }
-            memset(result_set->result[row + 1][col].valuestring, 0, result_set->result[0][col].max_length + 63);
-            strcpy(result_set->result[row + 1][col].valuestring, result[col].valuestring);
+        }
+
+        format_ns += pst_GetMonotonicNs() - fetch_end;
+        row++;
+    }
+    pst_timing_Record(PstPhase_Fetch, fetch_ns);
+    pst_timing_Record(PstPhase_Format, format_ns);
+
+    return RET_OK;
+}
+
+/* Row 0 of the result set holds the column names and widths */
+static int StoreHeader(PstSession* session, const MYSQL_FIELD* fields) {
+    for (uint64_t col = 0; col < session->result_set->column_count; col++) {
+        PstResult* header = &session->result_set->result[0][col];
+        header->type = fields[col].type;
+        header->length = 56;
+        header->max_length = fields[col].max_length + 1;
+        header->field_length = fields[col].name_length;
+        header->valuestring = (char*)pst_arena_Calloc(&session->arena, header->field_length + 63);
+        if (header->valuestring == NULL) {
+            log_error(PST_FORMAT_MSG_ERR_ALLOC, "result->value");
+            return RET_ERR;
+        }
+        memcpy(header->valuestring, fields[col].name, fields[col].name_length);
+        header->value = header->valuestring;
+        header->is_null = 0;
+        header->error = 0;
+    }
+
+    return RET_OK;
+}
+
+/* Text of the bound value into result->valuestring, returns its length */
+static size_t FormatResult(PstResult* result) {
+    char* text = result->valuestring;
+    size_t length = 0;
+
+    if (result->is_null) {
+        memcpy(text, "NULL", sizeof("NULL"));
+        return sizeof("NULL") - 1;
+    }
+
+    switch (result->type) {
+    case MYSQL_TYPE_TINY:
+        /* printed as a character, as it always was */
+        text[0] = *(char*)result->value;
+        text[1] = '\0';
+        length = text[0] != '\0';
+        break;
+    case MYSQL_TYPE_SHORT:
+    case MYSQL_TYPE_YEAR:
+        return pst_format_Int64(text, *(short*)result->value);
+    case MYSQL_TYPE_INT24:
+    case MYSQL_TYPE_LONG:
+        return pst_format_Int64(text, *(int*)result->value);
+    case MYSQL_TYPE_LONGLONG:
+        return pst_format_Int64(text, *(long long*)result->value);
+    case MYSQL_TYPE_FLOAT:
+        return pst_format_Fixed2(text, *(float*)result->value);
+    case MYSQL_TYPE_DOUBLE:
+        return pst_format_Fixed2(text, *(double*)result->value);
+    case MYSQL_TYPE_TIME:
+        return pst_format_Time(text, (MYSQL_TIME*)result->value);
+    case MYSQL_TYPE_DATE:
+        return pst_format_Date(text, (MYSQL_TIME*)result->value);
+    case MYSQL_TYPE_DATETIME:
+    case MYSQL_TYPE_TIMESTAMP:
+        return pst_format_DateTime(text, (MYSQL_TIME*)result->value);
+    case MYSQL_TYPE_NEWDECIMAL:
+    case MYSQL_TYPE_STRING:
+    case MYSQL_TYPE_VAR_STRING:
+    case MYSQL_TYPE_TINY_BLOB:
+    case MYSQL_TYPE_BLOB:
+    case MYSQL_TYPE_MEDIUM_BLOB:
+    case MYSQL_TYPE_LONG_BLOB:
+    case MYSQL_TYPE_BIT:
+        length = strlen((char*)result->value);
+        memcpy(text, result->value, length);
+        break;
+    default:
+        return (size_t)sprintf(text, "(Unknown type: %d)", result->type);
+    }
+
+    /* Trim space in the end of valuestring */
+    while (length > 0 && text[length - 1] == ' ') {
+        length--;
+    }
+    text[length] = '\0';
+
+    return length;
+}
+
+/* Size of a value bound as its own type, 0 if it is bound as a string */
+static unsigned long GetValueSize(PstFieldTypes type) {
+    switch (type) {
+    case MYSQL_TYPE_TINY:
+        return sizeof(signed char);
+    case MYSQL_TYPE_SHORT:
+    case MYSQL_TYPE_YEAR:
+        return sizeof(short);
+    case MYSQL_TYPE_INT24:
+    case MYSQL_TYPE_LONG:
+        return sizeof(int);
+    case MYSQL_TYPE_LONGLONG:
+        return sizeof(long long);
+    case MYSQL_TYPE_FLOAT:
+        return sizeof(float);
+    case MYSQL_TYPE_DOUBLE:
+        return sizeof(double);
+    case MYSQL_TYPE_TIME:
+    case MYSQL_TYPE_DATE:
+    case MYSQL_TYPE_DATETIME:
+    case MYSQL_TYPE_TIMESTAMP:
+        return sizeof(MYSQL_TIME);
+    default:
+        return 0;
+    }
+}
+
+/* Buffer size for a column fetched without mysql_stmt_store_result, */
+/* max_length is not known so it is derived from the type and field length */
+static unsigned long GetStreamBufferLength(const MYSQL_FIELD* field) {
+    unsigned long value_size = GetValueSize(field->type);
+    if (value_size > 0) {
+        return value_size;
+    }
+
+    return (field->length < PST_STREAM_BUFFER_LENGTH ? field->length : PST_STREAM_BUFFER_LENGTH) + 1;
+}
+
+/* Grow the buffers of truncated columns and fetch them again */
+static int FetchTruncatedColumns(PstSession* session) {
+    for (uint64_t col = 0; col < session->result_set->column_count; col++) {
+        PstResult* result = &session->result[col];
+        if (result->is_null || !result->error) {
+            continue;
+        }
+
+        /* the old buffers stay in the arena until the result is freed */
+        unsigned long buffer_length = result->length + 1;
+        result->value = pst_arena_Calloc(&session->arena, buffer_length + 63);
+        result->valuestring = (char*)pst_arena_Alloc(&session->arena, buffer_length + 63);
+        if (result->value == NULL || result->valuestring == NULL) {
+            log_error(PST_FORMAT_MSG_ERR_ALLOC, "result->value");
+            return RET_ERR;
+        }
+
+        session->result_bind[col].buffer = result->value;
+        session->result_bind[col].buffer_length = buffer_length;
+        if (mysql_stmt_fetch_column(session->stmt, &session->result_bind[col], (unsigned int)col, 0)) {
+            log_error(PST_FORMAT_MSG_ERR_MYSQL, mysql_stmt_errno(session->stmt), mysql_stmt_sqlstate(session->stmt), mysql_stmt_error(session->stmt));
+            return RET_ERR;
+        }
+    }
+
+    /* the statement keeps its own copy of the binding */
+    if (mysql_stmt_bind_result(session->stmt, session->result_bind)) {
+        log_error(PST_FORMAT_MSG_ERR_MYSQL, mysql_stmt_errno(session->stmt), mysql_stmt_sqlstate(session->stmt), mysql_stmt_error(session->stmt));
+        return RET_ERR;
+    }
+
+    return RET_OK;
+}
+
+/* Fetch row by row off the wire, or from the cursor in cursor mode, into */
+/* fixed buffers and hand every row to the sink, memory use does not depend */
+/* on the number of rows */
+/* One row of bound buffers sized for the column types, fetched rows */
+/* overwrite it and longer values are completed by FetchTruncatedColumns */
+static int BindRowBuffers(PstSession* session, const MYSQL_FIELD* fields, unsigned int field_count) {
+    session->result_bind = (MYSQL_BIND*)pst_arena_Calloc(&session->arena, sizeof(MYSQL_BIND) * field_count);
+    if (session->result_bind == NULL) {
+        log_error(PST_FORMAT_MSG_ERR_ALLOC, "bind");
+        return RET_ERR;
+    }
+
+    session->result = (PstResult*)pst_arena_Calloc(&session->arena, sizeof(PstResult) * field_count);
+    if (session->result == NULL) {
+        log_error(PST_FORMAT_MSG_ERR_ALLOC, "result");
+        return RET_ERR;
+    }
+
+    for (unsigned int col = 0; col < field_count; col++) {
+        unsigned long buffer_length = GetStreamBufferLength(&fields[col]);
+        session->result[col].type = fields[col].type;
+        session->result[col].value = pst_arena_Calloc(&session->arena, buffer_length + 63);
+        session->result[col].valuestring = (char*)pst_arena_Calloc(&session->arena, buffer_length + 63);
+        if (session->result[col].value == NULL || session->result[col].valuestring == NULL) {
+            log_error(PST_FORMAT_MSG_ERR_ALLOC, "result->value");
+            return RET_ERR;
+        }
+        session->result_bind[col].buffer_type = session->result[col].type;
+        session->result_bind[col].buffer = session->result[col].value;
+        session->result_bind[col].buffer_length = buffer_length;
+        session->result_bind[col].length = &session->result[col].length;
+        session->result_bind[col].is_null = &session->result[col].is_null;
+        session->result_bind[col].error = &session->result[col].error;
+    }
+
+    if (mysql_stmt_bind_result(session->stmt, session->result_bind)) {
+        log_error(PST_FORMAT_MSG_ERR_MYSQL, mysql_stmt_errno(session->stmt), mysql_stmt_sqlstate(session->stmt), mysql_stmt_error(session->stmt));
+        return RET_ERR;
+    }
+
+    return RET_OK;
+}
+
+/* Rows go to a sink while they are fetched when the server streams them */
+static bool IsStreamed(const PstSession* session) {
+    return session->prep_stmt->fetch_mode != PstFetchMode_Buffered;
+}
+
+static int StreamResultSet(PstSession* session) {
+    session->result_metadata = mysql_stmt_result_metadata(session->stmt);
+    if (session->result_metadata == NULL) {
+        log_error(PST_FORMAT_MSG_ERR_MYSQL, mysql_stmt_errno(session->stmt), mysql_stmt_sqlstate(session->stmt), mysql_stmt_error(session->stmt));
+        return RET_ERR;
+    }
+
+    unsigned int field_count = mysql_num_fields(session->result_metadata);
+    MYSQL_FIELD* fields = mysql_fetch_fields(session->result_metadata);
+    const PstRowSink* sink = session->sink;
+    if (sink == NULL) {
+        sink = pst_print_GetFormat() == PstOutputFormat_Table ? &g_table_sink : &g_format_sink;
+    }
+
+    /* only the header row is kept */
+    session->result_set->column_count = field_count;
+    session->result_set->row_count = 1;
+    session->result_set->result = (PstResult**)pst_arena_Alloc(&session->arena, sizeof(PstResult*));
+    if (session->result_set->result == NULL) {
+        log_error(PST_FORMAT_MSG_ERR_ALLOC, "result");
+        return RET_ERR;
+    }
+    session->result_set->result[0] = (PstResult*)pst_arena_Calloc(&session->arena, sizeof(PstResult) * field_count);
+    if (session->result_set->result[0] == NULL) {
+        log_error(PST_FORMAT_MSG_ERR_ALLOC, "result");
+        return RET_ERR;
+    }
+
+    if (BindRowBuffers(session, fields, field_count) != RET_OK) {
+        return RET_ERR;
+    }
+
+    if (StoreHeader(session, fields) != RET_OK || sink->Begin(session, fields, field_count) != RET_OK) {
+        return RET_ERR;
+    }
+
+    uint64_t fetch_ns = 0;
+    uint64_t format_ns = 0;
+    uint64_t print_ns = 0;
+    while (1) {
+        uint64_t fetch_start = pst_GetMonotonicNs();
+        int status = mysql_stmt_fetch(session->stmt);
+        if (status == MYSQL_DATA_TRUNCATED && FetchTruncatedColumns(session) != RET_OK) {
+            return RET_ERR;
+        }
+        uint64_t fetch_end = pst_GetMonotonicNs();
+        fetch_ns += fetch_end - fetch_start;
+        /* as if the rows had not been printed in between */
+        uint64_t row_end = session->stream_start_ns + fetch_ns;
+        if (status == MYSQL_NO_DATA) {
+            pst_timing_Record(PstPhase_LastRow, row_end - session->exec_start_ns);
+            session->fetch_end_ns = row_end;
+            break;
+        }
+        if (status == 1) {
+            log_error(PST_FORMAT_MSG_ERR_MYSQL, mysql_stmt_errno(session->stmt), mysql_stmt_sqlstate(session->stmt), mysql_stmt_error(session->stmt));
+            return RET_ERR;
+        }
+        if (session->rows == 0) {
+            pst_timing_Record(PstPhase_FirstRow, row_end - session->exec_start_ns);
+        }
+        session->rows++;
+
+        for (unsigned int col = 0; col < field_count; col++) {
+            FormatResult(&session->result[col]);
+        }
+        uint64_t format_end = pst_GetMonotonicNs();
+        format_ns += format_end - fetch_end;
+
+        if (sink->Row(session, session->result, field_count) != RET_OK) {
+            return RET_ERR;
+        }
+        print_ns += pst_GetMonotonicNs() - format_end;
+    }
+
+    int ret = sink->End(session, session->rows);
+    pst_timing_Record(PstPhase_Fetch, fetch_ns);
+    pst_timing_Record(PstPhase_Format, format_ns);
+    pst_timing_Record(PstPhase_Print, print_ns);
+
+    return ret;
+}
+
+static int BeginTable(PstSession* session, const MYSQL_FIELD* fields, unsigned int field_count) {
+    PstResult* header = session->result_set->result[0];
+    for (unsigned int col = 0; col < field_count; col++) {
+        unsigned long width = fields[col].length < PST_STREAM_COLUMN_WIDTH ? fields[col].length : PST_STREAM_COLUMN_WIDTH;
+        if (width > header[col].field_length) {
+            header[col].field_length = width;
+        }
+    }
+
+    return RET_OK;
+}
+
+static int PrintTableRow(PstSession* session, const PstResult* row, unsigned int field_count) {
+    const PstResult* header = session->result_set->result[0];
+
+    /* header is printed with the first row, an empty set prints no table */
+    if (session->rows == 1) {
+        pst_print_PrintResultSetBorder(header, field_count);
+        pst_print_PrintResultSetRow(header, header, field_count);
+        pst_print_PrintResultSetBorder(header, field_count);
+    }
+    pst_print_PrintResultSetRow(header, row, field_count);
+
+    return RET_OK;
+}
+
+static int EndTable(PstSession* session, uint64_t rows) {
+    if (rows > 0) {
+        pst_print_PrintResultSetBorder(session->result_set->result[0], session->result_set->column_count);
+    }
+
+    return RET_OK;
+}
+
+static int BeginFormat(PstSession* session, const MYSQL_FIELD* fields, unsigned int field_count) {
+    pst_print_BeginRows(fields, field_count);
+    return RET_OK;
+}
+
+static int PrintFormatRow(PstSession* session, const PstResult* row, unsigned int field_count) {
+    pst_print_PrintRow(row, field_count);
+    return RET_OK;
+}
+
+static int EndFormat(PstSession* session, uint64_t rows) {
+    pst_print_EndRows(rows);
+    return RET_OK;
+}
+
+/* Append value r of a variable length column, bytes grow by doubling in */
+/* place with realloc and are freed by pst_output_FreeResult. The value is */
+/* kept as fetched, FormatResult cuts it at a NUL and trims it for printing. */
+static int AppendColumnBytes(PstColumn* column, uint64_t row, const char* value, unsigned long length) {
+    uint64_t offset = column->offsets[row];
+    if (offset + length + 1 > column->bytes_size) {
+        uint64_t bytes_size = column->bytes_size * 2;
+        while (bytes_size < offset + length + 1) {
+            bytes_size *= 2;
+        }
+        char* bytes = (char*)realloc(column->bytes, bytes_size);
+        if (bytes == NULL) {
+            log_error(PST_FORMAT_MSG_ERR_ALLOC, "column->bytes");
+            return RET_ERR;
+        }
+        column->bytes = bytes;
+        column->bytes_size = bytes_size;
+    }
+
+    memcpy(column->bytes + offset, value, length);
+    column->bytes[offset + length] = '\0';
+    column->offsets[row + 1] = offset + length + 1;
+
+    return RET_OK;
+}
+
+/* Value r of the column as a PstResult that FormatResult understands */
+static void GetColumnValue(const PstColumn* column, uint64_t row, PstResult* result) {
+    result->type = column->type;
+    result->is_null = (column->nulls[row / 8] >> (row % 8)) & 1;
+    if (column->value_size > 0) {
+        result->value = column->values + row * column->value_size;
+        result->length = column->value_size;
+    } else {
+        result->value = column->bytes + column->offsets[row];
+        result->length = column->offsets[row + 1] - column->offsets[row] - 1;
+    }
+}
+
+/* Buffered fetch into one typed vector per column instead of one PstResult */
+/* per cell. Row 0 of the result set keeps the header for printing. */
+static int FetchColumnSet(PstSession* session) {
+    session->result_metadata = mysql_stmt_result_metadata(session->stmt);
+    if (session->result_metadata == NULL) {
+        log_error(PST_FORMAT_MSG_ERR_MYSQL, mysql_stmt_errno(session->stmt), mysql_stmt_sqlstate(session->stmt), mysql_stmt_error(session->stmt));
+        return RET_ERR;
+    }
+
+    unsigned int field_count = mysql_num_fields(session->result_metadata);
+    MYSQL_FIELD* fields = mysql_fetch_fields(session->result_metadata);
+
+    int update_max_length = 1;
+    if (mysql_stmt_attr_set(session->stmt, STMT_ATTR_UPDATE_MAX_LENGTH, &update_max_length)) {
+        log_error(PST_FORMAT_MSG_ERR_MYSQL, mysql_stmt_errno(session->stmt), mysql_stmt_sqlstate(session->stmt), mysql_stmt_error(session->stmt));
+        return RET_ERR;
+    }
+
+    uint64_t store_start = pst_GetMonotonicNs();
+    if (mysql_stmt_store_result(session->stmt)) {
+        log_error(PST_FORMAT_MSG_ERR_MYSQL, mysql_stmt_errno(session->stmt), mysql_stmt_sqlstate(session->stmt), mysql_stmt_error(session->stmt));
+        return RET_ERR;
+    }
+    uint64_t store_end = pst_GetMonotonicNs();
+    pst_timing_Record(PstPhase_Store, store_end - store_start);
+
+    session->rows = mysql_stmt_num_rows(session->stmt);
+    session->result_set->column_count = field_count;
+    if (session->rows == 0) {
+        pst_timing_Record(PstPhase_LastRow, store_end - session->exec_start_ns);
+        return RET_OK;
+    }
+    session->result_set->row_count = 1;
+
+    uint64_t row_count = session->rows;
+    session->column_set = (PstColumnSet*)pst_arena_Calloc(&session->arena, sizeof(PstColumnSet));
+    session->result_set->result = (PstResult**)pst_arena_Alloc(&session->arena, sizeof(PstResult*));
+    session->result_bind = (MYSQL_BIND*)pst_arena_Calloc(&session->arena, sizeof(MYSQL_BIND) * field_count);
+    session->result = (PstResult*)pst_arena_Calloc(&session->arena, sizeof(PstResult) * field_count);
+    if (session->column_set == NULL || session->result_set->result == NULL || session->result_bind == NULL || session->result == NULL) {
+        log_error(PST_FORMAT_MSG_ERR_ALLOC, "column_set");
+        return RET_ERR;
+    }
+    session->result_set->result[0] = (PstResult*)pst_arena_Calloc(&session->arena, sizeof(PstResult) * field_count);
+    session->column_set->columns = (PstColumn*)pst_arena_Calloc(&session->arena, sizeof(PstColumn) * field_count);
+    if (session->result_set->result[0] == NULL || session->column_set->columns == NULL) {
+        log_error(PST_FORMAT_MSG_ERR_ALLOC, "column_set");
+        return RET_ERR;
+    }
+    session->column_set->column_count = field_count;
+    session->column_set->row_count = row_count;
+
+    for (unsigned int col = 0; col < field_count; col++) {
+        PstColumn* column = &session->column_set->columns[col];
+        column->type = fields[col].type;
+        column->value_size = GetValueSize(column->type);
+        column->nulls = (uint8_t*)pst_arena_Calloc(&session->arena, (row_count + 7) / 8);
+        if (column->value_size > 0) {
+            column->values = (unsigned char*)pst_arena_Alloc(&session->arena, row_count * column->value_size);
+        } else {
+            column->offsets = (uint64_t*)pst_arena_Alloc(&session->arena, (row_count + 1) * sizeof(uint64_t));
+            column->bytes_size = 4096;
+            column->bytes = (char*)malloc(column->bytes_size);
+        }
+        if (column->nulls == NULL || (column->value_size > 0 ? column->values == NULL : column->offsets == NULL || column->bytes == NULL)) {
+            log_error(PST_FORMAT_MSG_ERR_ALLOC, "column");
+            return RET_ERR;
+        }
+        if (column->offsets != NULL) {
+            column->offsets[0] = 0;
+        }
+
+        /* scratch buffers the rows are fetched into and formatted from */
+        session->result[col].type = column->type;
+        session->result[col].max_length = fields[col].max_length + 1;
+        session->result[col].value = pst_arena_Calloc(&session->arena, session->result[col].max_length + 63);
+        session->result[col].valuestring = (char*)pst_arena_Calloc(&session->arena, session->result[col].max_length + 63);
+        if (session->result[col].value == NULL || session->result[col].valuestring == NULL) {
+            log_error(PST_FORMAT_MSG_ERR_ALLOC, "result->value");
+            return RET_ERR;
+        }
+        session->result_bind[col].buffer_type = session->result[col].type;
+        session->result_bind[col].buffer = session->result[col].value;
+        session->result_bind[col].buffer_length = session->result[col].max_length;
+        session->result_bind[col].length = &session->result[col].length;
+        session->result_bind[col].is_null = &session->result[col].is_null;
+        session->result_bind[col].error = &session->result[col].error;
+    }
+
+    if (mysql_stmt_bind_result(session->stmt, session->result_bind)) {
+        log_error(PST_FORMAT_MSG_ERR_MYSQL, mysql_stmt_errno(session->stmt), mysql_stmt_sqlstate(session->stmt), mysql_stmt_error(session->stmt));
+        return RET_ERR;
+    }
 
-            free(result[col].valuestring);
-            result[col].valuestring = NULL;
+    if (StoreHeader(session, fields) != RET_OK) {
+        return RET_ERR;
+    }
 
+    uint64_t row = 0;
+    uint64_t fetch_ns = 0;
+    while (1) {
+        uint64_t fetch_start = pst_GetMonotonicNs();
+        int status = mysql_stmt_fetch(session->stmt);
+        uint64_t fetch_end = pst_GetMonotonicNs();
+        fetch_ns += fetch_end - fetch_start;
+        if (status == 1 || status == MYSQL_NO_DATA) {
+            pst_timing_Record(PstPhase_LastRow, fetch_end - session->exec_start_ns);
+            break;
+        }
+        if (row == 0) {
+            pst_timing_Record(PstPhase_FirstRow, fetch_end - session->exec_start_ns);
+        }
+        if (row >= row_count) {
+            log_error("The number of rows obtained using mysql_stmt_fetch does not match the number of rows obtained using mysql_stmt_num_rows.");
+            return RET_ERR;
         }
 
+        for (unsigned int col = 0; col < field_count; col++) {
+            PstColumn* column = &session->column_set->columns[col];
+            const PstResult* result = &session->result[col];
+            if (result->is_null) {
+                column->nulls[row / 8] |= (uint8_t)(1 << (row % 8));
+            }
+            if (column->value_size > 0) {
+                memcpy(column->values + row * column->value_size, result->value, column->value_size);
+            } else if (AppendColumnBytes(column, row, result->is_null ? "" : (const char*)result->value,
+                result->is_null ? 0 : result->length < result->max_length ? result->length : result->max_length) != RET_OK) {
+                return RET_ERR;
+            }
+        }
         row++;
     }
+    pst_timing_Record(PstPhase_Fetch, fetch_ns);
+    session->column_set->row_count = row;
+
+    /* Column widths, one linear scan per column */
+    uint64_t format_start = pst_GetMonotonicNs();
+    for (unsigned int col = 0; col < field_count; col++) {
+        const PstColumn* column = &session->column_set->columns[col];
+        PstResult* header = &session->result_set->result[0][col];
+        PstResult value;
+        memset(&value, 0, sizeof(PstResult));
+        value.valuestring = session->result[col].valuestring;
+        for (uint64_t r = 0; r < session->column_set->row_count; r++) {
+            GetColumnValue(column, r, &value);
+            unsigned long text_length = FormatResult(&value);
+            if (text_length > header->field_length) {
+                header->field_length = text_length;
+            }
+        }
+    }
+    pst_timing_Record(PstPhase_Format, pst_GetMonotonicNs() - format_start);
 
     return RET_OK;
+}
+
+static void PrintColumnSet(PstSession* session) {
+    const PstColumnSet* column_set = session->column_set;
+    const PstResult* header = session->result_set->result[0];
+
+    PstResult* row_view = (PstResult*)pst_arena_Calloc(&session->arena, sizeof(PstResult) * column_set->column_count);
+    if (row_view == NULL) {
+        log_error(PST_FORMAT_MSG_ERR_ALLOC, "row_view");
+        session->ret = RET_ERR;
+        return;
+    }
+
+    pst_print_PrintResultSetBorder(header, column_set->column_count);
+    pst_print_PrintResultSetRow(header, header, column_set->column_count);
+    pst_print_PrintResultSetBorder(header, column_set->column_count);
+
+    for (uint64_t row = 0; row < column_set->row_count; row++) {
+        GetColumnRow(session, row, row_view);
+        pst_print_PrintResultSetRow(header, row_view, column_set->column_count);
+    }
+
+    pst_print_PrintResultSetBorder(header, column_set->column_count);
+}
+
+/* Row r of the column set as printable cells */
+static void GetColumnRow(PstSession* session, uint64_t row, PstResult* row_view) {
+    const PstColumnSet* column_set = session->column_set;
+    for (uint64_t col = 0; col < column_set->column_count; col++) {
+        const PstColumn* column = &column_set->columns[col];
+        GetColumnValue(column, row, &row_view[col]);
+        row_view[col].valuestring = session->result[col].valuestring;
+        FormatResult(&row_view[col]);
+    }
+}
+
+/* Fetch every row through the bound buffers and fold the values into */
+/* session->digest, nothing of the result is kept or formatted */
+static int DigestResultSet(PstSession* session) {
+    if (session->prep_stmt->fetch_mode == PstFetchMode_Buffered) {
+        uint64_t store_start = pst_GetMonotonicNs();
+        if (mysql_stmt_store_result(session->stmt)) {
+            log_error(PST_FORMAT_MSG_ERR_MYSQL, mysql_stmt_errno(session->stmt), mysql_stmt_sqlstate(session->stmt), mysql_stmt_error(session->stmt));
+            return RET_ERR;
+        }
+        pst_timing_Record(PstPhase_Store, pst_GetMonotonicNs() - store_start);
+    }
+
+    session->result_metadata = mysql_stmt_result_metadata(session->stmt);
+    if (session->result_metadata == NULL) {
+        log_error(PST_FORMAT_MSG_ERR_MYSQL, mysql_stmt_errno(session->stmt), mysql_stmt_sqlstate(session->stmt), mysql_stmt_error(session->stmt));
+        return RET_ERR;
+    }
+
+    unsigned int field_count = mysql_num_fields(session->result_metadata);
+    session->result_set->column_count = field_count;
+    if (BindRowBuffers(session, mysql_fetch_fields(session->result_metadata), field_count) != RET_OK) {
+        return RET_ERR;
+    }
+
+    uint64_t fetch_ns = 0;
+    uint64_t digest_ns = 0;
+    while (1) {
+        uint64_t fetch_start = pst_GetMonotonicNs();
+        int status = mysql_stmt_fetch(session->stmt);
+        if (status == MYSQL_DATA_TRUNCATED && FetchTruncatedColumns(session) != RET_OK) {
+            return RET_ERR;
+        }
+        uint64_t fetch_end = pst_GetMonotonicNs();
+        fetch_ns += fetch_end - fetch_start;
+        if (status == MYSQL_NO_DATA) {
+            pst_timing_Record(PstPhase_LastRow, fetch_end - session->exec_start_ns);
+            break;
+        }
+        if (status == 1) {
+            log_error(PST_FORMAT_MSG_ERR_MYSQL, mysql_stmt_errno(session->stmt), mysql_stmt_sqlstate(session->stmt), mysql_stmt_error(session->stmt));
+            return RET_ERR;
+        }
+        if (session->rows == 0) {
+            pst_timing_Record(PstPhase_FirstRow, fetch_end - session->exec_start_ns);
+        }
+        session->rows++;
+
+        for (unsigned int col = 0; col < field_count; col++) {
+            session->result_bytes += pst_digest_AddResult(&session->digest, &session->result[col]);
+        }
+        digest_ns += pst_GetMonotonicNs() - fetch_end;
+    }
+    pst_timing_Record(PstPhase_Fetch, fetch_ns);
+    /* hashing takes the place of formatting */
+    pst_timing_Record(PstPhase_Format, digest_ns);
 
+    return RET_OK;
 }
 
-static void GetResultSet() {
-    if (InitResultSet() != RET_OK) {
-        ret = RET_ERR;
+static void GetResultSet(PstSession* session) {
+    /* buffered results were fetched by pst_output_FetchResult */
+    if (session->result_set != NULL) {
+        return;
+    }
+    if (InitResultSet(session) != RET_OK) {
+        session->ret = RET_ERR;
+        return;
+    }
+
+    int ret;
+    if (IsStreamed(session)) {
+        ret = StreamResultSet(session);
+    } else if (session->prep_stmt->layout == PstLayout_Columns) {
+        ret = FetchColumnSet(session);
+    } else {
+        ret = FetchResultSet(session);
+    }
+    if (ret != RET_OK) {
+        session->ret = RET_ERR;
         return;
     }
+}
+
+/* Statements whose result is a result set rather than affected rows */
+static bool HasResultSet(PstSyntax syntax) {
+    switch (syntax) {
+    case PstSyntax_AnalyzeTable:
+    case PstSyntax_CacheIndex:
+    case PstSyntax_CheckSum:
+    case PstSyntax_LoadIndexIntoCache:
+    case PstSyntax_OptimizeTable:
+    case PstSyntax_RepairTable:
+    case PstSyntax_Select:
+    case PstSyntax_Show:
+    case PstSyntax_ShowCreate:
+        return true;
+    default:
+        return false;
+    }
+}
 
-    if (FetchResultSet() != RET_OK) {
-        ret = RET_ERR;
+static void PrintResultSet(PstSession* session) {
+    /* streamed rows went to the sink while fetching, an empty set prints */
+    /* no table but the header of the other formats */
+    bool table = pst_print_GetFormat() == PstOutputFormat_Table;
+    if (IsStreamed(session) || (table && session->rows == 0)) {
         return;
     }
+
+    uint64_t print_start = pst_GetMonotonicNs();
+    if (!table) {
+        PrintFormatRows(session);
+    } else if (session->column_set != NULL) {
+        PrintColumnSet(session);
+    } else {
+        pst_print_PrintResultSet(session->result_set);
+    }
+    pst_timing_Record(PstPhase_Print, pst_GetMonotonicNs() - print_start);
+}
+
+/* A buffered result in the machine formats, row by row as it was fetched */
+static void PrintFormatRows(PstSession* session) {
+    unsigned int field_count = (unsigned int)session->result_set->column_count;
+    PstResult* row_view = NULL;
+    if (session->column_set != NULL) {
+        row_view = (PstResult*)pst_arena_Calloc(&session->arena, sizeof(PstResult) * field_count);
+        if (row_view == NULL) {
+            log_error(PST_FORMAT_MSG_ERR_ALLOC, "row_view");
+            session->ret = RET_ERR;
+            return;
+        }
+    }
+
+    pst_print_BeginRows(mysql_fetch_fields(session->result_metadata), field_count);
+    for (uint64_t row = 0; row < session->rows; row++) {
+        if (session->column_set != NULL) {
+            GetColumnRow(session, row, row_view);
+            pst_print_PrintRow(row_view, field_count);
+        } else {
+            pst_print_PrintRow(session->result_set->result[row + 1], field_count);
+        }
+    }
+    pst_print_EndRows(session->rows);
 }
 
-static void PrintAlterTable() {
-    GetRowsAffected();
-    pst_print_PrintRowsAffectedAndDuplicate(rows);
+static void PrintAlterTable(PstSession* session) {
+    GetRowsAffected(session);
+    pst_print_PrintRowsAffectedAndDuplicate(session->rows, GetElapsedSec(session));
 }
 
-static void PrintAlterUser() {
-    GetRowsAffected();
-    pst_print_PrintRowsAffected(rows);
+static void PrintAlterUser(PstSession* session) {
+    GetRowsAffected(session);
+    pst_print_PrintRowsAffected(session->rows, GetElapsedSec(session));
 }
 
-static void PrintAnalyzeTable() {
-    GetResultSet();
-    if (ret == RET_ERR) return;
-    if (rows == 0) {
-        pst_print_PrintEmptySet();
+static void PrintAnalyzeTable(PstSession* session) {
+    GetResultSet(session);
+    if (session->ret == RET_ERR) return;
+    PrintResultSet(session);
+    if (session->rows == 0) {
+        pst_print_PrintEmptySet(GetElapsedSec(session));
     } else {
-        pst_print_PrintResultSet(result_set);
-        pst_print_PrintRowsInSet(rows);
+        pst_print_PrintRowsInSet(session->rows, GetElapsedSec(session));
     }
 }
 
-static void PrintCacheIndex() {
-    GetResultSet();
-    if (ret == RET_ERR) return;
-    if (rows == 0) {
-        pst_print_PrintEmptySet();
+static void PrintCacheIndex(PstSession* session) {
+    GetResultSet(session);
+    if (session->ret == RET_ERR) return;
+    PrintResultSet(session);
+    if (session->rows == 0) {
+        pst_print_PrintEmptySet(GetElapsedSec(session));
     } else {
-        pst_print_PrintResultSet(result_set);
-        pst_print_PrintRowsInSet(rows);
+        pst_print_PrintRowsInSet(session->rows, GetElapsedSec(session));
     }
 }
 
-static void PrintCall() {
-    GetRowsAffected();
-    pst_print_PrintRowsAffected(rows);
+static void PrintCall(PstSession* session) {
+    GetRowsAffected(session);
+    pst_print_PrintRowsAffected(session->rows, GetElapsedSec(session));
 }
 
-static void PrintChange() {
-    GetRowsAffected();
-    pst_print_PrintRowsAffectedIncludeWarnings(rows);
+static void PrintChange(PstSession* session) {
+    GetRowsAffected(session);
+    pst_print_PrintRowsAffectedIncludeWarnings(session->rows, GetElapsedSec(session));
 }
 
-static void PrintCheckSum() {
-    GetResultSet();
-    if (ret == RET_ERR) return;
-    if (rows == 0) {
-        pst_print_PrintEmptySet();
+static void PrintCheckSum(PstSession* session) {
+    GetResultSet(session);
+    if (session->ret == RET_ERR) return;
+    PrintResultSet(session);
+    if (session->rows == 0) {
+        pst_print_PrintEmptySet(GetElapsedSec(session));
     } else {
-        pst_print_PrintResultSet(result_set);
-        pst_print_PrintRowsInSet(rows);
+        pst_print_PrintRowsInSet(session->rows, GetElapsedSec(session));
     }
 }
 
-static void PrintCommit() {
-    GetRowsAffected();
-    pst_print_PrintRowsAffected(rows);
+static void PrintCommit(PstSession* session) {
+    GetRowsAffected(session);
+    pst_print_PrintRowsAffected(session->rows, GetElapsedSec(session));
 }
 
-static void PrintCreateOrDropIndex() {
-    GetRowsAffected();
-    pst_print_PrintRowsAffectedAndDuplicate(rows);
+static void PrintCreateOrDropIndex(PstSession* session) {
+    GetRowsAffected(session);
+    pst_print_PrintRowsAffectedAndDuplicate(session->rows, GetElapsedSec(session));
 }
 
-static void PrintCreateOrRenameOrDropDatabase() {
-    GetRowsAffected();
-    pst_print_PrintRowsAffected(rows);
+static void PrintCreateOrRenameOrDropDatabase(PstSession* session) {
+    GetRowsAffected(session);
+    pst_print_PrintRowsAffected(session->rows, GetElapsedSec(session));
 }
 
-static void PrintCreateOrDropTable() {
-    GetRowsAffected();
-    pst_print_PrintRowsAffected(rows);
+static void PrintCreateOrDropTable(PstSession* session) {
+    GetRowsAffected(session);
+    pst_print_PrintRowsAffected(session->rows, GetElapsedSec(session));
 }
 
-static void PrintCreateOrRenameOrDropUser() {
-    GetRowsAffected();
-    pst_print_PrintRowsAffected(rows);
+static void PrintCreateOrRenameOrDropUser(PstSession* session) {
+    GetRowsAffected(session);
+    pst_print_PrintRowsAffected(session->rows, GetElapsedSec(session));
 }
 
-static void PrintCreateOrDropView() {
-    GetRowsAffected();
-    pst_print_PrintRowsAffected(rows);
+static void PrintCreateOrDropView(PstSession* session) {
+    GetRowsAffected(session);
+    pst_print_PrintRowsAffected(session->rows, GetElapsedSec(session));
 }
 
-static void PrintDelete() {
-    GetRowsAffected();
-    pst_print_PrintRowsAffected(rows);
+static void PrintDelete(PstSession* session) {
+    GetRowsAffected(session);
+    pst_print_PrintRowsAffected(session->rows, GetElapsedSec(session));
 }
 
-static void PrintDo() {
-    GetRowsAffected();
-    pst_print_PrintRowsAffected(rows);
+static void PrintDo(PstSession* session) {
+    GetRowsAffected(session);
+    pst_print_PrintRowsAffected(session->rows, GetElapsedSec(session));
 }
 
-static void PrintFlush() {
-    GetRowsAffected();
-    pst_print_PrintRowsAffected(rows);
+static void PrintFlush(PstSession* session) {
+    GetRowsAffected(session);
+    pst_print_PrintRowsAffected(session->rows, GetElapsedSec(session));
 }
 
-static void PrintGrant() {
-    GetRowsAffected();
-    pst_print_PrintRowsAffected(rows);
+static void PrintGrant(PstSession* session) {
+    GetRowsAffected(session);
+    pst_print_PrintRowsAffected(session->rows, GetElapsedSec(session));
 }
 
-static void PrintInsert() {
-    GetRowsAffected();
-    pst_print_PrintRowsAffected(rows);
+static void PrintInsert(PstSession* session) {
+    GetRowsAffected(session);
+    pst_print_PrintRowsAffected(session->rows, GetElapsedSec(session));
 }
 
-static void PrintInsertSelect() {
-    GetRowsAffected();
-    pst_print_PrintRowsAffectedAndDuplicate(rows);
+static void PrintInsertSelect(PstSession* session) {
+    GetRowsAffected(session);
+    pst_print_PrintRowsAffectedAndDuplicate(session->rows, GetElapsedSec(session));
 }
 
-static void PrintInstallPlugin() {
-    GetRowsAffected();
-    pst_print_PrintRowsAffected(rows);
+static void PrintInstallPlugin(PstSession* session) {
+    GetRowsAffected(session);
+    pst_print_PrintRowsAffected(session->rows, GetElapsedSec(session));
 }
 
-static void PrintKill() {
-    GetRowsAffected();
-    pst_print_PrintRowsAffected(rows);
+static void PrintKill(PstSession* session) {
+    GetRowsAffected(session);
+    pst_print_PrintRowsAffected(session->rows, GetElapsedSec(session));
 }
 
-static void PrintLoadIndexIntoCache() {
-    GetResultSet();
-    if (ret == RET_ERR) return;
-    if (rows == 0) {
-        pst_print_PrintEmptySet();
+static void PrintLoadIndexIntoCache(PstSession* session) {
+    GetResultSet(session);
+    if (session->ret == RET_ERR) return;
+    PrintResultSet(session);
+    if (session->rows == 0) {
+        pst_print_PrintEmptySet(GetElapsedSec(session));
     } else {
-        pst_print_PrintResultSet(result_set);
-        pst_print_PrintRowsInSet(rows);
+        pst_print_PrintRowsInSet(session->rows, GetElapsedSec(session));
     }
 }
-static void PrintOptimizeTable() {
-    GetResultSet();
-    if (ret == RET_ERR) return;
-    if (rows == 0) {
-        pst_print_PrintEmptySet();
+static void PrintOptimizeTable(PstSession* session) {
+    GetResultSet(session);
+    if (session->ret == RET_ERR) return;
+    PrintResultSet(session);
+    if (session->rows == 0) {
+        pst_print_PrintEmptySet(GetElapsedSec(session));
     } else {
-        pst_print_PrintResultSet(result_set);
-        pst_print_PrintRowsInSet(rows);
+        pst_print_PrintRowsInSet(session->rows, GetElapsedSec(session));
     }
 }
 
-static void PrintRenameTable() {
-    GetRowsAffected();
-    pst_print_PrintRowsAffected(rows);
+static void PrintRenameTable(PstSession* session) {
+    GetRowsAffected(session);
+    pst_print_PrintRowsAffected(session->rows, GetElapsedSec(session));
 }
 
-static void PrintRepairTable() {
-    GetResultSet();
-    if (ret == RET_ERR) return;
-    if (rows == 0) {
-        pst_print_PrintEmptySet();
+static void PrintRepairTable(PstSession* session) {
+    GetResultSet(session);
+    if (session->ret == RET_ERR) return;
+    PrintResultSet(session);
+    if (session->rows == 0) {
+        pst_print_PrintEmptySet(GetElapsedSec(session));
     } else {
-        pst_print_PrintResultSet(result_set);
-        pst_print_PrintRowsInSet(rows);
+        pst_print_PrintRowsInSet(session->rows, GetElapsedSec(session));
     }
 }
 
-static void PrintReplace() {
-    GetRowsAffected();
-    pst_print_PrintRowsAffected(rows);
+static void PrintReplace(PstSession* session) {
+    GetRowsAffected(session);
+    pst_print_PrintRowsAffected(session->rows, GetElapsedSec(session));
 }
 
-static void PrintReset() {
-    GetRowsAffected();
-    pst_print_PrintRowsAffected(rows);
+static void PrintReset(PstSession* session) {
+    GetRowsAffected(session);
+    pst_print_PrintRowsAffected(session->rows, GetElapsedSec(session));
 }
 
-static void PrintRevoke() {
-    GetRowsAffected();
-    pst_print_PrintRowsAffected(rows);
+static void PrintRevoke(PstSession* session) {
+    GetRowsAffected(session);
+    pst_print_PrintRowsAffected(session->rows, GetElapsedSec(session));
 }
 
-static void PrintSelect() {
-    GetResultSet();
-    if (ret == RET_ERR) return;
-    if (rows == 0) {
-        pst_print_PrintEmptySet();
+static void PrintSelect(PstSession* session) {
+    GetResultSet(session);
+    if (session->ret == RET_ERR) return;
+    PrintResultSet(session);
+    if (session->rows == 0) {
+        pst_print_PrintEmptySet(GetElapsedSec(session));
     } else {
-        pst_print_PrintResultSet(result_set);
-        pst_print_PrintRowsInSet(rows);
+        pst_print_PrintRowsInSet(session->rows, GetElapsedSec(session));
     }
 }
 
-static void PrintSet() {
-    GetRowsAffected();
-    pst_print_PrintRowsAffectedIncludeWarnings(rows);
+static void PrintSet(PstSession* session) {
+    GetRowsAffected(session);
+    pst_print_PrintRowsAffectedIncludeWarnings(session->rows, GetElapsedSec(session));
 }
 
-static void PrintShow() {
-    GetResultSet();
-    if (ret == RET_ERR) return;
-    if (rows == 0) {
-        pst_print_PrintEmptySet();
+static void PrintShow(PstSession* session) {
+    GetResultSet(session);
+    if (session->ret == RET_ERR) return;
+    PrintResultSet(session);
+    if (session->rows == 0) {
+        pst_print_PrintEmptySet(GetElapsedSec(session));
     } else {
-        pst_print_PrintResultSet(result_set);
-        pst_print_PrintRowsInSet(rows);
+        pst_print_PrintRowsInSet(session->rows, GetElapsedSec(session));
     }
 }
 
-static void PrintShowCreate() {
-    GetResultSet();
-    if (ret == RET_ERR) return;
-    if (rows == 0) {
-        pst_print_PrintEmptySet();
+static void PrintShowCreate(PstSession* session) {
+    GetResultSet(session);
+    if (session->ret == RET_ERR) return;
+    PrintResultSet(session);
+    if (session->rows == 0) {
+        pst_print_PrintEmptySet(GetElapsedSec(session));
     } else {
-        pst_print_PrintResultSet(result_set);
-        pst_print_PrintRowsInSet(rows);
+        pst_print_PrintRowsInSet(session->rows, GetElapsedSec(session));
     }
 }
-static void PrintStartOrStopReplica() {
-    GetRowsAffected();
-    pst_print_PrintRowsAffected(rows);
+static void PrintStartOrStopReplica(PstSession* session) {
+    GetRowsAffected(session);
+    pst_print_PrintRowsAffected(session->rows, GetElapsedSec(session));
 }
 
-static void PrintTruncate() {
-    GetRowsAffected();
-    pst_print_PrintRowsAffected(rows);
+static void PrintTruncate(PstSession* session) {
+    GetRowsAffected(session);
+    pst_print_PrintRowsAffected(session->rows, GetElapsedSec(session));
 }
 
-static void PrintUninstallPlugin() {
-    GetRowsAffected();
-    pst_print_PrintRowsAffected(rows);
+static void PrintUninstallPlugin(PstSession* session) {
+    GetRowsAffected(session);
+    pst_print_PrintRowsAffected(session->rows, GetElapsedSec(session));
 }
 
-static void PrintUpdate() {
-    GetRowsAffected();
-    pst_print_PrintRowsAffectedAndChanged(rows);
+static void PrintUpdate(PstSession* session) {
+    GetRowsAffected(session);
+    pst_print_PrintRowsAffectedAndChanged(session->rows, GetElapsedSec(session));
 }
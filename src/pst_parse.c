@@ -4,61 +4,125 @@
 
 #include "cJSON.h"
 #include "log.h"
+#include "pst_compile.h"
 #include "pst_parse.h"
+#include "pst_stream.h"
+#include "pst_verify.h"
+
+/* text kept by the scan, see CutParameters */
+typedef struct PstSkeleton {
+    char* str;
+    size_t used;
+    size_t size;
+    /* the document before it is in str or cut out */
+    const char* copied;
+} PstSkeleton;
 
 /* global variables */
 static PstConnection* conn;
+static PstScenario* scenario;
 static PstPreparedStatements* prep_stmts;
+/* the mapped scenario file, kept while parameter sets are streamed from it */
+static char* g_file;
+static size_t g_file_size;
+static bool g_file_mapped;
+static char* g_filename;
+/* text of the parameter array of every statement, see CutParameters */
+static PstParamStream* g_streams;
+static unsigned long g_streams_size;
+/* the scan may stop at an array, and stopped at g_streams[g_scan_index] */
+static bool g_scan_stop;
+static bool g_scan_stopped;
+static unsigned long g_scan_index;
+/* root members the scan has to find before it may stop */
+static const char* g_connection_members[] = { "user", "password", "host", "port", "database", NULL };
+/* the sidecar and pst_parse_SetupStatements, for statements read later */
+static char* g_expect_file;
+static bool g_setup;
+
+/* the document without its parameter sets, see pst_parse_GetSkeleton */
+static char* g_skeleton;
+static size_t g_skeleton_size;
+static bool g_stream_parameters;
 
 /* declarations */
-static char* ReadLine(FILE* file, char* buffer);
+static cJSON* ParseText(const char* str, size_t str_len);
+static int ParseStatement(const cJSON* cjson_prepared_statement, unsigned long index, const PstCompiledHeader* compiled);
+static int ReadStatements(const cJSON* root, unsigned long index);
+static int SetupStatement(unsigned long index);
+static char* CutParameters(const char* data, size_t size, size_t* length);
+static int CutStatements(PstSkeleton* skeleton, const char* p, const char* end, unsigned long index);
+static bool NextMember(const char** p, const char* end, const char** key);
+static bool IsKey(const char* key, const char* name);
+static int CutStatement(PstSkeleton* skeleton, const char** p, const char* end, unsigned long index, bool cut);
+static int KeepUntil(PstSkeleton* skeleton, const char* to);
+static int KeepText(PstSkeleton* skeleton, const char* text);
+static int Reserve(PstSkeleton* skeleton, size_t size);
+static int GrowStreams(unsigned long size);
+static int OpenParameterFile(const char* filename, const cJSON* cjson_prepared_statement, PstParamStream* stream);
+static int ParseColumns(const cJSON* cjson_columns, PstParamStream* stream, char delimiter);
+static int LoadParameters(PstParamStream* stream, PstPreparedStatement* prep_stmt);
+static void OpenCompiled(const PstCompiledHeader* header, unsigned long index, PstPreparedStatement* prep_stmt);
+static void CloseStreams();
 static int InitBuffer();
+static int GetOptionalNumber(const cJSON* object, const char* name, double min, double* value);
+static int GetOptionalString(const cJSON* object, const char* name, char* buffer, size_t size);
+static int GetOptionalBool(const cJSON* object, const char* name, bool* value);
+static int ParseScenario(const cJSON* root);
+static int ParseStatementOptions(const cJSON* object, PstPreparedStatement* prep_stmt);
+static int ApplyExpectations(const char* filename, unsigned long first);
+static int ParseExpectations(const cJSON* object, PstPreparedStatement* prep_stmt, bool overwrite);
 
 int pst_parse_Parse(const char* filename) {
     if (InitBuffer() != RET_OK) {
         return RET_ERR;
     }
 
-    FILE* fp = fopen(filename, "r");
-    if (fp == NULL) {
-        log_error(PST_FORMAT_MSG_ERR_FOPEN, filename);
+    g_file = pst_MapFile(filename, &g_file_size, &g_file_mapped);
+    if (g_file == NULL) {
         return RET_ERR;
     }
+    log_debug("File size: %zu", g_file_size);
 
-    char* buffer = NULL;
+    /* parameter_file is relative to it, also for statements read later */
+    g_filename = strdup(filename);
+    if (g_filename == NULL) {
+        log_error(PST_FORMAT_MSG_ERR_ALLOC, "filename");
+        return RET_ERR;
+    }
+
+    /* a compiled scenario carries the rest of the document as it is */
+    const PstCompiledHeader* compiled = NULL;
+    if (pst_compile_Open(g_file, g_file_size, &compiled) != RET_OK) {
+        return RET_ERR;
+    }
+
+    /* the parameter sets are parsed one at a time from the file, cJSON */
+    /* only builds the small rest of the document */
+    size_t str_len = 0;
     char* str = NULL;
-    unsigned long str_len = 0;
-    while ((buffer = ReadLine(fp, buffer)) != NULL) {
-        if (str) {
-            str = realloc(str, str_len + strlen(buffer) + 1);
-        } else {
-            str = malloc(strlen(buffer) + 1);
-        }
-        if (!str) {
-            log_error(PST_FORMAT_MSG_ERR_ALLOC, "string buffer");
-            fclose(fp);
-            return RET_ERR;
+    if (compiled != NULL) {
+        str_len = compiled->skeleton_size;
+        str = strndup(g_file + compiled->skeleton_offset, str_len);
+        if (str == NULL) {
+            log_error(PST_FORMAT_MSG_ERR_ALLOC, "skeleton");
         }
-        memset(str + str_len, 0, strlen(buffer) + 1);
-        strcat(str, buffer);
-        str_len += strlen(str);
+    } else {
+        str = CutParameters(g_file, g_file_size, &str_len);
+    }
+    if (str == NULL) {
+        return RET_ERR;
     }
-
-    log_debug("File Content: %s", str);
-    fclose(fp);
 
     /* parse json string */
-    cJSON* root = cJSON_Parse(str);
+    cJSON* root = ParseText(str, str_len);
     if (root == NULL) {
-        const char* error_ptr = cJSON_GetErrorPtr();
-        if (error_ptr != NULL) {
-            log_error("Error before: %s\n", error_ptr);
-        }
-        cJSON_Delete(root);
         free(str);
-        str = NULL;
         return RET_ERR;
     }
+    free(g_skeleton);
+    g_skeleton = str;
+    g_skeleton_size = str_len;
 
     cJSON* cjson_user = NULL;
     cJSON* cjson_password = NULL;
@@ -70,8 +134,6 @@ int pst_parse_Parse(const char* filename) {
     if (!cJSON_IsString(cjson_user) && cjson_user->valuestring == NULL) {
         log_error("user is not found or is null");
         cJSON_Delete(root);
-        free(str);
-        str = NULL;
         return RET_ERR;
     }
 
@@ -79,8 +141,6 @@ int pst_parse_Parse(const char* filename) {
     if (!cJSON_IsString(cjson_password) && cjson_password->valuestring == NULL) {
         log_error("password is not found or is null");
         cJSON_Delete(root);
-        free(str);
-        str = NULL;
         return RET_ERR;
     }
 
@@ -88,8 +148,6 @@ int pst_parse_Parse(const char* filename) {
     if (!cJSON_IsString(cjson_host) && cjson_host->valuestring == NULL) {
         log_error("host is not found or is null");
         cJSON_Delete(root);
-        free(str);
-        str = NULL;
         return RET_ERR;
     }
 
@@ -97,8 +155,6 @@ int pst_parse_Parse(const char* filename) {
     if (!cJSON_IsNumber(cjson_port) && cjson_port->valueint == 0) {
         log_error("port is not found or is null");
         cJSON_Delete(root);
-        free(str);
-        str = NULL;
         return RET_ERR;
     }
 
@@ -106,8 +162,6 @@ int pst_parse_Parse(const char* filename) {
     if (!cJSON_IsString(cjson_database) && cjson_database->valuestring == NULL) {
         log_error("database is not found or is null");
         cJSON_Delete(root);
-        free(str);
-        str = NULL;
         return RET_ERR;
     }
 
@@ -124,188 +178,165 @@ int pst_parse_Parse(const char* filename) {
     conn->port = (unsigned int)cjson_port->valuedouble;
     strcpy(conn->database, cjson_database->valuestring);
 
-    cJSON* cjson_prepared_statements = NULL;
-    int    cjson_prepared_statements_size = 0;
-
-    cJSON* cjson_prepared_statement = NULL;
-    cJSON* cjson_statement = NULL;
-
-    cJSON* cjson_parameters = NULL;
-    int    cjson_parameters_size = 0;
-
-    cJSON* cjson_parameter = NULL;
-    int    cjson_parameter_count = 0;
-
-    cJSON* cjson_parameter_item = NULL;
-    cJSON* cjson_parameter_item_type = NULL;
-    cJSON* cjson_parameter_item_unsigned = NULL;
-    cJSON* cjson_parameter_item_value = NULL;
+    /* scenario options, all optional */
+    if (ParseScenario(root) != RET_OK) {
+        cJSON_Delete(root);
+        return RET_ERR;
+    }
+    if (g_stream_parameters) {
+        scenario->stream_parameters = true;
+    }
 
-    cjson_prepared_statements = cJSON_GetObjectItemCaseSensitive(root, "prepared_statement");
-    cjson_prepared_statements_size = cJSON_GetArraySize(cjson_prepared_statements);
+    cJSON* cjson_prepared_statements = cJSON_GetObjectItemCaseSensitive(root, "prepared_statement");
+    int cjson_prepared_statements_size = cJSON_GetArraySize(cjson_prepared_statements);
     if (!cJSON_IsArray(cjson_prepared_statements) && cjson_prepared_statements_size == 0) {
         log_error("prepared_statement is not found or is null");
         cJSON_Delete(root);
-        free(str);
-        str = NULL;
         return RET_ERR;
     }
 
-    prep_stmts->prep_stmt_size = cjson_prepared_statements_size;
-    prep_stmts->prep_stmt = (PstPreparedStatement*)malloc(prep_stmts->prep_stmt_size * sizeof(PstPreparedStatement));
+    prep_stmts->prep_stmt = (PstPreparedStatement*)malloc(cjson_prepared_statements_size * sizeof(PstPreparedStatement));
     if (!prep_stmts->prep_stmt) {
         log_error(PST_FORMAT_MSG_ERR_ALLOC, "prepared statement");
         cJSON_Delete(root);
-        free(str);
-        str = NULL;
         return RET_ERR;
     }
-    memset(prep_stmts->prep_stmt, 0, prep_stmts->prep_stmt_size * sizeof(PstPreparedStatement));
+    memset(prep_stmts->prep_stmt, 0, cjson_prepared_statements_size * sizeof(PstPreparedStatement));
 
+    if (compiled != NULL && compiled->statements_size != (unsigned long)cjson_prepared_statements_size) {
+        log_error("Compiled scenario has %u statements, its prepared_statement has %d",
+            compiled->statements_size, cjson_prepared_statements_size);
+        cJSON_Delete(root);
+        return RET_ERR;
+    }
+
+    /* one stream per statement */
+    if (GrowStreams(cjson_prepared_statements_size) != RET_OK) {
+        cJSON_Delete(root);
+        return RET_ERR;
+    }
+
+    /* walk the lists, cJSON_GetArrayItem starts over from the head */
+    const cJSON* cjson_prepared_statement = cjson_prepared_statements->child;
     for (int i = 0; i < cjson_prepared_statements_size; i++) {
-        cjson_prepared_statement = cJSON_GetArrayItem(cjson_prepared_statements, i);
-        if (!cJSON_IsObject(cjson_prepared_statement)) {
-            log_error("prepared_statement is not an object");
+        prep_stmts->prep_stmt_size = i + 1;
+        if (ParseStatement(cjson_prepared_statement, i, compiled) != RET_OK) {
             cJSON_Delete(root);
-            free(str);
-            str = NULL;
             return RET_ERR;
         }
+        cjson_prepared_statement = cjson_prepared_statement->next;
+    }
 
-        cjson_statement = cJSON_GetObjectItemCaseSensitive(cjson_prepared_statement, "statement");
-        if (!cJSON_IsString(cjson_statement) && cjson_statement->valuestring == NULL) {
-            log_error("statement is not found or is null");
-            cJSON_Delete(root);
-            free(str);
-            str = NULL;
-            return RET_ERR;
-        }
-        log_debug("statement: %s", cjson_statement->valuestring);
+    cJSON_Delete(root);
 
-        prep_stmts->prep_stmt[i].stmt = (char*)malloc(strlen(cjson_statement->valuestring) + 1);
-        if (!prep_stmts->prep_stmt[i].stmt) {
-            log_error(PST_FORMAT_MSG_ERR_ALLOC, "prepared statement");
-            cJSON_Delete(root);
-            free(str);
-            str = NULL;
+    /* an array the scan stopped at may have ended already, when it is empty */
+    if (pst_parse_MoreToRead() && pst_parse_ReadMore() != RET_OK) {
+        return RET_ERR;
+    }
+
+    bool streamed = g_scan_stopped;
+    bool lent = false;
+    for (unsigned long i = 0; i < prep_stmts->prep_stmt_size; i++) {
+        streamed = streamed || prep_stmts->prep_stmt[i].params_stream != NULL;
+        lent = lent || g_streams[i].lent;
+    }
+    if (!streamed) {
+        pst_UnmapFile(g_file, g_file_size, g_file_mapped);
+        g_file = NULL;
+    }
+    if (!streamed && !lent) {
+        CloseStreams();
+    }
+
+    return RET_OK;
+}
+
+bool pst_parse_MoreToRead() {
+    return g_scan_stopped && !g_streams[g_scan_index].unread;
+}
+
+int pst_parse_ReadMore() {
+    while (pst_parse_MoreToRead()) {
+        /* the rest of the statement the scan stopped in, as the first element */
+        /* of a document of its own, and the statements after it */
+        unsigned long index = g_scan_index;
+        const char* p = g_streams[index].end + 1;
+        const char* end = g_file + g_file_size;
+        g_scan_stopped = false;
+
+        PstSkeleton skeleton;
+        memset(&skeleton, 0, sizeof(PstSkeleton));
+        skeleton.copied = p;
+        int ret = KeepText(&skeleton, "{\"prepared_statement\":[{\"parameter\":[]");
+        if (ret == RET_OK) {
+            ret = CutStatement(&skeleton, &p, end, index, true);
+        }
+        p = p != NULL ? pst_stream_SkipSpace(p, end) : NULL;
+        if (ret == RET_OK && p != NULL && p < end && *p == ',') {
+            ret = CutStatements(&skeleton, p + 1, end, index + 1);
+        }
+        if (ret == RET_OK && !g_scan_stopped) {
+            ret = KeepUntil(&skeleton, end);
+        }
+        if (ret != RET_OK) {
+            free(skeleton.str);
             return RET_ERR;
         }
-        memset(prep_stmts->prep_stmt[i].stmt, 0, strlen(cjson_statement->valuestring) + 1);
-        memcpy(prep_stmts->prep_stmt[i].stmt, cjson_statement->valuestring, strlen(cjson_statement->valuestring));
-        prep_stmts->prep_stmt[i].stmt_len = strlen(prep_stmts->prep_stmt[i].stmt);
 
-        cjson_parameters = cJSON_GetObjectItemCaseSensitive(cjson_prepared_statement, "parameter");
-        cjson_parameters_size = cJSON_GetArraySize(cjson_parameters);
-        if (!cJSON_IsArray(cjson_parameters) && cjson_parameters_size == 0) {
-            log_error("parameter is not found or is null");
-            cJSON_Delete(root);
-            free(str);
-            str = NULL;
+        cJSON* root = ParseText(skeleton.str, skeleton.used);
+        free(skeleton.str);
+        if (root == NULL) {
             return RET_ERR;
         }
-
-        prep_stmts->prep_stmt[i].params_size = cjson_parameters_size;
-        prep_stmts->prep_stmt[i].params = (PstParameter**)malloc(prep_stmts->prep_stmt[i].params_size * sizeof(PstParameter*));
-        if (!prep_stmts->prep_stmt[i].params) {
-            log_error(PST_FORMAT_MSG_ERR_ALLOC, "parameter");
-            cJSON_Delete(root);
-            free(str);
-            str = NULL;
+        ret = ReadStatements(root, index);
+        cJSON_Delete(root);
+        if (ret != RET_OK) {
             return RET_ERR;
         }
-        memset(prep_stmts->prep_stmt[i].params, 0, prep_stmts->prep_stmt[i].params_size * sizeof(PstParameter*));
+    }
 
-        for (int j = 0; j < cjson_parameters_size; j++) {
-            cjson_parameter = cJSON_GetArrayItem(cjson_parameters, j);
-            cjson_parameter_count = cJSON_GetArraySize(cjson_parameter);
-            if (!cJSON_IsArray(cjson_parameter) && cjson_parameter_count == 0) {
-                log_error("parameter is not found or is null");
-                cJSON_Delete(root);
-                free(str);
-                str = NULL;
-                return RET_ERR;
-            }
+    return RET_OK;
+}
 
-            prep_stmts->prep_stmt[i].param_markers_count = cjson_parameter_count;
-            prep_stmts->prep_stmt[i].params[j] = (PstParameter*)malloc(prep_stmts->prep_stmt[i].param_markers_count * sizeof(PstParameter));
-            if (!prep_stmts->prep_stmt[i].params[j]) {
-                log_error(PST_FORMAT_MSG_ERR_ALLOC, "parameter");
-                cJSON_Delete(root);
-                free(str);
-                str = NULL;
-                return RET_ERR;
-            }
-            memset(prep_stmts->prep_stmt[i].params[j], 0, prep_stmts->prep_stmt[i].param_markers_count * sizeof(PstParameter));
-
-            for (int k = 0; k < cjson_parameter_count; k++) {
-                cjson_parameter_item = cJSON_GetArrayItem(cjson_parameter, k);
-                if (!cJSON_IsObject(cjson_parameter_item)) {
-                    log_error("parameter is not an object");
-                    cJSON_Delete(root);
-                    free(str);
-                    str = NULL;
-                    return RET_ERR;
-                }
+int pst_parse_SetupStatements() {
+    for (unsigned long i = 0; i < prep_stmts->prep_stmt_size; i++) {
+        if (SetupStatement(i) != RET_OK) {
+            return RET_ERR;
+        }
+    }
+    g_setup = true;
 
-                cjson_parameter_item_type = cJSON_GetObjectItemCaseSensitive(cjson_parameter_item, "type");
-                if (!cJSON_IsString(cjson_parameter_item_type) && cjson_parameter_item_type->valuestring == NULL) {
-                    log_error("type is not found or is null");
-                    cJSON_Delete(root);
-                    free(str);
-                    str = NULL;
-                    return RET_ERR;
-                }
-                log_debug("type: %s", cjson_parameter_item_type->valuestring);
+    return RET_OK;
+}
 
-                memcpy(prep_stmts->prep_stmt[i].params[j][k].type, cjson_parameter_item_type->valuestring, strlen(cjson_parameter_item_type->valuestring));
+void pst_parse_StreamParameters() {
+    g_stream_parameters = true;
+}
 
-                cjson_parameter_item_unsigned = cJSON_GetObjectItemCaseSensitive(cjson_parameter_item, "unsigned");
-                if (cJSON_IsTrue(cjson_parameter_item_unsigned)) {
-                    prep_stmts->prep_stmt[i].params[j][k].is_unsigned = true;
-                } else {
-                    prep_stmts->prep_stmt[i].params[j][k].is_unsigned = false;
-                }
-                log_debug("unsigned: %s", prep_stmts->prep_stmt[i].params[j][k].is_unsigned ? "true" : "false");
-
-                cjson_parameter_item_value = cJSON_GetObjectItemCaseSensitive(cjson_parameter_item, "value");
-                if (cJSON_IsString(cjson_parameter_item_value) && cjson_parameter_item_value->valuestring != NULL) {
-                    log_debug("value: %s", cjson_parameter_item_value->valuestring);
-                    prep_stmts->prep_stmt[i].params[j][k].valuestring = malloc(strlen(cjson_parameter_item_value->valuestring) + 1);
-                    if (!prep_stmts->prep_stmt[i].params[j][k].valuestring) {
-                        log_error(PST_FORMAT_MSG_ERR_ALLOC, "parameter value");
-                        cJSON_Delete(root);
-                        free(str);
-                        str = NULL;
-                        return RET_ERR;
-                    }
-                    memset(prep_stmts->prep_stmt[i].params[j][k].valuestring, 0, strlen(cjson_parameter_item_value->valuestring) + 1);
-                    memcpy(prep_stmts->prep_stmt[i].params[j][k].valuestring, cjson_parameter_item_value->valuestring, strlen(cjson_parameter_item_value->valuestring));
-                } else if (cJSON_IsNumber(cjson_parameter_item_value)) {
-                    log_debug("value: %lf", cjson_parameter_item_value->valuedouble);
-                    prep_stmts->prep_stmt[i].params[j][k].valuedouble = cjson_parameter_item_value->valuedouble;
-                } else {
-                    log_error("value is not found or is null");
-                    cJSON_Delete(root);
-                    free(str);
-                    str = NULL;
-                    return RET_ERR;
-                }
+const char* pst_parse_GetSkeleton(size_t* size) {
+    *size = g_skeleton_size;
+    return g_skeleton;
+}
 
-            }
-        }
+int pst_parse_ParseExpectations(const char* filename) {
+    free(g_expect_file);
+    g_expect_file = strdup(filename);
+    if (g_expect_file == NULL) {
+        log_error(PST_FORMAT_MSG_ERR_ALLOC, "filename");
+        return RET_ERR;
     }
 
-    cJSON_Delete(root);
-    free(str);
-    str = NULL;
-
-    return RET_OK;
+    return ApplyExpectations(filename, 0);
 }
 
 PstConnection* pst_parse_GetConnection() {
     return conn;
 }
 
+PstScenario* pst_parse_GetScenario() {
+    return scenario;
+}
+
 
 PstPreparedStatements* pst_parse_GetPreparedStatement() {
     return prep_stmts;
@@ -318,6 +349,12 @@ void pst_parse_Free() {
         conn = NULL;
     }
 
+    /* free scenario memory */
+    if (scenario) {
+        free(scenario);
+        scenario = NULL;
+    }
+
     /* free prepared statement memory */
     if (prep_stmts) {
         if (prep_stmts->prep_stmt) {
@@ -327,19 +364,13 @@ void pst_parse_Free() {
                     prep_stmts->prep_stmt[i].stmt = NULL;
                 }
                 for (int j = 0; j < prep_stmts->prep_stmt[i].params_size; j++) {
-                    if (prep_stmts->prep_stmt[i].params[j]) {
-                        for (int k = 0; k < prep_stmts->prep_stmt[i].param_markers_count; k++) {
-                            if (prep_stmts->prep_stmt[i].params[j][k].valuestring) {
-                                free(prep_stmts->prep_stmt[i].params[j][k].valuestring);
-                                prep_stmts->prep_stmt[i].params[j][k].valuestring = NULL;
-                            }
-                        }
-                        free(prep_stmts->prep_stmt[i].params[j]);
-                        prep_stmts->prep_stmt[i].params[j] = NULL;
-                    }
+                    pst_stream_FreeParameters(prep_stmts->prep_stmt[i].params[j], prep_stmts->prep_stmt[i].param_markers_count);
+                    prep_stmts->prep_stmt[i].params[j] = NULL;
                 }
                 free(prep_stmts->prep_stmt[i].params);
                 prep_stmts->prep_stmt[i].params = NULL;
+                free(prep_stmts->prep_stmt[i].expects);
+                prep_stmts->prep_stmt[i].expects = NULL;
             }
             free(prep_stmts->prep_stmt);
             prep_stmts->prep_stmt = NULL;
@@ -347,59 +378,603 @@ void pst_parse_Free() {
         free(prep_stmts);
         prep_stmts = NULL;
     }
+
+    /* free the streamed files */
+    if (g_file) {
+        pst_UnmapFile(g_file, g_file_size, g_file_mapped);
+        g_file = NULL;
+    }
+    CloseStreams();
+    free(g_skeleton);
+    g_skeleton = NULL;
+    g_skeleton_size = 0;
+    free(g_filename);
+    g_filename = NULL;
+    free(g_expect_file);
+    g_expect_file = NULL;
+    g_scan_stopped = false;
+    g_setup = false;
 }
 
 
 /* static functions */
-static char* ReadLine(FILE* file, char* buffer) {
-    if (buffer) {
-        free(buffer);
-        buffer = NULL;
-    }
-    int buffer_size = 1024;
-    buffer = (char*)malloc(buffer_size);
-    if (!buffer) {
-        log_error(PST_FORMAT_MSG_ERR_ALLOC, "file buffer");
+/* cJSON tree of str, NULL with the place of the error logged */
+static cJSON* ParseText(const char* str, size_t str_len) {
+    cJSON* root = cJSON_ParseWithLength(str, str_len);
+    if (root == NULL) {
+        const char* error_ptr = cJSON_GetErrorPtr();
+        if (error_ptr != NULL) {
+            size_t rest = str_len - (size_t)(error_ptr - str);
+            log_error("Error before: %.*s\n", (int)(rest < 64 ? rest : 64), error_ptr);
+        }
+    }
+
+    return root;
+}
+
+/**
+ *  One element of "prepared_statement" into prep_stmts->prep_stmt[index],
+ *  with its parameter sets from g_streams[index], a parameter_file or the
+ *  compiled scenario.
+ */
+static int ParseStatement(const cJSON* cjson_prepared_statement, unsigned long index, const PstCompiledHeader* compiled) {
+    PstPreparedStatement* prep_stmt = &prep_stmts->prep_stmt[index];
+    if (!cJSON_IsObject(cjson_prepared_statement)) {
+        log_error("prepared_statement is not an object");
+        return RET_ERR;
+    }
+
+    cJSON* cjson_statement = cJSON_GetObjectItemCaseSensitive(cjson_prepared_statement, "statement");
+    if (!cJSON_IsString(cjson_statement) && cjson_statement->valuestring == NULL) {
+        log_error("statement is not found or is null");
+        return RET_ERR;
+    }
+    log_debug("statement: %s", cjson_statement->valuestring);
+
+    prep_stmt->stmt = (char*)malloc(strlen(cjson_statement->valuestring) + 1);
+    if (!prep_stmt->stmt) {
+        log_error(PST_FORMAT_MSG_ERR_ALLOC, "prepared statement");
+        return RET_ERR;
+    }
+    memset(prep_stmt->stmt, 0, strlen(cjson_statement->valuestring) + 1);
+    memcpy(prep_stmt->stmt, cjson_statement->valuestring, strlen(cjson_statement->valuestring));
+    prep_stmt->stmt_len = strlen(prep_stmt->stmt);
+    prep_stmt->syntax = pst_GetSyntax(prep_stmt->stmt);
+    log_debug("syntax: %d", prep_stmt->syntax);
+
+    if (ParseStatementOptions(cjson_prepared_statement, prep_stmt) != RET_OK) {
+        return RET_ERR;
+    }
+
+    cJSON* cjson_parameters = cJSON_GetObjectItemCaseSensitive(cjson_prepared_statement, "parameter");
+    cJSON* cjson_parameter_file = cJSON_GetObjectItemCaseSensitive(cjson_prepared_statement, "parameter_file");
+    PstParamStream* stream = NULL;
+    if (compiled != NULL) {
+        OpenCompiled(compiled, index, prep_stmt);
+    } else if (cjson_parameter_file != NULL) {
+        if (!cJSON_IsString(cjson_parameter_file) || cjson_parameters != NULL) {
+            log_error("parameter_file must be a file name, given instead of parameter");
+            return RET_ERR;
+        }
+        if (OpenParameterFile(g_filename, cjson_prepared_statement, &g_streams[index]) != RET_OK) {
+            return RET_ERR;
+        }
+        stream = &g_streams[index];
+    } else if (!cJSON_IsArray(cjson_parameters)) {
+        log_error("parameter is not found or is null");
+        return RET_ERR;
+    } else if (g_streams[index].begin != NULL) {
+        /* cut out as [] by CutParameters, empty when it really is */
+        stream = &g_streams[index];
+    }
+    if (stream != NULL && LoadParameters(stream, prep_stmt) != RET_OK) {
+        return RET_ERR;
+    }
+
+    return ParseExpectations(cjson_prepared_statement, prep_stmt, true);
+}
+
+/**
+ *  root is the rest of the document read by pst_parse_ReadMore: the
+ *  members of statement index after its parameter array, as the only
+ *  element of "prepared_statement" but for the statements after it. They
+ *  are appended and set up like the statements read at startup.
+ */
+static int ReadStatements(const cJSON* root, unsigned long index) {
+    const cJSON* cjson_prepared_statements = root->child;
+    const cJSON* cjson_prepared_statement = cjson_prepared_statements->child;
+    if (cjson_prepared_statements->next != NULL || cjson_prepared_statement->child->next != NULL) {
+        log_error("Statement[%lu]: members after its parameter array and root members after prepared_statement "
+            "are read once the run has started, give them before the array with stream_parameters", index);
+        return RET_ERR;
+    }
+
+    unsigned long first = prep_stmts->prep_stmt_size;
+    unsigned long size = first + (unsigned long)cJSON_GetArraySize(cjson_prepared_statements) - 1;
+    if (size == first) {
+        return RET_OK;
+    }
+    PstPreparedStatement* prep_stmt = (PstPreparedStatement*)realloc(prep_stmts->prep_stmt, size * sizeof(PstPreparedStatement));
+    if (prep_stmt == NULL) {
+        log_error(PST_FORMAT_MSG_ERR_ALLOC, "prepared statement");
+        return RET_ERR;
+    }
+    memset(prep_stmt + first, 0, (size - first) * sizeof(PstPreparedStatement));
+    prep_stmts->prep_stmt = prep_stmt;
+    if (GrowStreams(size) != RET_OK) {
+        return RET_ERR;
+    }
+
+    for (unsigned long i = first; i < size; i++) {
+        cjson_prepared_statement = cjson_prepared_statement->next;
+        prep_stmts->prep_stmt_size = i + 1;
+        if (ParseStatement(cjson_prepared_statement, i, NULL) != RET_OK) {
+            return RET_ERR;
+        }
+    }
+    log_info("Read Statement[%lu] to Statement[%lu] after the run started.", first, size - 1);
+
+    if (g_expect_file != NULL && ApplyExpectations(g_expect_file, first) != RET_OK) {
+        return RET_ERR;
+    }
+    for (unsigned long i = first; g_setup && i < size; i++) {
+        if (SetupStatement(i) != RET_OK) {
+            return RET_ERR;
+        }
+    }
+
+    return RET_OK;
+}
+
+/**
+ *  Command line options and verification of statement index, see
+ *  pst_parse_SetupStatements. The event engine receives results over the
+ *  text protocol and counts them, the options that choose how they are
+ *  fetched, kept or printed can not be honoured there.
+ */
+static int SetupStatement(unsigned long index) {
+    PstPreparedStatement* prep_stmt = &prep_stmts->prep_stmt[index];
+    if (scenario->fetch_mode != PstFetchMode_Unknown) {
+        prep_stmt->fetch_mode = scenario->fetch_mode;
+    }
+    if (scenario->prefetch_rows > 0) {
+        prep_stmt->prefetch_rows = scenario->prefetch_rows;
+    }
+    if (scenario->layout != PstLayout_Unknown) {
+        prep_stmt->layout = scenario->layout;
+    }
+    if (scenario->zero_copy) {
+        prep_stmt->zero_copy = true;
+    }
+    if (scenario->result_mode != PstResultMode_Unknown) {
+        prep_stmt->result_mode = scenario->result_mode;
+    }
+
+    /* results are verified by their digest, which the event engine does not compute */
+    bool verify = scenario->record || pst_verify_HasExpectations(prep_stmt);
+    if (verify) {
+        prep_stmt->result_mode = PstResultMode_Digest;
+    }
+    if (scenario->engine != PstEngine_Event) {
+        return RET_OK;
+    }
+
+    if (verify && scenario->record) {
+        log_error("--record needs the thread engine, the event engine computes no digests.");
+        return RET_ERR;
+    }
+    if (verify) {
+        log_error("Expectations in '%s' need the thread engine, the event engine computes no digests.",
+            g_expect_file != NULL ? g_expect_file : g_filename);
+        return RET_ERR;
+    }
+
+    const char* option = NULL;
+    if (prep_stmt->fetch_mode != PstFetchMode_Buffered) {
+        option = "fetch stream or cursor";
+    } else if (prep_stmt->layout != PstLayout_Rows) {
+        option = "layout columns";
+    } else if (prep_stmt->zero_copy) {
+        option = "zero_copy";
+    } else if (prep_stmt->result_mode != PstResultMode_Table) {
+        option = "result_mode digest";
+    }
+    if (option != NULL) {
+        log_error("Statement[%lu]: %s is not supported by the event engine", index, option);
+        return RET_ERR;
+    }
+
+    return RET_OK;
+}
+
+/**
+ *  A copy of the document with the "parameter" array of every element of
+ *  "prepared_statement" replaced by [], the text of the array is left in
+ *  g_streams[i] for pst_stream_Next. Only the brackets and strings are
+ *  followed here, whatever is kept is checked by cJSON.
+ *  A streamed run may start before the rest of the document is read: with
+ *  "stream_parameters": true and the connection given before the list,
+ *  the scan stops at the first array that comes after the "statement" of
+ *  its element, see CutStatement.
+ */
+static char* CutParameters(const char* data, size_t size, size_t* length) {
+    const char* end = data + size;
+    PstSkeleton skeleton;
+    memset(&skeleton, 0, sizeof(PstSkeleton));
+    skeleton.copied = data;
+
+    /* values are skipped without being looked at, the parameter arrays */
+    /* are cut out as they are found; broken text is left to cJSON */
+    bool streamed = false;
+    unsigned int required = 0;
+    for (unsigned int k = 0; g_connection_members[k] != NULL; k++) {
+        required |= 1u << k;
+    }
+    unsigned int given = 0;
+    const char* p = pst_stream_SkipSpace(data, end);
+    p = p < end && *p == '{' ? p + 1 : NULL;
+    const char* key = NULL;
+    while (p != NULL && NextMember(&p, end, &key) && !IsKey(key, "prepared_statement")) {
+        if (IsKey(key, "stream_parameters")) {
+            streamed = end - p >= 4 && memcmp(p, "true", 4) == 0;
+        }
+        for (unsigned int k = 0; g_connection_members[k] != NULL; k++) {
+            given |= IsKey(key, g_connection_members[k]) ? 1u << k : 0;
+        }
+        p = pst_stream_SkipValue(p, end);
+    }
+
+    /* compile reads every array */
+    g_scan_stopped = false;
+    g_scan_stop = streamed && !g_stream_parameters && given == required;
+    int ret = RET_OK;
+    if (key != NULL && *p == '[') {
+        ret = CutStatements(&skeleton, p + 1, end, 0);
+    }
+    if (ret == RET_OK && !g_scan_stopped) {
+        ret = KeepUntil(&skeleton, end);
+    }
+    if (ret != RET_OK) {
+        free(skeleton.str);
         return NULL;
     }
-    memset(buffer, 0, buffer_size);
 
-    int position = 0;
-    int c;
+    *length = skeleton.used;
+    return skeleton.str;
+}
 
-    while ((c = fgetc(file)) != EOF) {
-        /* if c is a line break, break the loop */
-        if (c == '\n') {
+/**
+ *  p after the opening bracket of "prepared_statement" or after the comma
+ *  before its element index, the statement objects from there are passed
+ *  to CutStatement.
+ */
+static int CutStatements(PstSkeleton* skeleton, const char* p, const char* end, unsigned long index) {
+    for (; p != NULL; index++) {
+        p = pst_stream_SkipSpace(p, end);
+        if (p == end || *p == ']') {
+            break;
+        }
+        if (*p != '{') {
+            p = pst_stream_SkipValue(p, end);
+        } else {
+            p++;
+            if (CutStatement(skeleton, &p, end, index, false) != RET_OK) {
+                return RET_ERR;
+            }
+        }
+        if (p == NULL) {
             break;
         }
+        p = pst_stream_SkipSpace(p, end);
+        p = p < end && *p == ',' ? p + 1 : NULL;
+    }
+
+    return RET_OK;
+}
+
+/**
+ *  *p after the opening brace of an object or after the value of a member.
+ *  Moves *p to the value of the next member and *key to the opening quote
+ *  of its name. false after the closing brace, with *p past it, or with *p
+ *  NULL when the text is broken, *key is NULL then.
+ */
+static bool NextMember(const char** p, const char* end, const char** key) {
+    *key = NULL;
+    const char* q = pst_stream_SkipSpace(*p, end);
+    if (q < end && *q == ',') {
+        q = pst_stream_SkipSpace(q + 1, end);
+    }
+    if (q < end && *q == '}') {
+        *p = q + 1;
+        return false;
+    }
+
+    const char* key_end = q < end && *q == '"' ? pst_stream_SkipString(q, end) : NULL;
+    const char* colon = key_end != NULL ? pst_stream_SkipSpace(key_end, end) : NULL;
+    if (colon == NULL || colon == end || *colon != ':') {
+        *p = NULL;
+        return false;
+    }
 
-        /* add c to buffer */
-        buffer[position++] = c;
+    *p = pst_stream_SkipSpace(colon + 1, end);
+    if (*p == end) {
+        *p = NULL;
+        return false;
+    }
+    *key = q;
+
+    return true;
+}
 
-        /* check if buffer is full */
-        if (position >= buffer_size) {
-            buffer_size *= 2; /* add buffer size */
-            char* new_buffer = (char*)realloc(buffer, buffer_size);
-            if (!new_buffer) {
-                free(buffer); /* free old buffer */
-                log_error(PST_FORMAT_MSG_ERR_ALLOC, "file buffer");
-                return NULL;
+/* key at the opening quote of a member name found by NextMember */
+static bool IsKey(const char* key, const char* name) {
+    size_t name_len = strlen(name);
+    return strncmp(key + 1, name, name_len) == 0 && key[name_len + 1] == '"';
+}
+
+/**
+ *  *p after the opening brace of a statement object, or after its array
+ *  with cut, moved past the object or to NULL when the text is broken.
+ *  Its "parameter" array is opened as g_streams[index] and kept as [],
+ *  RET_ERR when out of memory. With g_scan_stop an array after the
+ *  "statement" member is not read: the element, the list and the root
+ *  are closed right after it, *p is NULL and the rest is left to
+ *  pst_parse_ReadMore.
+ */
+static int CutStatement(PstSkeleton* skeleton, const char** p, const char* end, unsigned long index, bool cut) {
+    const char* q = *p;
+    const char* key = NULL;
+    bool statement = false;
+    while (q != NULL && NextMember(&q, end, &key)) {
+        statement = statement || IsKey(key, "statement");
+        if (!IsKey(key, "parameter") || cut || *q != '[') {
+            q = pst_stream_SkipValue(q, end);
+            continue;
+        }
+
+        if (GrowStreams(index + 1) != RET_OK || KeepUntil(skeleton, q) != RET_OK) {
+            return RET_ERR;
+        }
+        if (g_scan_stop && statement) {
+            /* the sets are read by the run, which starts right away */
+            pst_stream_OpenUnread(&g_streams[index], q, end, g_file_mapped);
+            g_scan_stopped = true;
+            g_scan_index = index;
+            q = NULL;
+            if (KeepText(skeleton, "[]}]}") != RET_OK) {
+                return RET_ERR;
             }
-            memset(new_buffer + position, 0, buffer_size - position);
-            buffer = new_buffer;
+            break;
+        }
+
+        const char* params_end = pst_stream_Open(&g_streams[index], q, end, g_file_mapped);
+        if (params_end == NULL) {
+            g_streams[index].begin = NULL;
+            q = NULL;
+            break;
+        }
+        if (KeepText(skeleton, "[]") != RET_OK) {
+            return RET_ERR;
         }
+        skeleton->copied = params_end;
+
+        cut = true;
+        q = params_end;
     }
 
-    /* if buffer is empty and EOF, return NULL */
-    if (position == 0 && c == EOF) {
-        free(buffer);
-        return NULL;
+    *p = q;
+    return RET_OK;
+}
+
+/* Copies the document from skeleton->copied up to to */
+static int KeepUntil(PstSkeleton* skeleton, const char* to) {
+    size_t size = to - skeleton->copied;
+    if (Reserve(skeleton, size) != RET_OK) {
+        return RET_ERR;
+    }
+    memcpy(skeleton->str + skeleton->used, skeleton->copied, size);
+    skeleton->used += size;
+    skeleton->copied = to;
+
+    return RET_OK;
+}
+
+static int KeepText(PstSkeleton* skeleton, const char* text) {
+    size_t size = strlen(text);
+    if (Reserve(skeleton, size) != RET_OK) {
+        return RET_ERR;
+    }
+    memcpy(skeleton->str + skeleton->used, text, size);
+    skeleton->used += size;
+
+    return RET_OK;
+}
+
+/* Room for size more characters, doubled as the kept text grows */
+static int Reserve(PstSkeleton* skeleton, size_t size) {
+    if (skeleton->used + size <= skeleton->size) {
+        return RET_OK;
+    }
+
+    size_t capacity = skeleton->size == 0 ? PST_SKELETON_SIZE : skeleton->size;
+    while (capacity < skeleton->used + size) {
+        capacity *= 2;
+    }
+    char* str = (char*)realloc(skeleton->str, capacity);
+    if (str == NULL) {
+        log_error(PST_FORMAT_MSG_ERR_ALLOC, "string buffer");
+        return RET_ERR;
+    }
+    skeleton->str = str;
+    skeleton->size = capacity;
+
+    return RET_OK;
+}
+
+/* g_streams for size statements, the statements are pointed at the moved streams */
+static int GrowStreams(unsigned long size) {
+    if (g_streams_size >= size) {
+        return RET_OK;
+    }
+
+    PstParamStream* streams = (PstParamStream*)realloc(g_streams, size * sizeof(PstParamStream));
+    if (streams == NULL) {
+        log_error(PST_FORMAT_MSG_ERR_ALLOC, "parameter");
+        return RET_ERR;
+    }
+    memset(streams + g_streams_size, 0, (size - g_streams_size) * sizeof(PstParamStream));
+    for (unsigned long i = 0; i < prep_stmts->prep_stmt_size; i++) {
+        if (prep_stmts->prep_stmt[i].params_stream != NULL) {
+            prep_stmts->prep_stmt[i].params_stream = &streams[i];
+        }
+    }
+    g_streams = streams;
+    g_streams_size = size;
+
+    return RET_OK;
+}
+
+/**
+ *  With stream_parameters the statement reads its sets while it runs,
+ *  only the first one is parsed here for the number of markers and to
+ *  show errors before the run. Otherwise all sets are parsed into params.
+ */
+static int LoadParameters(PstParamStream* stream, PstPreparedStatement* prep_stmt) {
+    unsigned long count = PST_STREAM_ANY_COUNT;
+    PstParameter* param = NULL;
+
+    if (scenario->stream_parameters) {
+        if (pst_stream_Peek(stream, &count) != RET_OK) {
+            return RET_ERR;
+        }
+        if (count != PST_STREAM_ANY_COUNT) {
+            prep_stmt->param_markers_count = count;
+            prep_stmt->params_stream = stream;
+        }
+        return RET_OK;
+    }
+
+    unsigned long capacity = 0;
+    while (true) {
+        if (pst_stream_Next(stream, &param, &count) != RET_OK) {
+            return RET_ERR;
+        }
+        if (param == NULL) {
+            break;
+        }
+
+        if (prep_stmt->params_size == capacity) {
+            capacity = capacity == 0 ? 16 : capacity * 2;
+            PstParameter** params = (PstParameter**)realloc(prep_stmt->params, capacity * sizeof(PstParameter*));
+            if (params == NULL) {
+                log_error(PST_FORMAT_MSG_ERR_ALLOC, "parameter");
+                pst_stream_FreeParameters(param, count);
+                return RET_ERR;
+            }
+            prep_stmt->params = params;
+        }
+        prep_stmt->params[prep_stmt->params_size++] = param;
+        prep_stmt->param_markers_count = count;
+    }
+
+    return RET_OK;
+}
+
+/**
+ *  parameter_file is relative to the directory of the scenario file. Its
+ *  parameter_format comes from the extension when it is not given, CSV and
+ *  TSV take the types of their fields from columns.
+ */
+static int OpenParameterFile(const char* filename, const cJSON* cjson_prepared_statement, PstParamStream* stream) {
+    const char* name = cJSON_GetObjectItemCaseSensitive(cjson_prepared_statement, "parameter_file")->valuestring;
+    const char* extension = strrchr(name, '.');
+    PstParamFormat format = extension != NULL ? pst_ToParamFormat(extension + 1) : PstParamFormat_Unknown;
+    if (format == PstParamFormat_Unknown) {
+        format = PstParamFormat_Ndjson;
+    }
+
+    const cJSON* cjson_format = cJSON_GetObjectItemCaseSensitive(cjson_prepared_statement, "parameter_format");
+    if (cjson_format != NULL) {
+        format = pst_ToParamFormat(cJSON_GetStringValue(cjson_format));
+        if (format == PstParamFormat_Unknown) {
+            log_error("parameter_format must be ndjson, csv or tsv");
+            return RET_ERR;
+        }
+    }
+    log_debug("parameter_format: %d", format);
+
+    const cJSON* cjson_columns = cJSON_GetObjectItemCaseSensitive(cjson_prepared_statement, "columns");
+    if ((format == PstParamFormat_Ndjson) != (cjson_columns == NULL)) {
+        log_error("columns must be given for a CSV or TSV parameter_file, and only for it");
+        return RET_ERR;
+    }
+
+    char path[1024];
+    const char* slash = strrchr(filename, '/');
+    if (name[0] == '/' || strcmp(name, "-") == 0 || slash == NULL) {
+        snprintf(path, sizeof(path), "%s", name);
+    } else {
+        snprintf(path, sizeof(path), "%.*s/%s", (int)(slash - filename), filename, name);
+    }
+    log_debug("parameter_file: %s", path);
+
+    if (pst_stream_OpenFile(stream, path) != RET_OK) {
+        return RET_ERR;
+    }
+    if (format != PstParamFormat_Ndjson) {
+        return ParseColumns(cjson_columns, stream, format == PstParamFormat_Csv ? ',' : '\t');
+    }
+
+    return RET_OK;
+}
+
+/* "columns": [{"type": "int", "unsigned": true}, {"type": "varchar"}] */
+static int ParseColumns(const cJSON* cjson_columns, PstParamStream* stream, char delimiter) {
+    int cjson_columns_size = cJSON_GetArraySize(cjson_columns);
+    if (!cJSON_IsArray(cjson_columns) || cjson_columns_size == 0) {
+        log_error("columns is not found or is null");
+        return RET_ERR;
     }
 
-    /* add terminator to buffer */
-    buffer[position] = '\0';
+    PstParameter* columns = (PstParameter*)calloc(cjson_columns_size, sizeof(PstParameter));
+    if (columns == NULL) {
+        log_error(PST_FORMAT_MSG_ERR_ALLOC, "columns");
+        return RET_ERR;
+    }
+
+    unsigned long k = 0;
+    const cJSON* cjson_column = NULL;
+    cJSON_ArrayForEach(cjson_column, cjson_columns) {
+        if (pst_stream_ParseType(cjson_column, &columns[k]) != RET_OK) {
+            free(columns);
+            return RET_ERR;
+        }
+        k++;
+    }
+    pst_stream_SetColumns(stream, delimiter, columns, k);
+
+    return RET_OK;
+}
+
+/* Sets of statement index in the mapped compiled scenario, nothing is read */
+static void OpenCompiled(const PstCompiledHeader* header, unsigned long index, PstPreparedStatement* prep_stmt) {
+    const PstCompiledStatement* compiled_stmt = (const PstCompiledStatement*)(header + 1) + index;
+    prep_stmt->param_markers_count = compiled_stmt->param_markers_count;
+    log_debug("compiled parameter sets: %lu", (unsigned long)compiled_stmt->sets_size);
+    if (compiled_stmt->sets_size > 0) {
+        pst_stream_OpenCompiled(&g_streams[index], g_file + compiled_stmt->sets_offset,
+            g_file + compiled_stmt->sets_end, compiled_stmt->sets_size, g_file_mapped);
+        prep_stmt->params_stream = &g_streams[index];
+    }
+}
 
-    return buffer;
+static void CloseStreams() {
+    for (unsigned long i = 0; i < g_streams_size; i++) {
+        pst_stream_Close(&g_streams[i]);
+    }
+    free(g_streams);
+    g_streams = NULL;
+    g_streams_size = 0;
 }
 
 static int InitBuffer() {
@@ -410,6 +985,19 @@ static int InitBuffer() {
     }
     memset(conn, 0, sizeof(PstConnection));
 
+    scenario = (PstScenario*)malloc(sizeof(PstScenario));
+    if (!scenario) {
+        log_error(PST_FORMAT_MSG_ERR_ALLOC, "scenario");
+        return RET_ERR;
+    }
+    memset(scenario, 0, sizeof(PstScenario));
+    scenario->concurrency = 1;
+    scenario->engine = PstEngine_Thread;
+    scenario->event_loops = 1;
+    scenario->fetch_mode = PstFetchMode_Unknown;
+    scenario->layout = PstLayout_Unknown;
+    scenario->result_mode = PstResultMode_Unknown;
+
     prep_stmts = (PstPreparedStatements*)malloc(sizeof(PstPreparedStatements));
     if (!prep_stmts) {
         log_error(PST_FORMAT_MSG_ERR_ALLOC, "prepared statement");
@@ -420,3 +1008,238 @@ static int InitBuffer() {
     return RET_OK;
 }
 
+/* Leaves value untouched if name is absent, fails if present but not a number >= min */
+static int GetOptionalNumber(const cJSON* object, const char* name, double min, double* value) {
+    cJSON* cjson_item = cJSON_GetObjectItemCaseSensitive(object, name);
+    if (cjson_item == NULL) {
+        return RET_OK;
+    }
+
+    if (!cJSON_IsNumber(cjson_item) || cjson_item->valuedouble < min) {
+        log_error("%s must be a number not less than %g", name, min);
+        return RET_ERR;
+    }
+
+    *value = cjson_item->valuedouble;
+    return RET_OK;
+}
+
+/* Leaves buffer untouched if name is absent, fails if present but not a string fitting in buffer */
+static int GetOptionalString(const cJSON* object, const char* name, char* buffer, size_t size) {
+    cJSON* cjson_item = cJSON_GetObjectItemCaseSensitive(object, name);
+    if (cjson_item == NULL) {
+        return RET_OK;
+    }
+
+    if (!cJSON_IsString(cjson_item) || cjson_item->valuestring == NULL || strlen(cjson_item->valuestring) >= size) {
+        log_error("%s must be a string shorter than %zu characters", name, size);
+        return RET_ERR;
+    }
+
+    strcpy(buffer, cjson_item->valuestring);
+    return RET_OK;
+}
+
+static int GetOptionalBool(const cJSON* object, const char* name, bool* value) {
+    cJSON* cjson_item = cJSON_GetObjectItemCaseSensitive(object, name);
+    if (cjson_item == NULL) {
+        return RET_OK;
+    }
+
+    if (!cJSON_IsBool(cjson_item)) {
+        log_error("%s must be true or false", name);
+        return RET_ERR;
+    }
+
+    *value = cJSON_IsTrue(cjson_item);
+    return RET_OK;
+}
+
+static int ParseScenario(const cJSON* root) {
+    double concurrency = scenario->concurrency;
+    double iterations = scenario->iterations;
+    double duration_sec = scenario->duration_sec;
+    double rate = scenario->rate;
+    double event_loops = scenario->event_loops;
+    char engine[16] = "thread";
+    char output_format[16] = "table";
+
+    if (GetOptionalNumber(root, "concurrency", 1, &concurrency) != RET_OK ||
+        GetOptionalNumber(root, "iterations", 1, &iterations) != RET_OK ||
+        GetOptionalNumber(root, "duration_sec", 0, &duration_sec) != RET_OK ||
+        GetOptionalNumber(root, "rate", 0, &rate) != RET_OK ||
+        GetOptionalString(root, "hdr_log", scenario->hdr_log, sizeof(scenario->hdr_log)) != RET_OK ||
+        GetOptionalString(root, "engine", engine, sizeof(engine)) != RET_OK ||
+        GetOptionalNumber(root, "event_loops", 1, &event_loops) != RET_OK ||
+        GetOptionalString(root, "output_format", output_format, sizeof(output_format)) != RET_OK ||
+        GetOptionalBool(root, "async_output", &scenario->async_output) != RET_OK ||
+        GetOptionalBool(root, "stream_parameters", &scenario->stream_parameters) != RET_OK) {
+        return RET_ERR;
+    }
+
+    scenario->engine = pst_ToEngine(engine);
+    if (scenario->engine == PstEngine_Unknown) {
+        log_error("Unknown engine '%s', expected 'thread' or 'event'", engine);
+        return RET_ERR;
+    }
+
+    scenario->output_format = pst_ToOutputFormat(output_format);
+    if (scenario->output_format == PstOutputFormat_Unknown) {
+        log_error("Unknown output format '%s', expected 'table', 'csv', 'tsv' or 'ndjson'", output_format);
+        return RET_ERR;
+    }
+
+    scenario->concurrency = (unsigned int)concurrency;
+    scenario->iterations = (unsigned long)iterations;
+    scenario->duration_sec = duration_sec;
+    scenario->rate = rate;
+    scenario->event_loops = (unsigned int)event_loops;
+
+    log_debug("concurrency: %u, iterations: %lu, duration_sec: %lf, rate: %lf, engine: %d, event_loops: %u, output_format: %d, async_output: %d",
+        scenario->concurrency, scenario->iterations, scenario->duration_sec, scenario->rate,
+        scenario->engine, scenario->event_loops, scenario->output_format, scenario->async_output);
+
+    return RET_OK;
+}
+
+static int ParseStatementOptions(const cJSON* object, PstPreparedStatement* prep_stmt) {
+    char fetch_mode[16] = "buffered";
+    double prefetch_rows = 1;
+    char layout[16] = "rows";
+    char result_mode[16] = "table";
+
+    if (GetOptionalString(object, "fetch", fetch_mode, sizeof(fetch_mode)) != RET_OK ||
+        GetOptionalNumber(object, "prefetch_rows", 1, &prefetch_rows) != RET_OK ||
+        GetOptionalString(object, "layout", layout, sizeof(layout)) != RET_OK ||
+        GetOptionalBool(object, "zero_copy", &prep_stmt->zero_copy) != RET_OK ||
+        GetOptionalString(object, "result_mode", result_mode, sizeof(result_mode)) != RET_OK) {
+        return RET_ERR;
+    }
+
+    prep_stmt->fetch_mode = pst_ToFetchMode(fetch_mode);
+    if (prep_stmt->fetch_mode == PstFetchMode_Unknown) {
+        log_error("Unknown fetch mode '%s', expected 'buffered', 'stream' or 'cursor'", fetch_mode);
+        return RET_ERR;
+    }
+    prep_stmt->prefetch_rows = (unsigned long)prefetch_rows;
+
+    prep_stmt->layout = pst_ToLayout(layout);
+    if (prep_stmt->layout == PstLayout_Unknown) {
+        log_error("Unknown layout '%s', expected 'rows' or 'columns'", layout);
+        return RET_ERR;
+    }
+
+    prep_stmt->result_mode = pst_ToResultMode(result_mode);
+    if (prep_stmt->result_mode == PstResultMode_Unknown) {
+        log_error("Unknown result mode '%s', expected 'table' or 'digest'", result_mode);
+        return RET_ERR;
+    }
+
+    log_debug("fetch: %d, prefetch_rows: %lu, layout: %d, zero_copy: %d, result_mode: %d",
+        prep_stmt->fetch_mode, prep_stmt->prefetch_rows, prep_stmt->layout, prep_stmt->zero_copy, prep_stmt->result_mode);
+
+    return RET_OK;
+}
+
+/* Expectations of the sidecar for the statements from first on */
+static int ApplyExpectations(const char* filename, unsigned long first) {
+    size_t size = 0;
+    bool mapped = false;
+    char* str = pst_MapFile(filename, &size, &mapped);
+    if (str == NULL) {
+        return RET_ERR;
+    }
+
+    cJSON* root = cJSON_ParseWithLength(str, size);
+    pst_UnmapFile(str, size, mapped);
+    if (root == NULL) {
+        log_error("Can not parse expectations file '%s'", filename);
+        return RET_ERR;
+    }
+
+    int ret = RET_OK;
+    cJSON* cjson_prepared_statements = cJSON_GetObjectItemCaseSensitive(root, "prepared_statement");
+    for (unsigned long i = first; i < prep_stmts->prep_stmt_size && ret == RET_OK; i++) {
+        cJSON* cjson_prepared_statement = cJSON_GetArrayItem(cjson_prepared_statements, (int)i);
+        if (cjson_prepared_statement == NULL) {
+            break;
+        }
+
+        /* recorded for another statement file */
+        cJSON* cjson_statement = cJSON_GetObjectItemCaseSensitive(cjson_prepared_statement, "statement");
+        if (!cJSON_IsString(cjson_statement) || strcmp(cjson_statement->valuestring, prep_stmts->prep_stmt[i].stmt) != 0) {
+            log_warn("Expectations of statement %lu in '%s' are for another statement, ignored", i, filename);
+            continue;
+        }
+
+        ret = ParseExpectations(cjson_prepared_statement, &prep_stmts->prep_stmt[i], false);
+    }
+
+    cJSON_Delete(root);
+
+    return ret;
+}
+
+/* "expect": [ { "rows": N, "digest": "16 hex digits" }, ... ], entry j for */
+/* parameter set j, null for a parameter set without expectation. */
+/* Entries only fill unset expectations unless overwrite is true. */
+static int ParseExpectations(const cJSON* object, PstPreparedStatement* prep_stmt, bool overwrite) {
+    cJSON* cjson_expects = cJSON_GetObjectItemCaseSensitive(object, "expect");
+    if (cjson_expects != NULL && !cJSON_IsArray(cjson_expects)) {
+        log_error("expect must be an array with at most one entry per parameter set");
+        return RET_ERR;
+    }
+    unsigned long given = cjson_expects != NULL ? (unsigned long)cJSON_GetArraySize(cjson_expects) : 0;
+
+    /* one per parameter set in the order the sets are read; the sets of a */
+    /* streamed or compiled statement are not counted in advance, it keeps */
+    /* as many as are given and pst_verify_Check adds the recorded ones */
+    unsigned long expects_size = prep_stmt->params_size > 0 ? prep_stmt->params_size : 1;
+    if (prep_stmt->params_stream != NULL) {
+        expects_size = given > prep_stmt->expects_size ? given : prep_stmt->expects_size;
+    } else if (given > expects_size) {
+        log_error("expect must be an array with at most one entry per parameter set");
+        return RET_ERR;
+    }
+    if (expects_size > prep_stmt->expects_size) {
+        PstExpect* expects = (PstExpect*)realloc(prep_stmt->expects, expects_size * sizeof(PstExpect));
+        if (expects == NULL) {
+            log_error(PST_FORMAT_MSG_ERR_ALLOC, "expect");
+            return RET_ERR;
+        }
+        memset(expects + prep_stmt->expects_size, 0, (expects_size - prep_stmt->expects_size) * sizeof(PstExpect));
+        prep_stmt->expects = expects;
+        prep_stmt->expects_size = expects_size;
+    }
+
+    if (cjson_expects == NULL) {
+        return RET_OK;
+    }
+
+    cJSON* cjson_expect = cjson_expects->child;
+    for (int j = 0; cjson_expect != NULL; j++, cjson_expect = cjson_expect->next) {
+        if (cJSON_IsNull(cjson_expect) || (prep_stmt->expects[j].is_set && !overwrite)) {
+            continue;
+        }
+
+        cJSON* cjson_rows = cJSON_GetObjectItemCaseSensitive(cjson_expect, "rows");
+        cJSON* cjson_digest = cJSON_GetObjectItemCaseSensitive(cjson_expect, "digest");
+        char* end = NULL;
+        if (!cJSON_IsNumber(cjson_rows) || cjson_rows->valuedouble < 0 ||
+            !cJSON_IsString(cjson_digest) || strlen(cjson_digest->valuestring) != 16) {
+            log_error("expect needs rows and a digest of 16 hex digits");
+            return RET_ERR;
+        }
+        uint64_t digest = strtoull(cjson_digest->valuestring, &end, 16);
+        if (*end != '\0') {
+            log_error("Invalid digest '%s'", cjson_digest->valuestring);
+            return RET_ERR;
+        }
+
+        prep_stmt->expects[j].is_set = true;
+        prep_stmt->expects[j].rows = (uint64_t)cjson_rows->valuedouble;
+        prep_stmt->expects[j].digest = digest;
+    }
+
+    return RET_OK;
+}
@@ -1,70 +1,201 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/uio.h>
 
-
+#include "log.h"
 #include "pst_print.h"
 
+/* output is collected here and written with few large write calls */
+#define PST_PRINT_BUFFER_SIZE (256 * 1024)
+
+/* bytes the asynchronous writer can hold, a power of two */
+#define PST_PRINT_RING_SIZE (4 * 1024 * 1024)
+
+/* Writer of the rows of one output format */
+typedef struct PstFormatter {
+    void (*Begin)(const MYSQL_FIELD* fields, unsigned int field_count);
+    void (*Row)(const PstResult* row, unsigned int field_count);
+} PstFormatter;
+
 static void* g_stream;
+static PstOutputFormat g_format = PstOutputFormat_Table;
+/* fields of the result being written, for the NDJSON keys */
+static __thread const MYSQL_FIELD* g_fields = NULL;
+static int g_fd = -1;
+/* a terminal sees the output of every execution as soon as it is complete */
+static bool g_interactive = false;
+static char g_buffer[PST_PRINT_BUFFER_SIZE];
+static size_t g_used = 0;
+/* output of the calling thread goes here instead, see pst_print_BeginChunk */
+static __thread PstPrintChunk* g_chunk = NULL;
+
+/**
+ *  Asynchronous output stage. Whoever holds the print lock is the single
+ *  producer, it copies finished output into the ring; the writer thread is
+ *  the single consumer and writes it out. head and tail count bytes ever
+ *  pushed and written, either side sleeps on cond only when the ring is
+ *  full or empty. Time the producer waits for room is the backpressure.
+ */
+typedef struct PstPrintRing {
+    char* data;
+    atomic_size_t head;
+    atomic_size_t tail;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    atomic_bool producer_waiting;
+    atomic_bool writer_sleeping;
+    atomic_bool stop;
+    pthread_t thread;
+    bool started;
+    uint64_t blocked_ns;
+    unsigned long blocked_count;
+} PstPrintRing;
+
+static PstPrintRing g_ring = { .mutex = PTHREAD_MUTEX_INITIALIZER, .cond = PTHREAD_COND_INITIALIZER };
+
+static void WriteAll(const struct iovec* iov, int iovcnt);
+static void Output(const struct iovec* iov, int iovcnt);
+static void Drain();
+static void Push(const char* data, size_t length);
+static void WaitForRing(bool empty);
+static void* RunWriter(void* arg);
+static char* ReserveChunk(size_t length);
+static void Append(const char* data, size_t length);
+static void AppendRepeat(char c, size_t count);
+static void AppendPadded(const char* str, size_t width);
+static void Printf(const char* fmt, ...) __attribute__((format(printf, 1, 2)));
+static void VPrintf(const char* fmt, va_list args);
+static void Report(const char* fmt, ...) __attribute__((format(printf, 1, 2)));
+static void PrintValue(unsigned long i, PstFieldTypes type, bool is_unsigned, const void* data, unsigned long length);
+static void BeginCsv(const MYSQL_FIELD* fields, unsigned int field_count);
+static void PrintCsvRow(const PstResult* row, unsigned int field_count);
+static void BeginTsv(const MYSQL_FIELD* fields, unsigned int field_count);
+static void PrintTsvRow(const PstResult* row, unsigned int field_count);
+static void BeginNdjson(const MYSQL_FIELD* fields, unsigned int field_count);
+static void PrintNdjsonRow(const PstResult* row, unsigned int field_count);
+
+static const PstFormatter g_formatters[PstOutputFormat_Unknown] = {
+    /* the table is printed by pst_print_PrintResultSet */
+    [PstOutputFormat_Table] = { NULL, NULL },
+    [PstOutputFormat_Csv] = { BeginCsv, PrintCsvRow },
+    [PstOutputFormat_Tsv] = { BeginTsv, PrintTsvRow },
+    [PstOutputFormat_Ndjson] = { BeginNdjson, PrintNdjsonRow },
+};
 
 void pst_print_SetStream(void* stream) {
+    pst_print_Flush();
     g_stream = stream;
+    g_fd = fileno((FILE*)stream);
+    g_interactive = isatty(g_fd);
+}
+
+void pst_print_Flush() {
+    Drain();
+    if (g_ring.started) {
+        WaitForRing(true);
+    }
+}
+
+int pst_print_StartWriter() {
+    g_ring.data = (char*)malloc(PST_PRINT_RING_SIZE);
+    if (g_ring.data == NULL) {
+        log_error(PST_FORMAT_MSG_ERR_ALLOC, "output ring");
+        return RET_ERR;
+    }
+
+    /* anything printed so far goes out before the writer takes over */
+    pst_print_Flush();
+    fflush((FILE*)g_stream);
+
+    atomic_store(&g_ring.head, 0);
+    atomic_store(&g_ring.tail, 0);
+    atomic_store(&g_ring.stop, false);
+    if (pthread_create(&g_ring.thread, NULL, RunWriter, NULL) != 0) {
+        log_error("Failed to create output writer thread");
+        free(g_ring.data);
+        g_ring.data = NULL;
+        return RET_ERR;
+    }
+    g_ring.started = true;
+
+    return RET_OK;
+}
+
+void pst_print_StopWriter() {
+    if (!g_ring.started) {
+        return;
+    }
+
+    pst_print_Flush();
+    pthread_mutex_lock(&g_ring.mutex);
+    atomic_store(&g_ring.stop, true);
+    pthread_cond_broadcast(&g_ring.cond);
+    pthread_mutex_unlock(&g_ring.mutex);
+    pthread_join(g_ring.thread, NULL);
+
+    g_ring.started = false;
+    free(g_ring.data);
+    g_ring.data = NULL;
+}
+
+void pst_print_SetFormat(PstOutputFormat format) {
+    g_format = format;
+}
+
+PstOutputFormat pst_print_GetFormat() {
+    return g_format;
 }
 
 void pst_print_PrintExceptionMessage() {
-    fprintf(g_stream, "An exception occurred, please check input content and log file.\n");
+    Report("An exception occurred, please check input content and log file.\n");
+    pst_print_Flush();
 }
 
 void pst_print_PrintConnection(const PstConnection* conn) {
-    fprintf(g_stream, "User     : %s\n", conn->user);
-    fprintf(g_stream, "Password : %s\n", conn->password);
-    fprintf(g_stream, "Host     : %s\n", conn->host);
-    fprintf(g_stream, "Port     : %u\n", conn->port);
-    fprintf(g_stream, "Database : %s\n", conn->database);
-    fprintf(g_stream, "\n");
+    if (g_format != PstOutputFormat_Table) {
+        return;
+    }
+    Printf("User     : %s\n", conn->user);
+    Printf("Password : %s\n", conn->password);
+    Printf("Host     : %s\n", conn->host);
+    Printf("Port     : %u\n", conn->port);
+    Printf("Database : %s\n", conn->database);
+    Printf("\n");
 }
 
 void pst_print_PrintStatement(const PstPreparedStatement* prep_stmt, const unsigned long  prep_stmt_index) {
-    fprintf(g_stream, "Statement[%ld]: %s\n", prep_stmt_index, prep_stmt->stmt);
+    if (g_format != PstOutputFormat_Table) {
+        return;
+    }
+    Printf("Statement[%ld]: %s\n", prep_stmt_index, prep_stmt->stmt);
 }
 
 void pst_print_PrintParameter(const PstParameter* param, const unsigned long param_markers_count, const unsigned long params_index) {
-    fprintf(g_stream, "Parameter[%ld]: ", params_index);
+    if (g_format != PstOutputFormat_Table) {
+        return;
+    }
+    Printf("Parameter[%ld]: ", params_index);
     for (unsigned long i = 0; i < param_markers_count; i++) {
-        PstFieldTypes type = pst_ToMySQLFieldType(param[i].type);
-        switch (type) {
-        case MYSQL_TYPE_TINY:
-            fprintf(g_stream, "(%ld)%c ", i, (signed char)param[i].valuedouble);
-            break;
-        case MYSQL_TYPE_SHORT:
-            fprintf(g_stream, "(%ld)%hd ", i, (short)param[i].valuedouble);
-            break;
-        case MYSQL_TYPE_LONG:
-            fprintf(g_stream, "(%ld)%d ", i, (int)param[i].valuedouble);
-            break;
-        case MYSQL_TYPE_LONGLONG:
-            fprintf(g_stream, "(%ld)%lld ", i, (long long)param[i].valuedouble);
-            break;
-        case MYSQL_TYPE_FLOAT:
-            fprintf(g_stream, "(%ld)%f ", i, (float)param[i].valuedouble);
-            break;
-        case MYSQL_TYPE_DOUBLE:
-            fprintf(g_stream, "(%ld)%lf ", i, (double)param[i].valuedouble);
-            break;
-        case MYSQL_TYPE_TIME:
-        case MYSQL_TYPE_DATE:
-        case MYSQL_TYPE_DATETIME:
-        case MYSQL_TYPE_TIMESTAMP:
-        case MYSQL_TYPE_STRING:
-        case MYSQL_TYPE_BLOB:
-            fprintf(g_stream, "(%ld)%s ", i, param[i].valuestring);
-            break;
-        case MYSQL_TYPE_NULL:
-        default:
-            break;
-        }
+        PrintValue(i, param[i].buffer_type, param[i].is_unsigned, pst_GetParameterBuffer(&param[i]), param[i].length);
     }
-    fprintf(g_stream, "\n");
+    Printf("\n");
+}
+
+void pst_print_PrintCompiledParameter(const PstCompiledValue* set, const unsigned long param_markers_count, const unsigned long params_index) {
+    if (g_format != PstOutputFormat_Table) {
+        return;
+    }
+    Printf("Parameter[%ld]: ", params_index);
+    const PstCompiledValue* value = set;
+    for (unsigned long i = 0; i < param_markers_count; i++, value = PST_COMPILED_NEXT(value)) {
+        PrintValue(i, (PstFieldTypes)value->buffer_type, value->is_unsigned, PST_COMPILED_DATA(value), value->length);
+    }
+    Printf("\n");
 }
 
 void pst_print_PrintResultSet(const PstResultSet* result_set) {
@@ -78,65 +209,663 @@ void pst_print_PrintResultSet(const PstResultSet* result_set) {
      +---------------------+---------+----------+----------+
     */
 
-    /* Top dashed */
-    fprintf(g_stream, "+");
-    for (uint64_t col = 0; col < result_set->column_count; col++) {
-        fprintf(g_stream, "-");
-        for (unsigned long i = 0; i < result_set->result[0][col].field_length; i++) {
-            fprintf(g_stream, "-");
+    const PstResult* header = result_set->result[0];
+
+    pst_print_PrintResultSetBorder(header, result_set->column_count);
+    pst_print_PrintResultSetRow(header, header, result_set->column_count);
+    pst_print_PrintResultSetBorder(header, result_set->column_count);
+    for (uint64_t row = 1; row < result_set->row_count; row++) {
+        pst_print_PrintResultSetRow(header, result_set->result[row], result_set->column_count);
+    }
+    pst_print_PrintResultSetBorder(header, result_set->column_count);
+}
+
+void pst_print_PrintResultSetBorder(const PstResult* header, uint64_t column_count) {
+    Append("+", 1);
+    for (uint64_t col = 0; col < column_count; col++) {
+        AppendRepeat('-', header[col].field_length + 2);
+        Append("+", 1);
+    }
+    Append("\n", 1);
+}
+
+void pst_print_PrintResultSetRow(const PstResult* header, const PstResult* row, uint64_t column_count) {
+    Append("|", 1);
+    for (uint64_t col = 0; col < column_count; col++) {
+        Append(" ", 1);
+        AppendPadded(row[col].valuestring, header[col].field_length);
+        Append(" |", 2);
+    }
+    Append("\n", 1);
+}
+
+void pst_print_BeginRows(const MYSQL_FIELD* fields, unsigned int field_count) {
+    g_fields = fields;
+    g_formatters[g_format].Begin(fields, field_count);
+}
+
+void pst_print_PrintRow(const PstResult* row, unsigned int field_count) {
+    g_formatters[g_format].Row(row, field_count);
+}
+
+void pst_print_EndRows(uint64_t rows) {
+    g_fields = NULL;
+}
+
+void pst_print_PrintExecutionMessage(const char* fmt, ...) {
+    if (g_format != PstOutputFormat_Table) {
+        return;
+    }
+
+    va_list args;
+    va_start(args, fmt);
+    VPrintf(fmt, args);
+    va_end(args);
+    Append("\n\n", 2);
+}
+
+void pst_print_PrintRunSummary(const PstRunStats* stats) {
+    Report("Summary: %lu %s, %lu %s in %.2f sec (%.2f per sec, %u %s",
+        stats->iterations, stats->iterations == 1 ? "iteration" : "iterations",
+        stats->executions, stats->executions == 1 ? "execution" : "executions", stats->seconds,
+        stats->seconds > 0 ? stats->executions / stats->seconds : 0.0,
+        stats->threads, stats->threads == 1 ? "thread" : "threads");
+    if (stats->connections != stats->threads) {
+        Report(", %u %s", stats->connections, stats->connections == 1 ? "connection" : "connections");
+    }
+    Report(")\n");
+    Report("Latency: avg %.3f ms, max %.3f ms\n",
+        stats->executions > 0 ? stats->latency_total_ns / 1e6 / stats->executions : 0.0,
+        stats->latency_max_ns / 1e6);
+    if (stats->rate > 0) {
+        Report("Schedule: %.2f per sec target, %lu late %s (avg %.3f ms, max %.3f ms behind)\n",
+            stats->rate, stats->late_sends, stats->late_sends == 1 ? "send" : "sends",
+            stats->late_sends > 0 ? stats->lateness_total_ns / 1e6 / stats->late_sends : 0.0,
+            stats->lateness_max_ns / 1e6);
+    }
+    if (stats->digest_rows > 0) {
+        Report("Digest: %llu rows (%.2f per sec), %.2f MB (%.2f MB per sec)\n",
+            (unsigned long long)stats->digest_rows,
+            stats->seconds > 0 ? stats->digest_rows / stats->seconds : 0.0,
+            stats->digest_bytes / 1e6,
+            stats->seconds > 0 ? stats->digest_bytes / 1e6 / stats->seconds : 0.0);
+    }
+    if (stats->verify_checked > 0 || stats->verify_recorded > 0) {
+        Report("Verify: %lu checked, %lu %s",
+            stats->verify_checked, stats->verify_mismatches, stats->verify_mismatches == 1 ? "mismatch" : "mismatches");
+        if (stats->verify_recorded > 0) {
+            Report(", %lu recorded", stats->verify_recorded);
         }
-        fprintf(g_stream, "-+");
+        Report("\n");
+    }
+    if (g_ring.started) {
+        Report("Output: executors blocked %.3f ms on a full output ring (%lu %s)\n",
+            g_ring.blocked_ns / 1e6, g_ring.blocked_count, g_ring.blocked_count == 1 ? "time" : "times");
+    }
+    if (stats->arena_high_water > 0) {
+        Report("Memory: result arena high-water %.1f KB per session\n", stats->arena_high_water / 1024.0);
     }
-    fprintf(g_stream, "\n");
+    Report("\n");
+}
+
+void pst_print_PrintHistogramHeader() {
+    Report("%-16s %10s %10s %10s %10s %10s %10s %10s\n",
+        "Latency (ms)", "count", "per sec", "p50", "p90", "p99", "p99.9", "max");
+}
 
-    /* Title */
-    fprintf(g_stream, "|");
-    for (uint64_t col = 0; col < result_set->column_count; col++) {
-        fprintf(g_stream, " %-*s ", (int)(result_set->result[0][col]).field_length, (result_set->result[0][col]).valuestring);
-        fprintf(g_stream, "|");
+void pst_print_PrintHistogram(const char* label, const PstHistogram* h, double seconds) {
+    /* histograms are recorded in microseconds */
+    Report("%-16s %10lld %10.2f %10.3f %10.3f %10.3f %10.3f %10.3f\n",
+        label, (long long)h->total_count, seconds > 0 ? h->total_count / seconds : 0.0,
+        pst_histogram_ValueAtPercentile(h, 50.0) / 1e3,
+        pst_histogram_ValueAtPercentile(h, 90.0) / 1e3,
+        pst_histogram_ValueAtPercentile(h, 99.0) / 1e3,
+        pst_histogram_ValueAtPercentile(h, 99.9) / 1e3,
+        h->max_value / 1e3);
+}
+
+void pst_print_PrintPhaseHeader() {
+    Report("\n");
+    Report("%-16s %10s %10s %10s %10s %10s %10s %10s\n",
+        "Phase (ms)", "count", "total", "p50", "p90", "p99", "p99.9", "max");
+}
+
+void pst_print_PrintPhase(const char* label, const PstHistogram* h, uint64_t total_ns) {
+    /* phases are recorded in nanoseconds */
+    Report("%-16s %10lld %10.3f %10.4f %10.4f %10.4f %10.4f %10.4f\n",
+        label, (long long)h->total_count, total_ns / 1e6,
+        pst_histogram_ValueAtPercentile(h, 50.0) / 1e6,
+        pst_histogram_ValueAtPercentile(h, 90.0) / 1e6,
+        pst_histogram_ValueAtPercentile(h, 99.0) / 1e6,
+        pst_histogram_ValueAtPercentile(h, 99.9) / 1e6,
+        h->max_value / 1e6);
+}
+
+void pst_print_PrintPhaseSplit(uint64_t server_ns, uint64_t client_ns) {
+    uint64_t total_ns = server_ns + client_ns;
+    Report("Server and network: %.3f ms (%.1f%%), PSTest: %.3f ms (%.1f%%)\n",
+        server_ns / 1e6, total_ns > 0 ? 100.0 * server_ns / total_ns : 0.0,
+        client_ns / 1e6, total_ns > 0 ? 100.0 * client_ns / total_ns : 0.0);
+    Report("\n");
+}
+
+void pst_print_BeginChunk(PstPrintChunk* chunk) {
+    chunk->used = 0;
+    g_chunk = chunk;
+}
+
+void pst_print_EndChunk() {
+    g_chunk = NULL;
+}
+
+void pst_print_PrintChunk(const PstPrintChunk* chunk) {
+    if (chunk->used > 0) {
+        Append(chunk->data, chunk->used);
+    }
+}
+
+void pst_print_FreeChunk(PstPrintChunk* chunk) {
+    free(chunk->data);
+    chunk->data = NULL;
+    chunk->used = 0;
+    chunk->size = 0;
+}
+
+void pst_print_Lock() {
+    flockfile(g_stream);
+}
+
+void pst_print_Unlock() {
+    if (g_interactive) {
+        Drain();
     }
-    fprintf(g_stream, "\n");
+    funlockfile(g_stream);
+}
 
-    /* Title dashed */
-    fprintf(g_stream, "+");
-    for (uint64_t col = 0; col < result_set->column_count; col++) {
-        fprintf(g_stream, "-");
-        for (unsigned long i = 0; i < result_set->result[0][col].field_length; i++) {
-            fprintf(g_stream, "-");
+/* static functions */
+/* One parameter value from the buffer of its MYSQL_BIND */
+static void PrintValue(unsigned long i, PstFieldTypes type, bool is_unsigned, const void* data, unsigned long length) {
+    char time[32];
+    switch (type) {
+    case MYSQL_TYPE_TINY:
+        Printf("(%ld)%c ", i, *(const signed char*)data);
+        break;
+    case MYSQL_TYPE_SHORT:
+        if (is_unsigned) {
+            Printf("(%ld)%hu ", i, *(const unsigned short*)data);
+        } else {
+            Printf("(%ld)%hd ", i, *(const short*)data);
+        }
+        break;
+    case MYSQL_TYPE_LONG:
+        if (is_unsigned) {
+            Printf("(%ld)%u ", i, *(const unsigned int*)data);
+        } else {
+            Printf("(%ld)%d ", i, *(const int*)data);
         }
-        fprintf(g_stream, "-+");
+        break;
+    case MYSQL_TYPE_LONGLONG:
+        if (is_unsigned) {
+            Printf("(%ld)%llu ", i, *(const unsigned long long*)data);
+        } else {
+            Printf("(%ld)%lld ", i, *(const long long*)data);
+        }
+        break;
+    case MYSQL_TYPE_FLOAT:
+        Printf("(%ld)%f ", i, *(const float*)data);
+        break;
+    case MYSQL_TYPE_DOUBLE:
+        Printf("(%ld)%lf ", i, *(const double*)data);
+        break;
+    case MYSQL_TYPE_TIME:
+    case MYSQL_TYPE_DATE:
+    case MYSQL_TYPE_DATETIME:
+    case MYSQL_TYPE_TIMESTAMP:
+        pst_FromMySQLTime((const MYSQL_TIME*)data, type, time, sizeof(time));
+        Printf("(%ld)%s ", i, time);
+        break;
+    case MYSQL_TYPE_STRING:
+    case MYSQL_TYPE_BLOB:
+        Printf("(%ld)%.*s ", i, (int)length, (const char*)data);
+        break;
+    case MYSQL_TYPE_NULL:
+    default:
+        break;
     }
-    fprintf(g_stream, "\n");
+}
 
+static void WriteAll(const struct iovec* iov, int iovcnt) {
+    struct iovec pending[2];
+    memcpy(pending, iov, sizeof(struct iovec) * iovcnt);
+    struct iovec* next = pending;
+    while (iovcnt > 0) {
+        ssize_t written = writev(g_fd, next, iovcnt);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            log_error("Failed to write output: %s", strerror(errno));
+            return;
+        }
+        while (iovcnt > 0 && (size_t)written >= next->iov_len) {
+            written -= next->iov_len;
+            next++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            next->iov_base = (char*)next->iov_base + written;
+            next->iov_len -= written;
+        }
+    }
+}
 
-    /* Result set */
-    for (uint64_t row = 1; row < result_set->row_count; row++) {
-        fprintf(g_stream, "|");
-        for (uint64_t col = 0; col < result_set->column_count; col++) {
-            fprintf(g_stream, " %-*s ", (int)(result_set->result[0][col]).field_length, (result_set->result[row][col]).valuestring);
-            fprintf(g_stream, "|");
+/* To the ring when the writer runs, else straight to the stream */
+static void Output(const struct iovec* iov, int iovcnt) {
+    if (g_ring.started) {
+        for (int i = 0; i < iovcnt; i++) {
+            Push((const char*)iov[i].iov_base, iov[i].iov_len);
+        }
+        return;
+    }
+
+    /* anything written to the stream through stdio goes first */
+    fflush((FILE*)g_stream);
+    WriteAll(iov, iovcnt);
+}
+
+/* Hand the buffered output on, without waiting for the writer */
+static void Drain() {
+    if (g_used == 0) {
+        return;
+    }
+
+    struct iovec iov = { g_buffer, g_used };
+    Output(&iov, 1);
+    g_used = 0;
+}
+
+static void Push(const char* data, size_t length) {
+    size_t head = atomic_load(&g_ring.head);
+    while (length > 0) {
+        size_t space = PST_PRINT_RING_SIZE - (head - atomic_load(&g_ring.tail));
+        if (space == 0) {
+            WaitForRing(false);
+            continue;
+        }
+
+        size_t chunk = length < space ? length : space;
+        size_t offset = head & (PST_PRINT_RING_SIZE - 1);
+        size_t first = chunk < PST_PRINT_RING_SIZE - offset ? chunk : PST_PRINT_RING_SIZE - offset;
+        memcpy(g_ring.data + offset, data, first);
+        memcpy(g_ring.data, data + first, chunk - first);
+
+        head += chunk;
+        atomic_store(&g_ring.head, head);
+        data += chunk;
+        length -= chunk;
+
+        if (atomic_load(&g_ring.writer_sleeping)) {
+            pthread_mutex_lock(&g_ring.mutex);
+            pthread_cond_broadcast(&g_ring.cond);
+            pthread_mutex_unlock(&g_ring.mutex);
         }
-        fprintf(g_stream, "\n");
     }
+}
 
-    /* Bottom dashed */
-    fprintf(g_stream, "+");
-    for (uint64_t col = 0; col < result_set->column_count; col++) {
-        fprintf(g_stream, "-");
-        for (unsigned long i = 0; i < result_set->result[0][col].field_length; i++) {
-            fprintf(g_stream, "-");
+/* Producer side, until everything is written or until there is room */
+static void WaitForRing(bool empty) {
+    uint64_t start = pst_GetMonotonicNs();
+
+    pthread_mutex_lock(&g_ring.mutex);
+    atomic_store(&g_ring.producer_waiting, true);
+    while (true) {
+        size_t used = atomic_load(&g_ring.head) - atomic_load(&g_ring.tail);
+        if (empty ? used == 0 : used < PST_PRINT_RING_SIZE) {
+            break;
         }
-        fprintf(g_stream, "-+");
+        pthread_cond_wait(&g_ring.cond, &g_ring.mutex);
     }
-    fprintf(g_stream, "\n");
+    atomic_store(&g_ring.producer_waiting, false);
+    pthread_mutex_unlock(&g_ring.mutex);
 
+    /* waiting for a full ring is what a slow stream costs the executors */
+    if (!empty) {
+        g_ring.blocked_ns += pst_GetMonotonicNs() - start;
+        g_ring.blocked_count++;
+    }
 }
 
-void pst_print_PrintExecutionMessage(const char* fmt, ...) {
+static void* RunWriter(void* arg) {
+    while (true) {
+        size_t tail = atomic_load(&g_ring.tail);
+        size_t head = atomic_load(&g_ring.head);
+        if (head == tail) {
+            if (atomic_load(&g_ring.stop)) {
+                break;
+            }
+            pthread_mutex_lock(&g_ring.mutex);
+            atomic_store(&g_ring.writer_sleeping, true);
+            while (atomic_load(&g_ring.head) == tail && !atomic_load(&g_ring.stop)) {
+                pthread_cond_wait(&g_ring.cond, &g_ring.mutex);
+            }
+            atomic_store(&g_ring.writer_sleeping, false);
+            pthread_mutex_unlock(&g_ring.mutex);
+            continue;
+        }
+
+        /* everything pushed so far, in two pieces when it wraps */
+        size_t offset = tail & (PST_PRINT_RING_SIZE - 1);
+        size_t length = head - tail;
+        size_t first = length < PST_PRINT_RING_SIZE - offset ? length : PST_PRINT_RING_SIZE - offset;
+        struct iovec iov[2] = { { g_ring.data + offset, first }, { g_ring.data, length - first } };
+        WriteAll(iov, length > first ? 2 : 1);
+
+        atomic_store(&g_ring.tail, head);
+        if (atomic_load(&g_ring.producer_waiting)) {
+            pthread_mutex_lock(&g_ring.mutex);
+            pthread_cond_broadcast(&g_ring.cond);
+            pthread_mutex_unlock(&g_ring.mutex);
+        }
+    }
+
+    return NULL;
+}
+
+/* Room for length more bytes in g_chunk, which grows by doubling */
+static char* ReserveChunk(size_t length) {
+    if (g_chunk->used + length > g_chunk->size) {
+        size_t size = g_chunk->size > 0 ? g_chunk->size : PST_PRINT_BUFFER_SIZE;
+        while (size < g_chunk->used + length) {
+            size *= 2;
+        }
+        char* data = (char*)realloc(g_chunk->data, size);
+        if (data == NULL) {
+            log_error(PST_FORMAT_MSG_ERR_ALLOC, "output chunk");
+            return NULL;
+        }
+        g_chunk->data = data;
+        g_chunk->size = size;
+    }
+
+    return g_chunk->data + g_chunk->used;
+}
+
+static void Append(const char* data, size_t length) {
+    if (g_chunk != NULL) {
+        char* end = ReserveChunk(length);
+        if (end != NULL) {
+            memcpy(end, data, length);
+            g_chunk->used += length;
+        }
+        return;
+    }
+
+    if (length <= PST_PRINT_BUFFER_SIZE - g_used) {
+        memcpy(g_buffer + g_used, data, length);
+        g_used += length;
+        return;
+    }
+
+    /* buffered output and data go out in one call */
+    struct iovec iov[2] = { { g_buffer, g_used }, { (void*)data, length } };
+    Output(iov, 2);
+    g_used = 0;
+}
+
+static void AppendRepeat(char c, size_t count) {
+    if (g_chunk != NULL) {
+        char* end = ReserveChunk(count);
+        if (end != NULL) {
+            memset(end, c, count);
+            g_chunk->used += count;
+        }
+        return;
+    }
+
+    while (count > 0) {
+        if (g_used == PST_PRINT_BUFFER_SIZE) {
+            Drain();
+        }
+        size_t length = PST_PRINT_BUFFER_SIZE - g_used;
+        if (length > count) {
+            length = count;
+        }
+        memset(g_buffer + g_used, c, length);
+        g_used += length;
+        count -= length;
+    }
+}
+
+/* str left aligned in width characters, "%-*s" */
+static void AppendPadded(const char* str, size_t width) {
+    size_t length = strlen(str);
+    Append(str, length);
+    if (length < width) {
+        AppendRepeat(' ', width - length);
+    }
+}
+
+/* The run report follows the results on the console and goes to stderr */
+/* when the stream carries machine readable rows */
+static void Report(const char* fmt, ...) {
     va_list args;
     va_start(args, fmt);
-    vfprintf(g_stream, fmt, args);
+    if (g_format == PstOutputFormat_Table) {
+        VPrintf(fmt, args);
+    } else {
+        pst_print_Flush();
+        vfprintf(stderr, fmt, args);
+    }
     va_end(args);
-    fprintf(g_stream, "\n");
-    fprintf(g_stream, "\n");
+}
+
+static void Printf(const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    VPrintf(fmt, args);
+    va_end(args);
+}
+
+static void VPrintf(const char* fmt, va_list args) {
+    va_list retry;
+    va_copy(retry, args);
+
+    if (g_chunk != NULL) {
+        int length = vsnprintf(NULL, 0, fmt, args);
+        char* end = length < 0 ? NULL : ReserveChunk((size_t)length + 1);
+        if (end != NULL) {
+            vsnprintf(end, (size_t)length + 1, fmt, retry);
+            g_chunk->used += length;
+        }
+        va_end(retry);
+        return;
+    }
+
+    size_t space = PST_PRINT_BUFFER_SIZE - g_used;
+    int length = vsnprintf(g_buffer + g_used, space, fmt, args);
+    if (length < 0) {
+        va_end(retry);
+        return;
+    }
+    if ((size_t)length < space) {
+        g_used += length;
+        va_end(retry);
+        return;
+    }
+
+    /* did not fit, make room or format a text larger than the buffer apart */
+    Drain();
+    if ((size_t)length < PST_PRINT_BUFFER_SIZE) {
+        g_used = vsnprintf(g_buffer, PST_PRINT_BUFFER_SIZE, fmt, retry);
+    } else {
+        char* text = (char*)malloc(length + 1);
+        if (text != NULL) {
+            vsnprintf(text, length + 1, fmt, retry);
+            Append(text, length);
+            free(text);
+        } else {
+            log_error(PST_FORMAT_MSG_ERR_ALLOC, "output");
+        }
+    }
+    va_end(retry);
+}
+
+/* RFC 4180, a field is quoted when it holds a comma, a quote or a line */
+/* break, NULL is an empty unquoted field and the empty string "" */
+static void AppendCsvField(const char* str, bool is_null) {
+    if (is_null) {
+        return;
+    }
+
+    size_t length = strlen(str);
+    if (length > 0 && strpbrk(str, ",\"\r\n") == NULL) {
+        Append(str, length);
+        return;
+    }
+
+    Append("\"", 1);
+    const char* quote;
+    while ((quote = strchr(str, '"')) != NULL) {
+        Append(str, quote - str + 1);
+        Append("\"", 1);
+        str = quote + 1;
+    }
+    Append(str, strlen(str));
+    Append("\"", 1);
+}
+
+static void BeginCsv(const MYSQL_FIELD* fields, unsigned int field_count) {
+    for (unsigned int col = 0; col < field_count; col++) {
+        if (col > 0) {
+            Append(",", 1);
+        }
+        AppendCsvField(fields[col].name, false);
+    }
+    Append("\n", 1);
+}
+
+static void PrintCsvRow(const PstResult* row, unsigned int field_count) {
+    for (unsigned int col = 0; col < field_count; col++) {
+        if (col > 0) {
+            Append(",", 1);
+        }
+        AppendCsvField(row[col].valuestring, row[col].is_null);
+    }
+    Append("\n", 1);
+}
+
+/* as mysql --batch writes it, tab, line break and backslash escaped, NULL as \N */
+static void AppendTsvField(const char* str, bool is_null) {
+    if (is_null) {
+        Append("\\N", 2);
+        return;
+    }
+
+    const char* start = str;
+    for (; *str != '\0'; str++) {
+        const char* escape = NULL;
+        switch (*str) {
+        case '\t': escape = "\\t"; break;
+        case '\n': escape = "\\n"; break;
+        case '\r': escape = "\\r"; break;
+        case '\\': escape = "\\\\"; break;
+        default: continue;
+        }
+        Append(start, str - start);
+        Append(escape, 2);
+        start = str + 1;
+    }
+    Append(start, str - start);
+}
+
+static void BeginTsv(const MYSQL_FIELD* fields, unsigned int field_count) {
+    for (unsigned int col = 0; col < field_count; col++) {
+        if (col > 0) {
+            Append("\t", 1);
+        }
+        AppendTsvField(fields[col].name, false);
+    }
+    Append("\n", 1);
+}
+
+static void PrintTsvRow(const PstResult* row, unsigned int field_count) {
+    for (unsigned int col = 0; col < field_count; col++) {
+        if (col > 0) {
+            Append("\t", 1);
+        }
+        AppendTsvField(row[col].valuestring, row[col].is_null);
+    }
+    Append("\n", 1);
+}
+
+static void AppendJsonString(const char* str) {
+    static const char hex[] = "0123456789abcdef";
+
+    Append("\"", 1);
+    const char* start = str;
+    for (; *str != '\0'; str++) {
+        unsigned char c = (unsigned char)*str;
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+        Append(start, str - start);
+        switch (c) {
+        case '"': Append("\\\"", 2); break;
+        case '\\': Append("\\\\", 2); break;
+        case '\n': Append("\\n", 2); break;
+        case '\r': Append("\\r", 2); break;
+        case '\t': Append("\\t", 2); break;
+        default: {
+            char escape[6] = { '\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xf] };
+            Append(escape, sizeof(escape));
+            break;
+        }
+        }
+        start = str + 1;
+    }
+    Append(start, str - start);
+    Append("\"", 1);
+}
+
+/* numbers are written bare, as long as the text is a JSON number */
+static bool IsJsonNumber(const PstResult* result) {
+    switch (result->type) {
+    case MYSQL_TYPE_SHORT:
+    case MYSQL_TYPE_INT24:
+    case MYSQL_TYPE_LONG:
+    case MYSQL_TYPE_LONGLONG:
+    case MYSQL_TYPE_YEAR:
+    case MYSQL_TYPE_FLOAT:
+    case MYSQL_TYPE_DOUBLE:
+    case MYSQL_TYPE_NEWDECIMAL: {
+        /* not inf or nan */
+        size_t length = strlen(result->valuestring);
+        return length > 0 && result->valuestring[length - 1] >= '0' && result->valuestring[length - 1] <= '9';
+    }
+    default:
+        return false;
+    }
+}
+
+static void BeginNdjson(const MYSQL_FIELD* fields, unsigned int field_count) {
+    /* every row carries its keys */
+}
+
+static void PrintNdjsonRow(const PstResult* row, unsigned int field_count) {
+    Append("{", 1);
+    for (unsigned int col = 0; col < field_count; col++) {
+        if (col > 0) {
+            Append(",", 1);
+        }
+        AppendJsonString(g_fields[col].name);
+        Append(":", 1);
+        if (row[col].is_null) {
+            Append("null", 4);
+        } else if (IsJsonNumber(&row[col])) {
+            Append(row[col].valuestring, strlen(row[col].valuestring));
+        } else {
+            AppendJsonString(row[col].valuestring);
+        }
+    }
+    Append("}\n", 2);
 }
@@ -0,0 +1,288 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "log.h"
+#include "pst_queue.h"
+#include "pst_parse.h"
+#include "pst_stats.h"
+#include "pst_stream.h"
+#include "pst_verify.h"
+
+typedef struct PstWorkQueue {
+    pthread_mutex_t mutex;
+    /* signalled when the last item ahead of a fence is released */
+    pthread_cond_t released;
+    const PstPreparedStatements* prep_stmts;
+    unsigned long stmt_index;
+    unsigned long params_index;
+    unsigned long iteration;
+    unsigned long max_iterations;
+    double duration_sec;
+    uint64_t deadline;
+    /* open-loop schedule, item n starts at start + n * interval */
+    uint64_t start;
+    double interval_ns;
+    unsigned long sequence;
+    /* items handed out and not released yet */
+    unsigned long running;
+    /* a caller found the next statement fenced and waits for running to drop to 0 */
+    bool fenced;
+    bool failed;
+} PstWorkQueue;
+
+/* global variables */
+static PstWorkQueue g_queue;
+
+static PstQueueStatus Take(PstWorkItem* item, bool wait);
+static bool IsFenced(unsigned long stmt_index);
+static bool IsDataStatement(PstSyntax syntax);
+
+int pst_queue_Init(const PstPreparedStatements* prep_stmts, const PstScenario* scenario) {
+    memset(&g_queue, 0, sizeof(PstWorkQueue));
+    if (pthread_mutex_init(&g_queue.mutex, NULL) != 0) {
+        log_error("Failed to initialize work queue mutex");
+        return RET_ERR;
+    }
+    if (pthread_cond_init(&g_queue.released, NULL) != 0) {
+        log_error("Failed to initialize work queue condition");
+        pthread_mutex_destroy(&g_queue.mutex);
+        return RET_ERR;
+    }
+
+    g_queue.prep_stmts = prep_stmts;
+    g_queue.max_iterations = scenario->iterations;
+    if (scenario->iterations == 0 && scenario->duration_sec == 0) {
+        g_queue.max_iterations = 1;
+    }
+    g_queue.duration_sec = scenario->duration_sec;
+    g_queue.interval_ns = scenario->rate > 0 ? 1e9 / scenario->rate : 0;
+
+    return RET_OK;
+}
+
+void pst_queue_Start(uint64_t start) {
+    pthread_mutex_lock(&g_queue.mutex);
+    g_queue.start = start;
+    if (g_queue.duration_sec > 0) {
+        g_queue.deadline = start + (uint64_t)(g_queue.duration_sec * 1e9);
+    }
+    pthread_mutex_unlock(&g_queue.mutex);
+}
+
+bool pst_queue_Next(PstWorkItem* item) {
+    return Take(item, true) == PstQueue_Item;
+}
+
+PstQueueStatus pst_queue_TryNext(PstWorkItem* item) {
+    return Take(item, false);
+}
+
+bool pst_queue_Release(PstWorkItem* item) {
+    if (!item->pending) {
+        return false;
+    }
+    if (item->owns_param) {
+        const PstPreparedStatement* prep_stmt = &g_queue.prep_stmts->prep_stmt[item->stmt_index];
+        pst_stream_FreeParameters(item->param, prep_stmt->param_markers_count);
+    }
+    item->param = NULL;
+    item->owns_param = false;
+    item->pending = false;
+
+    bool lifted = false;
+    pthread_mutex_lock(&g_queue.mutex);
+    g_queue.running--;
+    if (g_queue.running == 0 && g_queue.fenced) {
+        g_queue.fenced = false;
+        pthread_cond_broadcast(&g_queue.released);
+        lifted = true;
+    }
+    pthread_mutex_unlock(&g_queue.mutex);
+
+    return lifted;
+}
+
+bool pst_queue_Failed() {
+    pthread_mutex_lock(&g_queue.mutex);
+    bool failed = g_queue.failed;
+    pthread_mutex_unlock(&g_queue.mutex);
+    return failed;
+}
+
+unsigned long pst_queue_GetIterations() {
+    pthread_mutex_lock(&g_queue.mutex);
+    unsigned long iterations = g_queue.iteration;
+    pthread_mutex_unlock(&g_queue.mutex);
+    return iterations;
+}
+
+void pst_queue_Free() {
+    pthread_cond_destroy(&g_queue.released);
+    pthread_mutex_destroy(&g_queue.mutex);
+}
+
+
+/* static functions */
+/**
+ *  The next item, or PstQueue_Fenced when the next statement has to wait
+ *  for the items of the one before it: with wait the caller sleeps until
+ *  they are released, without it the caller asks again once
+ *  pst_queue_Release has returned true.
+ */
+static PstQueueStatus Take(PstWorkItem* item, bool wait) {
+    PstQueueStatus status = PstQueue_Over;
+    PstSetText text;
+    text.begin = NULL;
+
+    pthread_mutex_lock(&g_queue.mutex);
+    for (;;) {
+        uint64_t intended_start = 0;
+        if (g_queue.interval_ns > 0) {
+            intended_start = g_queue.start + (uint64_t)(g_queue.sequence * g_queue.interval_ns);
+        }
+        uint64_t next_start = intended_start != 0 ? intended_start : pst_GetMonotonicNs();
+        if (g_queue.failed || (g_queue.deadline != 0 && next_start >= g_queue.deadline)) {
+            break;
+        }
+
+        while (g_queue.prep_stmts->prep_stmt_size > 0 &&
+            (g_queue.max_iterations == 0 || g_queue.iteration < g_queue.max_iterations)) {
+            if (g_queue.stmt_index == g_queue.prep_stmts->prep_stmt_size) {
+                /* pass finished, replay the list */
+                g_queue.iteration++;
+                g_queue.stmt_index = 0;
+                g_queue.params_index = 0;
+                continue;
+            }
+
+            if (g_queue.params_index == 0 && g_queue.running > 0 && IsFenced(g_queue.stmt_index)) {
+                g_queue.fenced = true;
+                status = PstQueue_Fenced;
+                break;
+            }
+
+            const PstPreparedStatement* prep_stmt = &g_queue.prep_stmts->prep_stmt[g_queue.stmt_index];
+            PstParameter* param = NULL;
+            bool owns_param = false;
+            const PstCompiledValue* compiled = NULL;
+            if (prep_stmt->params_stream != NULL && prep_stmt->params_stream->compiled) {
+                if (g_queue.params_index == 0) {
+                    pst_stream_Rewind(prep_stmt->params_stream);
+                }
+                if (pst_stream_NextCompiled(prep_stmt->params_stream, prep_stmt->param_markers_count, &compiled) != RET_OK) {
+                    g_queue.failed = true;
+                    break;
+                }
+            } else if (prep_stmt->params_stream != NULL) {
+                /* the sets are read while the pass goes on, only their text is */
+                /* taken here and parsed once the queue is unlocked */
+                if (g_queue.params_index == 0) {
+                    pst_stream_Rewind(prep_stmt->params_stream);
+                }
+                unsigned long count = prep_stmt->param_markers_count;
+                if (pst_stream_Take(prep_stmt->params_stream, &param, &count, &text) != RET_OK) {
+                    g_queue.failed = true;
+                    break;
+                }
+                owns_param = true;
+                if (text.begin == NULL && pst_parse_MoreToRead()) {
+                    /* the first pass reached the end of the array the scan */
+                    /* stopped at, the statements after it are read once */
+                    /* nothing runs, as they move the ones before them */
+                    if (g_queue.running > 0) {
+                        g_queue.fenced = true;
+                        status = PstQueue_Fenced;
+                        break;
+                    }
+                    if (pst_parse_ReadMore() != RET_OK ||
+                        pst_stats_AddStatements(g_queue.prep_stmts) != RET_OK ||
+                        pst_verify_AddStatements(g_queue.prep_stmts) != RET_OK) {
+                        g_queue.failed = true;
+                        break;
+                    }
+                    continue;
+                }
+            } else if (g_queue.params_index < prep_stmt->params_size) {
+                param = prep_stmt->params[g_queue.params_index];
+            }
+
+            /* a statement without parameter sets is executed once */
+            if (param != NULL || text.begin != NULL || compiled != NULL || (prep_stmt->params_size == 0 && prep_stmt->params_stream == NULL && g_queue.params_index == 0)) {
+                item->stmt_index = g_queue.stmt_index;
+                item->params_index = g_queue.params_index;
+                item->param = param;
+                item->owns_param = owns_param;
+                item->compiled = compiled;
+                item->iteration = g_queue.iteration;
+                item->intended_start = intended_start;
+                item->pending = true;
+                g_queue.params_index++;
+                g_queue.sequence++;
+                g_queue.running++;
+                status = PstQueue_Item;
+                break;
+            }
+            g_queue.stmt_index++;
+            g_queue.params_index = 0;
+        }
+
+        if (status != PstQueue_Fenced || !wait) {
+            break;
+        }
+        pthread_cond_wait(&g_queue.released, &g_queue.mutex);
+        status = PstQueue_Over;
+    }
+    pthread_mutex_unlock(&g_queue.mutex);
+
+    if (status == PstQueue_Item && text.begin != NULL) {
+        unsigned long count = g_queue.prep_stmts->prep_stmt[item->stmt_index].param_markers_count;
+        if (pst_stream_Parse(&text, &item->param, &count) != RET_OK) {
+            item->param = NULL;
+            item->owns_param = false;
+            pthread_mutex_lock(&g_queue.mutex);
+            g_queue.failed = true;
+            pthread_mutex_unlock(&g_queue.mutex);
+            pst_queue_Release(item);
+            return PstQueue_Over;
+        }
+    }
+
+    return status;
+}
+
+/**
+ *  A statement waits for every item of the one before it when either of
+ *  them is not a data statement, so a table created, altered or dropped
+ *  by one statement is there, or gone, for the next; queries and DML of
+ *  consecutive statements still overlap. A statement is not fenced from
+ *  its own previous pass.
+ */
+static bool IsFenced(unsigned long stmt_index) {
+    const PstPreparedStatements* prep_stmts = g_queue.prep_stmts;
+    unsigned long prev_index = (stmt_index + prep_stmts->prep_stmt_size - 1) % prep_stmts->prep_stmt_size;
+    if (prev_index == stmt_index) {
+        return false;
+    }
+
+    return !IsDataStatement(prep_stmts->prep_stmt[prev_index].syntax) ||
+        !IsDataStatement(prep_stmts->prep_stmt[stmt_index].syntax);
+}
+
+static bool IsDataStatement(PstSyntax syntax) {
+    switch (syntax) {
+    case PstSyntax_Select:
+    case PstSyntax_Show:
+    case PstSyntax_ShowCreate:
+    case PstSyntax_CheckSum:
+    case PstSyntax_Insert:
+    case PstSyntax_InsertSelect:
+    case PstSyntax_Replace:
+    case PstSyntax_Update:
+    case PstSyntax_Delete:
+        return true;
+    default:
+        return false;
+    }
+}
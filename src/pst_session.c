@@ -0,0 +1,102 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "log.h"
+#include "pst_session.h"
+#include "pst_input.h"
+#include "pst_output.h"
+#include "pst_timing.h"
+#include "pst_arena.h"
+
+int pst_session_Open(PstSession* session, const PstConnection* conn, const PstPreparedStatements* prep_stmts) {
+    memset(session, 0, sizeof(PstSession));
+    pst_arena_Init(&session->arena, PST_ARENA_BLOCK_SIZE);
+
+    session->mysql = mysql_init(NULL);
+    if (session->mysql == NULL) {
+        log_error("Failed to initialize MySQL client");
+        return RET_ERR;
+    }
+
+    if (mysql_real_connect(session->mysql,
+        conn->host, conn->user, conn->password, conn->database, conn->port,
+        conn->unix_socket, conn->client_flag) == NULL) {
+        log_error(PST_FORMAT_MSG_ERR_MYSQL, mysql_errno(session->mysql), mysql_sqlstate(session->mysql), mysql_error(session->mysql));
+        return RET_ERR;
+    }
+
+    session->stmts = (MYSQL_STMT**)malloc(prep_stmts->prep_stmt_size * sizeof(MYSQL_STMT*));
+    if (session->stmts == NULL) {
+        log_error(PST_FORMAT_MSG_ERR_ALLOC, "session->stmts");
+        return RET_ERR;
+    }
+    memset(session->stmts, 0, prep_stmts->prep_stmt_size * sizeof(MYSQL_STMT*));
+    session->stmts_size = prep_stmts->prep_stmt_size;
+
+    return RET_OK;
+}
+
+MYSQL_STMT* pst_session_GetStatement(PstSession* session, const PstPreparedStatement* prep_stmt, unsigned long index) {
+    /* a statement read after the run started, see pst_parse_ReadMore */
+    if (index >= session->stmts_size) {
+        MYSQL_STMT** stmts = (MYSQL_STMT**)realloc(session->stmts, (index + 1) * sizeof(MYSQL_STMT*));
+        if (stmts == NULL) {
+            log_error(PST_FORMAT_MSG_ERR_ALLOC, "session->stmts");
+            return NULL;
+        }
+        memset(stmts + session->stmts_size, 0, (index + 1 - session->stmts_size) * sizeof(MYSQL_STMT*));
+        session->stmts = stmts;
+        session->stmts_size = index + 1;
+    }
+
+    if (session->stmts[index] != NULL) {
+        return session->stmts[index];
+    }
+
+    /* prepared on its first execution; the queue fences statements that */
+    /* change the schema, so one may refer to a table created before it */
+    MYSQL_STMT* stmt = mysql_stmt_init(session->mysql);
+    if (stmt == NULL) {
+        log_error(PST_FORMAT_MSG_ERR_MYSQL, mysql_errno(session->mysql), mysql_sqlstate(session->mysql), mysql_error(session->mysql));
+        return NULL;
+    }
+
+    uint64_t prepare_start = pst_GetMonotonicNs();
+    if (mysql_stmt_prepare(stmt, prep_stmt->stmt, prep_stmt->stmt_len) != 0) {
+        log_error(PST_FORMAT_MSG_ERR_MYSQL, mysql_stmt_errno(stmt), mysql_stmt_sqlstate(stmt), mysql_stmt_error(stmt));
+        mysql_stmt_close(stmt);
+        return NULL;
+    }
+    pst_timing_Record(PstPhase_Prepare, pst_GetMonotonicNs() - prepare_start);
+
+    if (pst_output_SetFetchMode(stmt, prep_stmt) != RET_OK) {
+        mysql_stmt_close(stmt);
+        return NULL;
+    }
+    session->stmts[index] = stmt;
+
+    return stmt;
+}
+
+void pst_session_Close(PstSession* session) {
+    pst_input_FreeParameters(session);
+    pst_output_FreeResult(session);
+    pst_arena_Free(&session->arena);
+
+    if (session->stmts) {
+        for (unsigned long i = 0; i < session->stmts_size; i++) {
+            if (session->stmts[i]) {
+                mysql_stmt_close(session->stmts[i]);
+                session->stmts[i] = NULL;
+            }
+        }
+        free(session->stmts);
+        session->stmts = NULL;
+    }
+
+    if (session->mysql) {
+        mysql_close(session->mysql);
+        session->mysql = NULL;
+    }
+}
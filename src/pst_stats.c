@@ -0,0 +1,149 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "log.h"
+#include "pst_stats.h"
+#include "pst_histogram.h"
+#include "pst_timing.h"
+#include "pst_print.h"
+
+/* global variables */
+static unsigned long g_count;
+/* latency of every execution, one histogram per statement shared by all workers */
+static PstHistogram* g_histograms;
+
+int pst_stats_Init(const PstPreparedStatements* prep_stmts) {
+    g_count = 0;
+    g_histograms = NULL;
+    if (pst_stats_AddStatements(prep_stmts) != RET_OK) {
+        return RET_ERR;
+    }
+
+    return pst_timing_Init();
+}
+
+int pst_stats_AddStatements(const PstPreparedStatements* prep_stmts) {
+    unsigned long count = prep_stmts->prep_stmt_size;
+    if (count <= g_count) {
+        return RET_OK;
+    }
+
+    PstHistogram* histograms = (PstHistogram*)realloc(g_histograms, count * sizeof(PstHistogram));
+    if (histograms == NULL) {
+        log_error(PST_FORMAT_MSG_ERR_ALLOC, "histograms");
+        return RET_ERR;
+    }
+    memset(histograms + g_count, 0, (count - g_count) * sizeof(PstHistogram));
+    g_histograms = histograms;
+
+    unsigned long first = g_count;
+    g_count = count;
+    for (unsigned long i = first; i < count; i++) {
+        if (pst_histogram_Init(&g_histograms[i], PST_HISTOGRAM_LOWEST, PST_HISTOGRAM_HIGHEST, PST_HISTOGRAM_SIGNIFICANT_FIGURES) != RET_OK) {
+            return RET_ERR;
+        }
+    }
+
+    return RET_OK;
+}
+
+void pst_stats_Free() {
+    if (g_histograms) {
+        for (unsigned long i = 0; i < g_count; i++) {
+            pst_histogram_Free(&g_histograms[i]);
+        }
+        free(g_histograms);
+        g_histograms = NULL;
+    }
+
+    pst_timing_Free();
+}
+
+void pst_stats_RecordLatency(PstRunStats* stats, unsigned long stmt_index, uint64_t latency_ns) {
+    pst_histogram_Record(&g_histograms[stmt_index], (int64_t)(latency_ns / 1000));
+
+    stats->executions++;
+    stats->latency_total_ns += latency_ns;
+    if (latency_ns > stats->latency_max_ns) {
+        stats->latency_max_ns = latency_ns;
+    }
+}
+
+void pst_stats_RecordLateness(PstRunStats* stats, uint64_t lateness_ns) {
+    if (lateness_ns <= PST_SCHEDULE_TOLERANCE_NS) {
+        return;
+    }
+
+    stats->late_sends++;
+    stats->lateness_total_ns += lateness_ns;
+    if (lateness_ns > stats->lateness_max_ns) {
+        stats->lateness_max_ns = lateness_ns;
+    }
+}
+
+void pst_stats_Merge(PstRunStats* to, const PstRunStats* from) {
+    to->executions += from->executions;
+    to->latency_total_ns += from->latency_total_ns;
+    if (from->latency_max_ns > to->latency_max_ns) {
+        to->latency_max_ns = from->latency_max_ns;
+    }
+    to->late_sends += from->late_sends;
+    to->lateness_total_ns += from->lateness_total_ns;
+    if (from->lateness_max_ns > to->lateness_max_ns) {
+        to->lateness_max_ns = from->lateness_max_ns;
+    }
+    if (from->arena_high_water > to->arena_high_water) {
+        to->arena_high_water = from->arena_high_water;
+    }
+    to->digest_rows += from->digest_rows;
+    to->digest_bytes += from->digest_bytes;
+    to->verify_checked += from->verify_checked;
+    to->verify_mismatches += from->verify_mismatches;
+    to->verify_recorded += from->verify_recorded;
+}
+
+void pst_stats_Report(const PstScenario* scenario, const PstRunStats* stats) {
+    pst_print_PrintRunSummary(stats);
+
+    PstHistogram total;
+    if (pst_histogram_Init(&total, PST_HISTOGRAM_LOWEST, PST_HISTOGRAM_HIGHEST, PST_HISTOGRAM_SIGNIFICANT_FIGURES) != RET_OK) {
+        pst_histogram_Free(&total);
+        return;
+    }
+
+    char label[32];
+    pst_print_PrintHistogramHeader();
+    for (unsigned long i = 0; i < g_count; i++) {
+        snprintf(label, sizeof(label), "Statement[%lu]", i);
+        pst_print_PrintHistogram(label, &g_histograms[i], stats->seconds);
+        pst_histogram_Add(&total, &g_histograms[i]);
+    }
+    pst_print_PrintHistogram("Total", &total, stats->seconds);
+
+    if (scenario->hdr_log[0] != '\0') {
+        FILE* file = fopen(scenario->hdr_log, "w");
+        if (file == NULL) {
+            log_error(PST_FORMAT_MSG_ERR_FOPEN, scenario->hdr_log);
+        } else {
+            struct timespec now;
+            clock_gettime(CLOCK_REALTIME, &now);
+            double end_time = now.tv_sec + now.tv_nsec / 1e9;
+
+            pst_histogram_WriteLogHeader(file, end_time - stats->seconds);
+            for (unsigned long i = 0; i < g_count; i++) {
+                snprintf(label, sizeof(label), "stmt%lu", i);
+                pst_histogram_WriteLogInterval(file, label, 0, stats->seconds, &g_histograms[i]);
+            }
+            pst_histogram_WriteLogInterval(file, "total", 0, stats->seconds, &total);
+            fclose(file);
+            log_info("Latency histograms written to '%s'.", scenario->hdr_log);
+        }
+    }
+
+    pst_histogram_Free(&total);
+
+    pst_timing_Report();
+    pst_print_Flush();
+}
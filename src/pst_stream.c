@@ -0,0 +1,829 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "cJSON.h"
+#include "log.h"
+#include "pst_stream.h"
+
+/* text read from a stream is given back to the kernel in steps of this size */
+#define PST_STREAM_RELEASE_SIZE (16 * 1024 * 1024)
+
+static int ParseSet(const char* p, const char* end, PstParameter** param, unsigned long* count);
+static int ToParameters(const cJSON* cjson_parameter, PstParameter** param, unsigned long* count);
+static int ParseRecord(const PstParamStream* stream, const char* p, const char* end, bool borrow,
+    PstParameter** param, unsigned long* count, const char** next);
+static int ToValue(const PstParamStream* stream, const PstParameter* column, const char* field, unsigned long length,
+    bool quoted, bool escaped, bool borrow, PstParameter* value);
+static char* Unescape(const PstParamStream* stream, const char* field, unsigned long* length, bool escaped);
+static bool EndsQuoted(const char* p, const char* end, bool quoted);
+static int ToJsonValue(const cJSON* cjson_value, PstParameter* value);
+static void SetInteger(PstParameter* value, long long integer);
+static void SetReal(PstParameter* value, double real);
+static int SetTime(PstParameter* value, const char* text);
+static bool IsTime(PstFieldTypes type);
+static void Release(PstParamStream* stream);
+static void ReleaseRange(const PstParamStream* stream, const char* from, const char* to);
+
+const char* pst_stream_SkipSpace(const char* p, const char* end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) {
+        p++;
+    }
+    return p;
+}
+
+const char* pst_stream_SkipString(const char* p, const char* end) {
+    for (p++; p < end; p++) {
+        if (*p == '\\') {
+            p++;
+        } else if (*p == '"') {
+            return p + 1;
+        }
+    }
+    return NULL;
+}
+
+const char* pst_stream_SkipValue(const char* p, const char* end) {
+    if (p >= end) {
+        return NULL;
+    }
+
+    if (*p == '"') {
+        return pst_stream_SkipString(p, end);
+    }
+
+    if (*p == '[' || *p == '{') {
+        unsigned long depth = 0;
+        while (p < end) {
+            if (*p == '"') {
+                p = pst_stream_SkipString(p, end);
+                if (p == NULL) {
+                    return NULL;
+                }
+                continue;
+            }
+            if (*p == '[' || *p == '{') {
+                depth++;
+            } else if ((*p == ']' || *p == '}') && --depth == 0) {
+                return p + 1;
+            }
+            p++;
+        }
+        return NULL;
+    }
+
+    /* number, true, false or null */
+    const char* start = p;
+    while (p < end && strchr(",]} \t\n\r", *p) == NULL) {
+        p++;
+    }
+    return p == start ? NULL : p;
+}
+
+const char* pst_stream_Open(PstParamStream* stream, const char* array, const char* end, bool mapped) {
+    stream->begin = array + 1;
+    stream->mapped = mapped;
+    stream->unread = false;
+    pst_stream_Rewind(stream);
+
+    /* element by element, so the pages read so far can be released */
+    const char* p = pst_stream_SkipSpace(array + 1, end);
+    while (p < end && *p != ']') {
+        p = pst_stream_SkipValue(p, end);
+        if (p == NULL) {
+            return NULL;
+        }
+        p = pst_stream_SkipSpace(p, end);
+        if (p < end && *p == ',') {
+            p = pst_stream_SkipSpace(p + 1, end);
+        }
+
+        stream->cursor = p;
+        Release(stream);
+    }
+    if (p == end) {
+        return NULL;
+    }
+
+    ReleaseRange(stream, stream->released, p);
+    stream->end = p;
+    pst_stream_Rewind(stream);
+
+    return p + 1;
+}
+
+void pst_stream_OpenUnread(PstParamStream* stream, const char* array, const char* end, bool mapped) {
+    stream->begin = array + 1;
+    stream->end = end;
+    stream->mapped = mapped;
+    stream->unread = true;
+    pst_stream_Rewind(stream);
+}
+
+int pst_stream_OpenFile(PstParamStream* stream, const char* filename) {
+    memset(stream, 0, sizeof(PstParamStream));
+    stream->lines = true;
+
+    struct stat st;
+    bool is_stdin = strcmp(filename, "-") == 0;
+    if (!is_stdin && stat(filename, &st) != 0) {
+        log_error(PST_FORMAT_MSG_ERR_FOPEN, filename);
+        return RET_ERR;
+    }
+
+    if (!is_stdin && S_ISREG(st.st_mode) && st.st_size > 0) {
+        stream->map = pst_MapFile(filename, &stream->map_size, &stream->mapped);
+        if (stream->map == NULL) {
+            return RET_ERR;
+        }
+        stream->begin = stream->map;
+        stream->end = stream->map + stream->map_size;
+        pst_stream_Rewind(stream);
+        return RET_OK;
+    }
+
+    stream->pipe = is_stdin ? stdin : fopen(filename, "r");
+    if (stream->pipe == NULL) {
+        log_error(PST_FORMAT_MSG_ERR_FOPEN, filename);
+        return RET_ERR;
+    }
+
+    return RET_OK;
+}
+
+void pst_stream_Close(PstParamStream* stream) {
+    if (stream->map != NULL) {
+        pst_UnmapFile(stream->map, stream->map_size, stream->mapped);
+        stream->map = NULL;
+    }
+    if (stream->pipe != NULL && stream->pipe != stdin) {
+        fclose((FILE*)stream->pipe);
+    }
+    stream->pipe = NULL;
+    free(stream->line);
+    stream->line = NULL;
+    pst_stream_FreeParameters(stream->peeked, stream->peeked_count);
+    stream->peeked = NULL;
+    free(stream->columns);
+    stream->columns = NULL;
+}
+
+void pst_stream_SetColumns(PstParamStream* stream, char delimiter, PstParameter* columns, unsigned long columns_size) {
+    stream->delimiter = delimiter;
+    stream->columns = columns;
+    stream->columns_size = columns_size;
+
+    /* strings of a mapped file are borrowed by the sets */
+    for (unsigned long k = 0; stream->map != NULL && k < columns_size; k++) {
+        if (columns[k].buffer_type == MYSQL_TYPE_STRING || columns[k].buffer_type == MYSQL_TYPE_BLOB) {
+            stream->lent = true;
+        }
+    }
+}
+
+int pst_stream_Next(PstParamStream* stream, PstParameter** param, unsigned long* count) {
+    PstSetText text;
+    if (pst_stream_Take(stream, param, count, &text) != RET_OK) {
+        return RET_ERR;
+    }
+    if (text.begin == NULL) {
+        return RET_OK;
+    }
+
+    return pst_stream_Parse(&text, param, count);
+}
+
+int pst_stream_Take(PstParamStream* stream, PstParameter** param, unsigned long* count, PstSetText* text) {
+    *param = NULL;
+    memset(text, 0, sizeof(PstSetText));
+    text->stream = stream;
+
+    if (stream->peeked != NULL) {
+        *param = stream->peeked;
+        *count = stream->peeked_count;
+        stream->peeked = NULL;
+        return RET_OK;
+    }
+
+    if (stream->pipe != NULL) {
+        /* the next line that is not blank, spaces are data in CSV and TSV */
+        ssize_t length = 0;
+        const char* p = NULL;
+        do {
+            length = getline(&stream->line, &stream->line_size, (FILE*)stream->pipe);
+            if (length < 0) {
+                if (ferror((FILE*)stream->pipe)) {
+                    log_error("Can not read parameter_file");
+                    return RET_ERR;
+                }
+                return RET_OK;
+            }
+            p = stream->line;
+            while (p < stream->line + length && (*p == '\n' || *p == '\r' ||
+                (stream->delimiter == '\0' && (*p == ' ' || *p == '\t')))) {
+                p++;
+            }
+        } while (p == stream->line + length);
+
+        /* the line buffer is read over by the next set, nothing is borrowed */
+        size_t offset = stream->delimiter != '\0' ? 0 : p - stream->line;
+        size_t size = length;
+        text->copy = (char*)malloc(size);
+        if (text->copy == NULL) {
+            log_error(PST_FORMAT_MSG_ERR_ALLOC, "parameter");
+            return RET_ERR;
+        }
+        memcpy(text->copy, stream->line, size);
+
+        /* a quoted CSV field goes on over the next lines */
+        bool quoted = stream->delimiter == ',' && EndsQuoted(stream->line, stream->line + length, false);
+        while (quoted && (length = getline(&stream->line, &stream->line_size, (FILE*)stream->pipe)) >= 0) {
+            char* copy = (char*)realloc(text->copy, size + length);
+            if (copy == NULL) {
+                log_error(PST_FORMAT_MSG_ERR_ALLOC, "parameter");
+                free(text->copy);
+                text->copy = NULL;
+                return RET_ERR;
+            }
+            text->copy = copy;
+            memcpy(text->copy + size, stream->line, length);
+            size += length;
+            quoted = EndsQuoted(stream->line, stream->line + length, true);
+        }
+        if (quoted && ferror((FILE*)stream->pipe)) {
+            log_error("Can not read parameter_file");
+            free(text->copy);
+            text->copy = NULL;
+            return RET_ERR;
+        }
+
+        text->begin = text->copy + offset;
+        text->end = text->copy + size;
+        return RET_OK;
+    }
+
+    if (stream->delimiter != '\0') {
+        const char* p = stream->cursor;
+        while (p < stream->end && (*p == '\n' || *p == '\r')) {
+            p++;
+        }
+        if (p == stream->end) {
+            return RET_OK;
+        }
+
+        /* only the end of the record is looked for here */
+        if (ParseRecord(stream, p, stream->end, true, NULL, count, &stream->cursor) != RET_OK) {
+            return RET_ERR;
+        }
+        text->begin = p;
+        text->end = stream->cursor;
+        Release(stream);
+        return RET_OK;
+    }
+
+    const char* p = pst_stream_SkipSpace(stream->cursor, stream->end);
+    if (p == stream->end) {
+        return RET_OK;
+    }
+    if (*p == ']' && stream->unread) {
+        /* the end of an array opened by pst_stream_OpenUnread */
+        stream->end = p;
+        stream->unread = false;
+        return RET_OK;
+    }
+    if (stream->cursor != stream->begin && !stream->lines) {
+        if (*p != ',') {
+            log_error("Expected ',' between parameter sets, found '%c'", *p);
+            return RET_ERR;
+        }
+        p = pst_stream_SkipSpace(p + 1, stream->end);
+    }
+
+    const char* value_end = pst_stream_SkipValue(p, stream->end);
+    if (value_end == NULL) {
+        log_error("parameter is not found or is null");
+        return RET_ERR;
+    }
+
+    text->begin = p;
+    text->end = value_end;
+    stream->cursor = value_end;
+    Release(stream);
+
+    return RET_OK;
+}
+
+int pst_stream_Parse(PstSetText* text, PstParameter** param, unsigned long* count) {
+    int ret = RET_OK;
+    if (text->stream->delimiter != '\0') {
+        const char* next = NULL;
+        ret = ParseRecord(text->stream, text->begin, text->end, text->copy == NULL, param, count, &next);
+    } else {
+        ret = ParseSet(text->begin, text->end, param, count);
+    }
+
+    free(text->copy);
+    text->copy = NULL;
+    text->begin = NULL;
+
+    return ret;
+}
+
+void pst_stream_OpenCompiled(PstParamStream* stream, const char* begin, const char* end, unsigned long sets_size, bool mapped) {
+    memset(stream, 0, sizeof(PstParamStream));
+    stream->compiled = true;
+    stream->mapped = mapped;
+    stream->begin = begin;
+    stream->end = end;
+    stream->sets_size = sets_size;
+    pst_stream_Rewind(stream);
+}
+
+int pst_stream_NextCompiled(PstParamStream* stream, unsigned long count, const PstCompiledValue** set) {
+    *set = NULL;
+    /* counted, a set without values takes no bytes */
+    if (stream->sets_read == stream->sets_size) {
+        return RET_OK;
+    }
+
+    /* only the bounds are checked, the values are bound as they are */
+    const PstCompiledValue* value = (const PstCompiledValue*)stream->cursor;
+    for (unsigned long k = 0; k < count; k++) {
+        if ((const char*)(value + 1) > stream->end ||
+            PST_COMPILED_PAD(value->length) > (uint64_t)(stream->end - PST_COMPILED_DATA(value))) {
+            log_error("Compiled parameter set is truncated");
+            return RET_ERR;
+        }
+        value = PST_COMPILED_NEXT(value);
+    }
+
+    *set = (const PstCompiledValue*)stream->cursor;
+    stream->cursor = (const char*)value;
+    stream->sets_read++;
+    Release(stream);
+
+    return RET_OK;
+}
+
+int pst_stream_Peek(PstParamStream* stream, unsigned long* count) {
+    PstParameter* param = NULL;
+    *count = PST_STREAM_ANY_COUNT;
+    if (pst_stream_Next(stream, &param, count) != RET_OK) {
+        return RET_ERR;
+    }
+    if (param == NULL) {
+        return RET_OK;
+    }
+
+    /* a pipe can not go back, it keeps the set for the first pst_stream_Next */
+    if (stream->pipe != NULL) {
+        stream->peeked = param;
+        stream->peeked_count = *count;
+    } else {
+        pst_stream_FreeParameters(param, *count);
+        pst_stream_Rewind(stream);
+    }
+
+    return RET_OK;
+}
+
+void pst_stream_Rewind(PstParamStream* stream) {
+    stream->cursor = stream->begin;
+    stream->released = stream->begin;
+    stream->sets_read = 0;
+}
+
+int pst_stream_ParseType(const cJSON* object, PstParameter* param) {
+    const cJSON* cjson_type = cJSON_GetObjectItemCaseSensitive(object, "type");
+    if (!cJSON_IsString(cjson_type)) {
+        log_error("type is not found or is null");
+        return RET_ERR;
+    }
+    log_debug("type: %s", cjson_type->valuestring);
+
+    /* "null" is the only name that resolves to MYSQL_TYPE_NULL */
+    char buffer[16];
+    param->buffer_type = pst_ToMySQLFieldType(cjson_type->valuestring);
+    if (param->buffer_type == MYSQL_TYPE_NULL &&
+        (strlen(cjson_type->valuestring) >= sizeof(buffer) || strcmp(pst_Upper(cjson_type->valuestring, buffer, sizeof(buffer)), "NULL") != 0)) {
+        log_error("type '%s' is not supported", cjson_type->valuestring);
+        return RET_ERR;
+    }
+
+    param->is_unsigned = cJSON_IsTrue(cJSON_GetObjectItemCaseSensitive(object, "unsigned"));
+    log_debug("unsigned: %s", param->is_unsigned ? "true" : "false");
+
+    return RET_OK;
+}
+
+void pst_stream_FreeParameters(PstParameter* param, unsigned long count) {
+    if (param == NULL) {
+        return;
+    }
+
+    for (unsigned long k = 0; k < count; k++) {
+        if (!param[k].borrowed) {
+            free(param[k].valuestring);
+        }
+        if (IsTime(param[k].buffer_type)) {
+            free(param[k].value.time);
+        }
+    }
+    free(param);
+}
+
+/* static functions */
+static int ParseSet(const char* p, const char* end, PstParameter** param, unsigned long* count) {
+    cJSON* cjson_parameter = cJSON_ParseWithLength(p, end - p);
+    if (cjson_parameter == NULL) {
+        size_t length = end - p;
+        log_error("Can not parse parameter set '%.*s'", (int)(length < 64 ? length : 64), p);
+        return RET_ERR;
+    }
+    int ret = ToParameters(cjson_parameter, param, count);
+    cJSON_Delete(cjson_parameter);
+
+    return ret;
+}
+
+static int ToParameters(const cJSON* cjson_parameter, PstParameter** param, unsigned long* count) {
+    if (!cJSON_IsArray(cjson_parameter)) {
+        log_error("parameter is not found or is null");
+        return RET_ERR;
+    }
+
+    unsigned long cjson_parameter_count = (unsigned long)cJSON_GetArraySize(cjson_parameter);
+    if (*count != PST_STREAM_ANY_COUNT && cjson_parameter_count != *count) {
+        log_error("Parameter set has %lu values, the statement has %lu", cjson_parameter_count, *count);
+        return RET_ERR;
+    }
+
+    PstParameter* values = (PstParameter*)calloc(cjson_parameter_count > 0 ? cjson_parameter_count : 1, sizeof(PstParameter));
+    if (values == NULL) {
+        log_error(PST_FORMAT_MSG_ERR_ALLOC, "parameter");
+        return RET_ERR;
+    }
+
+    unsigned long k = 0;
+    const cJSON* cjson_parameter_item = NULL;
+    cJSON_ArrayForEach(cjson_parameter_item, cjson_parameter) {
+        if (!cJSON_IsObject(cjson_parameter_item)) {
+            log_error("parameter is not an object");
+            pst_stream_FreeParameters(values, cjson_parameter_count);
+            return RET_ERR;
+        }
+
+        if (pst_stream_ParseType(cjson_parameter_item, &values[k]) != RET_OK ||
+            ToJsonValue(cJSON_GetObjectItemCaseSensitive(cjson_parameter_item, "value"), &values[k]) != RET_OK) {
+            pst_stream_FreeParameters(values, cjson_parameter_count);
+            return RET_ERR;
+        }
+        k++;
+    }
+
+    *param = values;
+    *count = cjson_parameter_count;
+
+    return RET_OK;
+}
+
+/* The value of a parameter object in the width of its resolved type */
+static int ToJsonValue(const cJSON* cjson_value, PstParameter* value) {
+    if (value->buffer_type == MYSQL_TYPE_NULL) {
+        return RET_OK;
+    }
+    if (!cJSON_IsNumber(cjson_value) && !(cJSON_IsString(cjson_value) && cjson_value->valuestring != NULL)) {
+        log_error("value is not found or is null");
+        return RET_ERR;
+    }
+
+    switch (value->buffer_type) {
+    case MYSQL_TYPE_TINY:
+    case MYSQL_TYPE_SHORT:
+    case MYSQL_TYPE_LONG:
+    case MYSQL_TYPE_LONGLONG:
+    case MYSQL_TYPE_FLOAT:
+    case MYSQL_TYPE_DOUBLE:
+        if (!cJSON_IsNumber(cjson_value)) {
+            log_error("value '%s' of a number type is not a number", cjson_value->valuestring);
+            return RET_ERR;
+        }
+        log_debug("value: %lf", cjson_value->valuedouble);
+        if (value->buffer_type == MYSQL_TYPE_FLOAT || value->buffer_type == MYSQL_TYPE_DOUBLE) {
+            SetReal(value, cjson_value->valuedouble);
+        } else if (value->is_unsigned && cjson_value->valuedouble >= 0) {
+            SetInteger(value, (long long)(unsigned long long)cjson_value->valuedouble);
+        } else {
+            SetInteger(value, (long long)cjson_value->valuedouble);
+        }
+        return RET_OK;
+    default:
+        break;
+    }
+
+    if (!cJSON_IsString(cjson_value)) {
+        log_error("value %g of a string or time type is not a string", cjson_value->valuedouble);
+        return RET_ERR;
+    }
+    log_debug("value: %s", cjson_value->valuestring);
+    if (IsTime(value->buffer_type)) {
+        return SetTime(value, cjson_value->valuestring);
+    }
+
+    value->valuestring = strdup(cjson_value->valuestring);
+    if (value->valuestring == NULL) {
+        log_error(PST_FORMAT_MSG_ERR_ALLOC, "parameter value");
+        return RET_ERR;
+    }
+    value->length = strlen(value->valuestring);
+
+    return RET_OK;
+}
+
+/* Converted to the width of the type as a C cast does */
+static void SetInteger(PstParameter* value, long long integer) {
+    switch (value->buffer_type) {
+    case MYSQL_TYPE_TINY:
+        value->value.tiny = (signed char)integer;
+        value->length = sizeof(signed char);
+        break;
+    case MYSQL_TYPE_SHORT:
+        value->value.small = (short)integer;
+        value->length = sizeof(short);
+        break;
+    case MYSQL_TYPE_LONG:
+        value->value.integer = (int)integer;
+        value->length = sizeof(int);
+        break;
+    default:
+        value->value.big = integer;
+        value->length = sizeof(long long);
+        break;
+    }
+}
+
+static void SetReal(PstParameter* value, double real) {
+    if (value->buffer_type == MYSQL_TYPE_FLOAT) {
+        value->value.real = (float)real;
+        value->length = sizeof(float);
+    } else {
+        value->value.dbl = real;
+        value->length = sizeof(double);
+    }
+}
+
+static int SetTime(PstParameter* value, const char* text) {
+    value->value.time = (MYSQL_TIME*)malloc(sizeof(MYSQL_TIME));
+    if (value->value.time == NULL) {
+        log_error(PST_FORMAT_MSG_ERR_ALLOC, "parameter value");
+        return RET_ERR;
+    }
+    *value->value.time = pst_ToMySQLTime(text);
+    value->length = sizeof(MYSQL_TIME);
+
+    return RET_OK;
+}
+
+static bool IsTime(PstFieldTypes type) {
+    return type == MYSQL_TYPE_TIME || type == MYSQL_TYPE_DATE ||
+        type == MYSQL_TYPE_DATETIME || type == MYSQL_TYPE_TIMESTAMP;
+}
+
+/**
+ *  One record of a CSV or TSV parameter_file from p, *next is after its
+ *  line end. A CSV field may be quoted, with "" for a quote and line ends
+ *  inside; a TSV field escapes tab, line end and backslash with a backslash
+ *  as mysql --batch writes them. Strings of a mapped file are borrowed
+ *  unless they have to be unescaped. With param NULL only *next is found.
+ */
+static int ParseRecord(const PstParamStream* stream, const char* p, const char* end, bool borrow,
+    PstParameter** param, unsigned long* count, const char** next) {
+    PstParameter* values = NULL;
+    if (param != NULL) {
+        values = (PstParameter*)calloc(stream->columns_size, sizeof(PstParameter));
+        if (values == NULL) {
+            log_error(PST_FORMAT_MSG_ERR_ALLOC, "parameter");
+            return RET_ERR;
+        }
+    }
+
+    const char* record = p;
+    unsigned long fields = 0;
+    while (true) {
+        const char* field = p;
+        unsigned long length = 0;
+        bool quoted = stream->delimiter == ',' && p < end && *p == '"';
+        bool escaped = false;
+        if (quoted) {
+            field = ++p;
+            while (p < end && (*p != '"' || (p + 1 < end && p[1] == '"'))) {
+                escaped = escaped || *p == '"';
+                p += *p == '"' ? 2 : 1;
+            }
+            if (p == end) {
+                log_error("Quoted field is not closed in '%.*s'", (int)(end - record < 64 ? end - record : 64), record);
+                pst_stream_FreeParameters(values, stream->columns_size);
+                return RET_ERR;
+            }
+            length = p++ - field;
+            if (p < end && *p == '\r') {
+                p++;
+            }
+        } else {
+            while (p < end && *p != stream->delimiter && *p != '\n') {
+                escaped = escaped || *p == '\\';
+                p++;
+            }
+            length = p - field;
+            if (length > 0 && field[length - 1] == '\r' && (p == end || *p == '\n')) {
+                length--;
+            }
+        }
+
+        if (values != NULL && fields < stream->columns_size &&
+            ToValue(stream, &stream->columns[fields], field, length, quoted, escaped, borrow, &values[fields]) != RET_OK) {
+            pst_stream_FreeParameters(values, stream->columns_size);
+            return RET_ERR;
+        }
+        fields++;
+
+        if (p < end && *p == stream->delimiter) {
+            p++;
+            continue;
+        }
+        if (p < end && *p != '\n') {
+            log_error("Expected '%c' or a line end after a quoted field, found '%c'", stream->delimiter, *p);
+            pst_stream_FreeParameters(values, stream->columns_size);
+            return RET_ERR;
+        }
+        break;
+    }
+
+    if (fields != stream->columns_size) {
+        log_error("Parameter set has %lu fields, the statement has %lu columns", fields, stream->columns_size);
+        pst_stream_FreeParameters(values, stream->columns_size);
+        return RET_ERR;
+    }
+
+    if (param != NULL) {
+        *param = values;
+        *count = stream->columns_size;
+    }
+    *next = p < end ? p + 1 : p;
+
+    return RET_OK;
+}
+
+/* \\N of TSV, or an empty field of CSV that is not a string, is NULL */
+static int ToValue(const PstParamStream* stream, const PstParameter* column, const char* field, unsigned long length,
+    bool quoted, bool escaped, bool borrow, PstParameter* value) {
+    value->buffer_type = column->buffer_type;
+    value->is_unsigned = column->is_unsigned;
+
+    bool is_null = stream->delimiter == '\t' ? length == 2 && field[0] == '\\' && field[1] == 'N'
+        : length == 0 && value->buffer_type != MYSQL_TYPE_STRING && value->buffer_type != MYSQL_TYPE_BLOB && !quoted;
+    if (is_null) {
+        value->buffer_type = MYSQL_TYPE_NULL;
+        return RET_OK;
+    }
+
+    /* the field is not terminated, numbers are parsed from a copy */
+    char buffer[64];
+    char* number_end = NULL;
+    if (length > 0 && length < sizeof(buffer)) {
+        memcpy(buffer, field, length);
+        buffer[length] = '\0';
+    }
+
+    switch (value->buffer_type) {
+    case MYSQL_TYPE_TINY:
+    case MYSQL_TYPE_SHORT:
+    case MYSQL_TYPE_LONG:
+    case MYSQL_TYPE_LONGLONG:
+        if (length > 0 && length < sizeof(buffer)) {
+            SetInteger(value, value->is_unsigned ? (long long)strtoull(buffer, &number_end, 10) : strtoll(buffer, &number_end, 10));
+        }
+        break;
+    case MYSQL_TYPE_FLOAT:
+    case MYSQL_TYPE_DOUBLE:
+        if (length > 0 && length < sizeof(buffer)) {
+            SetReal(value, strtod(buffer, &number_end));
+        }
+        break;
+    case MYSQL_TYPE_STRING:
+    case MYSQL_TYPE_BLOB:
+        if (borrow && !escaped) {
+            value->valuestring = (char*)field;
+            value->length = length;
+            value->borrowed = true;
+            return RET_OK;
+        }
+        value->length = length;
+        value->valuestring = Unescape(stream, field, &value->length, escaped);
+        if (value->valuestring == NULL) {
+            log_error(PST_FORMAT_MSG_ERR_ALLOC, "parameter value");
+            return RET_ERR;
+        }
+        return RET_OK;
+    case MYSQL_TYPE_TIME:
+    case MYSQL_TYPE_DATE:
+    case MYSQL_TYPE_DATETIME:
+    case MYSQL_TYPE_TIMESTAMP: {
+        unsigned long text_length = length;
+        char* text = Unescape(stream, field, &text_length, escaped);
+        if (text == NULL) {
+            log_error(PST_FORMAT_MSG_ERR_ALLOC, "parameter value");
+            return RET_ERR;
+        }
+        int ret = SetTime(value, text);
+        free(text);
+        return ret;
+    }
+    default:
+        return RET_OK;
+    }
+
+    if (number_end != buffer + length) {
+        log_error("'%.*s' is not a number", (int)(length < 64 ? length : 64), field);
+        return RET_ERR;
+    }
+
+    return RET_OK;
+}
+
+/* A terminated copy of the field, *length is its length before and after */
+static char* Unescape(const PstParamStream* stream, const char* field, unsigned long* length, bool escaped) {
+    char* str = (char*)malloc(*length + 1);
+    if (str == NULL) {
+        return NULL;
+    }
+
+    unsigned long n = 0;
+    for (unsigned long i = 0; i < *length; i++) {
+        char c = field[i];
+        if (!escaped) {
+            /* as it is */
+        } else if (stream->delimiter == ',' && c == '"') {
+            /* "" inside a quoted field */
+            i++;
+        } else if (stream->delimiter == '\t' && c == '\\' && i + 1 < *length) {
+            c = field[++i];
+            c = c == 't' ? '\t' : c == 'n' ? '\n' : c == 'r' ? '\r' : c == '0' ? '\0' : c;
+        }
+        str[n++] = c;
+    }
+    str[n] = '\0';
+    *length = n;
+
+    return str;
+}
+
+/**
+ *  Whether a CSV line [p, end) ends inside a quoted field, quoted tells
+ *  whether it starts inside one. Fields are taken as ParseRecord does, a
+ *  quote opens a field only at its start and "" inside it is a quote.
+ */
+static bool EndsQuoted(const char* p, const char* end, bool quoted) {
+    bool field_start = !quoted;
+    for (; p < end; p++) {
+        if (quoted && *p == '"' && p + 1 < end && p[1] == '"') {
+            p++;
+        } else if (quoted && *p == '"') {
+            quoted = false;
+        } else if (!quoted && field_start && *p == '"') {
+            quoted = true;
+        }
+        field_start = !quoted && *p == ',';
+    }
+
+    return quoted;
+}
+
+/* Drop the pages behind the cursor, they are read again from the file */
+/* after a rewind */
+static void Release(PstParamStream* stream) {
+    if (stream->cursor - stream->released < PST_STREAM_RELEASE_SIZE) {
+        return;
+    }
+
+    ReleaseRange(stream, stream->released, stream->cursor);
+    stream->released = stream->cursor;
+}
+
+/* Whole pages only, the text is mapped read-only from the file */
+static void ReleaseRange(const PstParamStream* stream, const char* from, const char* to) {
+    if (!stream->mapped) {
+        return;
+    }
+
+    uintptr_t page_size = (uintptr_t)sysconf(_SC_PAGESIZE);
+    uintptr_t first = ((uintptr_t)from + page_size - 1) & ~(page_size - 1);
+    uintptr_t last = (uintptr_t)to & ~(page_size - 1);
+    if (last > first) {
+        madvise((void*)first, last - first, MADV_DONTNEED);
+    }
+}
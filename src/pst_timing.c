@@ -0,0 +1,75 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "log.h"
+#include "pst_timing.h"
+#include "pst_histogram.h"
+#include "pst_print.h"
+
+/* phases are recorded in nanoseconds, fetch and format are summed per execution */
+#define PST_TIMING_HIGHEST 3600000000000LL
+
+static const char* phase_names[PstPhase_Count] = {
+    "prepare", "bind", "execute", "store", "fetch", "format", "print", "first row", "last row"
+};
+
+/* global variables */
+static PstHistogram* g_histograms = NULL;
+static uint64_t g_totals[PstPhase_Count];
+
+int pst_timing_Init() {
+    g_histograms = (PstHistogram*)malloc(PstPhase_Count * sizeof(PstHistogram));
+    if (g_histograms == NULL) {
+        log_error(PST_FORMAT_MSG_ERR_ALLOC, "timing histograms");
+        return RET_ERR;
+    }
+    memset(g_histograms, 0, PstPhase_Count * sizeof(PstHistogram));
+    memset(g_totals, 0, sizeof(g_totals));
+
+    for (int i = 0; i < PstPhase_Count; i++) {
+        if (pst_histogram_Init(&g_histograms[i], PST_HISTOGRAM_LOWEST, PST_TIMING_HIGHEST, PST_HISTOGRAM_SIGNIFICANT_FIGURES) != RET_OK) {
+            return RET_ERR;
+        }
+    }
+
+    return RET_OK;
+}
+
+void pst_timing_Free() {
+    if (g_histograms) {
+        for (int i = 0; i < PstPhase_Count; i++) {
+            pst_histogram_Free(&g_histograms[i]);
+        }
+        free(g_histograms);
+        g_histograms = NULL;
+    }
+}
+
+void pst_timing_Record(PstPhase phase, uint64_t ns) {
+    if (g_histograms == NULL) {
+        return;
+    }
+
+    pst_histogram_Record(&g_histograms[phase], (int64_t)ns);
+    __atomic_fetch_add(&g_totals[phase], ns, __ATOMIC_RELAXED);
+}
+
+void pst_timing_Report() {
+    if (g_histograms == NULL) {
+        return;
+    }
+
+    pst_print_PrintPhaseHeader();
+    for (int i = 0; i < PstPhase_Count; i++) {
+        if (g_histograms[i].total_count > 0) {
+            pst_print_PrintPhase(phase_names[i], &g_histograms[i], g_totals[i]);
+        }
+    }
+
+    /* execute, store and fetch wait on the server and the network, */
+    /* bind, format and print are PSTest's own overhead */
+    uint64_t server_ns = g_totals[PstPhase_Execute] + g_totals[PstPhase_Store] + g_totals[PstPhase_Fetch];
+    uint64_t client_ns = g_totals[PstPhase_Bind] + g_totals[PstPhase_Format] + g_totals[PstPhase_Print];
+    pst_print_PrintPhaseSplit(server_ns, client_ns);
+}
@@ -0,0 +1,237 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "cJSON.h"
+#include "log.h"
+#include "pst_verify.h"
+
+typedef struct PstVerifier {
+    pthread_mutex_t mutex;
+    const PstPreparedStatements* prep_stmts;
+    /* expectations of every statement, filled in when recording */
+    PstExpect** expects;
+    /* entries of expects[i], they grow with the sets of a streamed statement */
+    unsigned long* expects_sizes;
+    /* statements in expects */
+    unsigned long size;
+    bool record;
+    unsigned long mismatches;
+} PstVerifier;
+
+/* global variables */
+static PstVerifier g_verifier;
+
+static int GrowExpects(unsigned long stmt_index, unsigned long size);
+
+int pst_verify_Init(const PstPreparedStatements* prep_stmts, bool record) {
+    memset(&g_verifier, 0, sizeof(PstVerifier));
+    if (pthread_mutex_init(&g_verifier.mutex, NULL) != 0) {
+        log_error("Failed to initialize verifier mutex");
+        return RET_ERR;
+    }
+    g_verifier.prep_stmts = prep_stmts;
+    g_verifier.record = record;
+
+    return pst_verify_AddStatements(prep_stmts);
+}
+
+int pst_verify_AddStatements(const PstPreparedStatements* prep_stmts) {
+    unsigned long size = prep_stmts->prep_stmt_size;
+    if (size <= g_verifier.size) {
+        return RET_OK;
+    }
+
+    pthread_mutex_lock(&g_verifier.mutex);
+    PstExpect** expects = (PstExpect**)realloc(g_verifier.expects, size * sizeof(PstExpect*));
+    if (expects != NULL) {
+        g_verifier.expects = expects;
+    }
+    unsigned long* expects_sizes = (unsigned long*)realloc(g_verifier.expects_sizes, size * sizeof(unsigned long));
+    if (expects_sizes != NULL) {
+        g_verifier.expects_sizes = expects_sizes;
+    }
+    if (expects == NULL || expects_sizes == NULL) {
+        pthread_mutex_unlock(&g_verifier.mutex);
+        log_error(PST_FORMAT_MSG_ERR_ALLOC, "expects");
+        return RET_ERR;
+    }
+    memset(expects + g_verifier.size, 0, (size - g_verifier.size) * sizeof(PstExpect*));
+    memset(expects_sizes + g_verifier.size, 0, (size - g_verifier.size) * sizeof(unsigned long));
+    unsigned long first = g_verifier.size;
+    g_verifier.size = size;
+
+    int ret = RET_OK;
+    for (unsigned long i = first; i < size && ret == RET_OK; i++) {
+        const PstPreparedStatement* prep_stmt = &prep_stmts->prep_stmt[i];
+        /* none yet for streamed parameter sets without expect */
+        if (prep_stmt->expects_size == 0) {
+            continue;
+        }
+        g_verifier.expects[i] = (PstExpect*)calloc(prep_stmt->expects_size, sizeof(PstExpect));
+        if (g_verifier.expects[i] == NULL) {
+            log_error(PST_FORMAT_MSG_ERR_ALLOC, "expects");
+            ret = RET_ERR;
+            break;
+        }
+        memcpy(g_verifier.expects[i], prep_stmt->expects, prep_stmt->expects_size * sizeof(PstExpect));
+        g_verifier.expects_sizes[i] = prep_stmt->expects_size;
+    }
+    pthread_mutex_unlock(&g_verifier.mutex);
+
+    return ret;
+}
+
+bool pst_verify_HasExpectations(const PstPreparedStatement* prep_stmt) {
+    for (unsigned long j = 0; j < prep_stmt->expects_size; j++) {
+        if (prep_stmt->expects[j].is_set) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+PstVerifyResult pst_verify_Check(unsigned long stmt_index, unsigned long params_index, uint64_t rows, uint64_t digest) {
+    PstVerifyResult result = PstVerify_None;
+    PstExpect expected;
+
+    pthread_mutex_lock(&g_verifier.mutex);
+    if (params_index >= g_verifier.expects_sizes[stmt_index] &&
+        (!g_verifier.record || GrowExpects(stmt_index, params_index + 1) != RET_OK)) {
+        pthread_mutex_unlock(&g_verifier.mutex);
+        return result;
+    }
+
+    PstExpect* expect = &g_verifier.expects[stmt_index][params_index];
+    expected = *expect;
+    if (expect->is_set) {
+        if (expect->rows == rows && expect->digest == digest) {
+            result = PstVerify_Match;
+        } else {
+            result = PstVerify_Mismatch;
+            g_verifier.mismatches++;
+        }
+    } else if (g_verifier.record) {
+        expect->is_set = true;
+        expect->rows = rows;
+        expect->digest = digest;
+        result = PstVerify_Recorded;
+    }
+    pthread_mutex_unlock(&g_verifier.mutex);
+
+    if (result == PstVerify_Mismatch) {
+        log_error("Statement[%lu] Parameter[%lu]: expected %llu rows, digest %016llx, got %llu rows, digest %016llx",
+            stmt_index, params_index, (unsigned long long)expected.rows, (unsigned long long)expected.digest,
+            (unsigned long long)rows, (unsigned long long)digest);
+    }
+
+    return result;
+}
+
+unsigned long pst_verify_GetMismatches() {
+    return g_verifier.mismatches;
+}
+
+int pst_verify_Write(const char* filename) {
+    cJSON* root = cJSON_CreateObject();
+    cJSON* cjson_prepared_statements = cJSON_AddArrayToObject(root, "prepared_statement");
+    if (cjson_prepared_statements == NULL) {
+        log_error(PST_FORMAT_MSG_ERR_ALLOC, "expectations");
+        cJSON_Delete(root);
+        return RET_ERR;
+    }
+
+    for (unsigned long i = 0; i < g_verifier.prep_stmts->prep_stmt_size; i++) {
+        const PstPreparedStatement* prep_stmt = &g_verifier.prep_stmts->prep_stmt[i];
+        cJSON* cjson_prepared_statement = cJSON_CreateObject();
+        cJSON_AddItemToArray(cjson_prepared_statements, cjson_prepared_statement);
+        cJSON_AddStringToObject(cjson_prepared_statement, "statement", prep_stmt->stmt);
+
+        /* the room grown past the given ones is not written */
+        unsigned long expects_size = g_verifier.expects_sizes[i];
+        while (expects_size > prep_stmt->expects_size && !g_verifier.expects[i][expects_size - 1].is_set) {
+            expects_size--;
+        }
+
+        cJSON* cjson_expects = cJSON_AddArrayToObject(cjson_prepared_statement, "expect");
+        for (unsigned long j = 0; j < expects_size; j++) {
+            const PstExpect* expect = &g_verifier.expects[i][j];
+            if (!expect->is_set) {
+                cJSON_AddItemToArray(cjson_expects, cJSON_CreateNull());
+                continue;
+            }
+
+            char digest[17];
+            snprintf(digest, sizeof(digest), "%016llx", (unsigned long long)expect->digest);
+            cJSON* cjson_expect = cJSON_CreateObject();
+            cJSON_AddItemToArray(cjson_expects, cjson_expect);
+            cJSON_AddNumberToObject(cjson_expect, "rows", (double)expect->rows);
+            cJSON_AddStringToObject(cjson_expect, "digest", digest);
+        }
+    }
+
+    char* str = cJSON_Print(root);
+    cJSON_Delete(root);
+    if (str == NULL) {
+        log_error(PST_FORMAT_MSG_ERR_ALLOC, "expectations");
+        return RET_ERR;
+    }
+
+    FILE* fp = fopen(filename, "w");
+    if (fp == NULL) {
+        log_error(PST_FORMAT_MSG_ERR_FOPEN, filename);
+        free(str);
+        return RET_ERR;
+    }
+    fprintf(fp, "%s\n", str);
+    fclose(fp);
+    free(str);
+
+    return RET_OK;
+}
+
+void pst_verify_Free() {
+    if (g_verifier.prep_stmts == NULL) {
+        return;
+    }
+
+    if (g_verifier.expects != NULL) {
+        for (unsigned long i = 0; i < g_verifier.size; i++) {
+            free(g_verifier.expects[i]);
+        }
+        free(g_verifier.expects);
+        g_verifier.expects = NULL;
+    }
+    free(g_verifier.expects_sizes);
+    g_verifier.expects_sizes = NULL;
+    pthread_mutex_destroy(&g_verifier.mutex);
+    g_verifier.prep_stmts = NULL;
+}
+
+
+/* static functions */
+/**
+ *  Room for at least size expectations of a statement, for the parameter
+ *  sets of a streamed statement recorded as they are read. Called with the
+ *  mutex held.
+ */
+static int GrowExpects(unsigned long stmt_index, unsigned long size) {
+    unsigned long expects_size = g_verifier.expects_sizes[stmt_index];
+    unsigned long grown = expects_size > 0 ? expects_size : 64;
+    while (grown < size) {
+        grown *= 2;
+    }
+
+    PstExpect* expects = (PstExpect*)realloc(g_verifier.expects[stmt_index], grown * sizeof(PstExpect));
+    if (expects == NULL) {
+        log_error(PST_FORMAT_MSG_ERR_ALLOC, "expects");
+        return RET_ERR;
+    }
+    memset(expects + expects_size, 0, (grown - expects_size) * sizeof(PstExpect));
+    g_verifier.expects[stmt_index] = expects;
+    g_verifier.expects_sizes[stmt_index] = grown;
+
+    return RET_OK;
+}
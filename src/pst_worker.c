@@ -0,0 +1,272 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "log.h"
+#include "pst_worker.h"
+#include "pst_print.h"
+#include "pst_input.h"
+#include "pst_output.h"
+#include "pst_session.h"
+#include "pst_queue.h"
+#include "pst_stats.h"
+#include "pst_verify.h"
+#include "pst_timing.h"
+
+typedef struct PstWorker {
+    pthread_t thread;
+    unsigned int id;
+    PstSession session;
+    /* output of a streamed result, collected while its rows are fetched */
+    PstPrintChunk chunk;
+    PstRunStats stats;
+    int ret;
+} PstWorker;
+
+/* global variables */
+static const PstConnection* g_conn;
+static const PstPreparedStatements* g_prep_stmts;
+static atomic_int g_abort;
+/* several workers share the output */
+static bool g_shared_output;
+
+static int ExecuteWorkItem(PstWorker* worker, const PstWorkItem* item, MYSQL_STMT* stmt, uint64_t* end);
+static void* RunWorker(void* arg);
+
+int pst_worker_Run(const PstConnection* conn, const PstPreparedStatements* prep_stmts, const PstScenario* scenario) {
+    unsigned int concurrency = scenario->concurrency;
+
+    g_conn = conn;
+    g_prep_stmts = prep_stmts;
+    g_shared_output = concurrency > 1;
+    atomic_store(&g_abort, 0);
+
+    if (pst_queue_Init(prep_stmts, scenario) != RET_OK) {
+        return RET_ERR;
+    }
+
+    if (pst_stats_Init(prep_stmts) != RET_OK) {
+        pst_stats_Free();
+        pst_queue_Free();
+        return RET_ERR;
+    }
+
+    /* the bind arrays of every pass, built once */
+    if (pst_input_Init(prep_stmts) != RET_OK) {
+        pst_stats_Free();
+        pst_queue_Free();
+        return RET_ERR;
+    }
+
+    PstWorker* workers = (PstWorker*)malloc(concurrency * sizeof(PstWorker));
+    if (workers == NULL) {
+        log_error(PST_FORMAT_MSG_ERR_ALLOC, "workers");
+        pst_input_Free();
+        pst_stats_Free();
+        pst_queue_Free();
+        return RET_ERR;
+    }
+    memset(workers, 0, concurrency * sizeof(PstWorker));
+
+    uint64_t start = pst_GetMonotonicNs();
+    pst_queue_Start(start);
+
+    unsigned int started = 0;
+    for (unsigned int i = 0; i < concurrency; i++) {
+        workers[i].id = i;
+        if (pthread_create(&workers[i].thread, NULL, RunWorker, &workers[i]) != 0) {
+            log_error("Failed to create worker thread %u", i);
+            atomic_store(&g_abort, 1);
+            break;
+        }
+        started++;
+    }
+
+    int ret = started == concurrency ? RET_OK : RET_ERR;
+    PstRunStats stats;
+    memset(&stats, 0, sizeof(PstRunStats));
+    for (unsigned int i = 0; i < started; i++) {
+        pthread_join(workers[i].thread, NULL);
+        if (workers[i].ret != RET_OK) {
+            ret = RET_ERR;
+        }
+        pst_stats_Merge(&stats, &workers[i].stats);
+    }
+
+    uint64_t elapsed = pst_GetMonotonicNs() - start;
+    if (pst_queue_Failed()) {
+        ret = RET_ERR;
+    }
+
+    if (ret == RET_OK) {
+        stats.threads = concurrency;
+        stats.connections = concurrency;
+        stats.iterations = pst_queue_GetIterations();
+        stats.seconds = elapsed / 1e9;
+        stats.rate = scenario->rate;
+        pst_stats_Report(scenario, &stats);
+    }
+
+    free(workers);
+    workers = NULL;
+    pst_input_Free();
+    pst_stats_Free();
+    pst_queue_Free();
+
+    return ret;
+}
+
+/* static functions */
+/* end is when the result was fetched, before it is printed */
+static int ExecuteWorkItem(PstWorker* worker, const PstWorkItem* item, MYSQL_STMT* stmt, uint64_t* end) {
+    const PstPreparedStatement* prep_stmt = &g_prep_stmts->prep_stmt[item->stmt_index];
+    PstSession* session = &worker->session;
+    PstParameter* param = item->param;
+
+    if (param != NULL || item->compiled != NULL) {
+        uint64_t bind_start = pst_GetMonotonicNs();
+        int bound;
+        if (item->compiled != NULL) {
+            bound = pst_input_InputCompiled(session, stmt, item->compiled, prep_stmt->param_markers_count);
+        } else if (item->owns_param) {
+            bound = pst_input_InputParameters(session, stmt, param, prep_stmt->param_markers_count);
+        } else {
+            bound = pst_input_InputPrepared(session, stmt, item->stmt_index, item->params_index, prep_stmt->param_markers_count);
+        }
+        if (bound != RET_OK) {
+            pst_input_FreeParameters(session);
+            return RET_ERR;
+        }
+        pst_timing_Record(PstPhase_Bind, pst_GetMonotonicNs() - bind_start);
+    }
+
+    session->exec_start_ns = pst_GetMonotonicNs();
+    if (mysql_stmt_execute(stmt) != 0) {
+        log_error(PST_FORMAT_MSG_ERR_MYSQL, mysql_stmt_errno(stmt), mysql_stmt_sqlstate(stmt), mysql_stmt_error(stmt));
+        pst_input_FreeParameters(session);
+        return RET_ERR;
+    }
+    pst_timing_Record(PstPhase_Execute, pst_GetMonotonicNs() - session->exec_start_ns);
+
+    pst_input_FreeParameters(session);
+
+    /* the result is fetched and formatted before the print lock is taken, */
+    /* workers only wait for each other while writing it */
+    int ret = pst_output_FetchResult(session, stmt, prep_stmt);
+    if (ret == RET_OK && (!session->digested || pst_print_GetFormat() == PstOutputFormat_Table)) {
+        /* Statement, parameter and result of one execution are printed together. */
+        /* The rows of a streamed result are fetched while they are printed, with */
+        /* other workers they are collected in the chunk and written at the end. */
+        bool collect = g_shared_output && session->fetch_end_ns == 0;
+        if (collect) {
+            pst_print_BeginChunk(&worker->chunk);
+        } else {
+            pst_print_Lock();
+        }
+        if (item->params_index == 0) {
+            pst_print_PrintStatement(prep_stmt, item->stmt_index);
+        }
+        if (item->compiled != NULL) {
+            pst_print_PrintCompiledParameter(item->compiled, prep_stmt->param_markers_count, item->params_index);
+        } else if (param != NULL) {
+            pst_print_PrintParameter(param, prep_stmt->param_markers_count, item->params_index);
+        }
+        ret = pst_output_PrintResult(session);
+        if (collect) {
+            pst_print_EndChunk();
+            pst_print_Lock();
+            pst_print_PrintChunk(&worker->chunk);
+        }
+        pst_print_Unlock();
+    }
+    *end = session->fetch_end_ns != 0 ? session->fetch_end_ns : pst_GetMonotonicNs();
+    if (session->digested) {
+        worker->stats.digest_rows += session->rows;
+        worker->stats.digest_bytes += session->result_bytes;
+
+        PstVerifyResult verified = pst_verify_Check(item->stmt_index, item->params_index, session->rows, session->digest);
+        if (verified == PstVerify_Match || verified == PstVerify_Mismatch) {
+            worker->stats.verify_checked++;
+        }
+        if (verified == PstVerify_Mismatch) {
+            worker->stats.verify_mismatches++;
+        } else if (verified == PstVerify_Recorded) {
+            worker->stats.verify_recorded++;
+        }
+    }
+
+    pst_output_FreeResult(session);
+    if (ret != RET_OK) {
+        return RET_ERR;
+    }
+
+    if (mysql_stmt_reset(stmt) != 0) {
+        log_error(PST_FORMAT_MSG_ERR_MYSQL, mysql_stmt_errno(stmt), mysql_stmt_sqlstate(stmt), mysql_stmt_error(stmt));
+        return RET_ERR;
+    }
+
+    return RET_OK;
+}
+
+static void* RunWorker(void* arg) {
+    PstWorker* worker = (PstWorker*)arg;
+    worker->ret = RET_OK;
+
+    mysql_thread_init();
+
+    if (pst_session_Open(&worker->session, g_conn, g_prep_stmts) != RET_OK) {
+        worker->ret = RET_ERR;
+        atomic_store(&g_abort, 1);
+    } else {
+        log_info("Worker %u connected.", worker->id);
+    }
+
+    PstWorkItem item;
+    while (worker->ret == RET_OK && !atomic_load(&g_abort) && pst_queue_Next(&item)) {
+        /* the first execution on the connection prepares the statement, */
+        /* before its latency starts */
+        MYSQL_STMT* stmt = pst_session_GetStatement(&worker->session, &g_prep_stmts->prep_stmt[item.stmt_index], item.stmt_index);
+        if (stmt == NULL) {
+            pst_queue_Release(&item);
+            worker->ret = RET_ERR;
+            atomic_store(&g_abort, 1);
+            break;
+        }
+
+        uint64_t start;
+        if (item.intended_start != 0) {
+            /* open loop: wait for the slot, then measure from it rather than */
+            /* from the moment the worker became free, so server stalls show up */
+            pst_SleepUntilNs(item.intended_start);
+            start = item.intended_start;
+            pst_stats_RecordLateness(&worker->stats, pst_GetMonotonicNs() - item.intended_start);
+        } else {
+            start = pst_GetMonotonicNs();
+        }
+
+        uint64_t end = 0;
+        int ret = ExecuteWorkItem(worker, &item, stmt, &end);
+        if (ret != RET_OK) {
+            pst_queue_Release(&item);
+            worker->ret = RET_ERR;
+            atomic_store(&g_abort, 1);
+            break;
+        }
+
+        /* output and the print lock are not database latency; recorded */
+        /* before the release, statements may be added once none runs */
+        pst_stats_RecordLatency(&worker->stats, item.stmt_index, end - start);
+        pst_queue_Release(&item);
+    }
+
+    worker->stats.arena_high_water = worker->session.arena.high_water;
+    pst_session_Close(&worker->session);
+    pst_print_FreeChunk(&worker->chunk);
+    log_info("Worker %u finished after %lu executions.", worker->id, worker->stats.executions);
+
+    mysql_thread_end();
+
+    return NULL;
+}